@@ -1807,6 +1807,61 @@ static void blk_account_io_done(struct request *req)
 	}
 }
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+static void blk_latency_add(struct blk_latency_stat *stat, u64 start, u64 end)
+{
+	unsigned long us;
+	int bucket;
+
+	if (end <= start)
+		us = 0;
+	else if (likely(end - start < (1ULL << 32)))
+		us = (u32)(end - start) / NSEC_PER_USEC;
+	else
+		us = div_u64(end - start, NSEC_PER_USEC);
+
+	bucket = min_t(int, fls_long(us), BLK_LAT_NR_BUCKETS - 1);
+	stat->buckets[bucket]++;
+	stat->nr++;
+	stat->total_us += us;
+	if (us > stat->max_us)
+		stat->max_us = us;
+}
+
+/*
+ * Account queue-to-dispatch and dispatch-to-complete latency of @req.
+ * The flush machinery completes the data part of a FLUSH/FUA request
+ * and the request itself separately; only the latter is accounted.
+ * The flushes it issues are accounted through flush_rq.
+ */
+static void blk_account_io_latency(struct request *req)
+{
+	struct request_queue *q = req->q;
+	int type;
+
+	if (!blk_account_rq(req) || !req->io_start_time_ns)
+		return;
+	if ((req->cmd_flags & REQ_FLUSH_SEQ) && req != &q->flush_rq)
+		return;
+
+	if (req->cmd_flags & REQ_FLUSH)
+		type = BLK_LAT_FLUSH;
+	else if (rq_data_dir(req) == READ)
+		type = BLK_LAT_READ;
+	else if (rq_is_sync(req))
+		type = BLK_LAT_SYNC_WRITE;
+	else
+		type = BLK_LAT_WRITE;
+
+	blk_latency_add(&q->q2d_hist.stat[type], req->start_time_ns,
+			req->io_start_time_ns);
+	blk_latency_add(&q->d2c_hist.stat[type], req->io_start_time_ns,
+			sched_clock());
+}
+#else
+static inline void blk_account_io_latency(struct request *req) { }
+#endif
+
 /**
  * blk_peek_request - peek at the top of a request queue
  * @q: request queue to peek at
@@ -2212,7 +2267,7 @@ static void blk_finish_request(struct request *req, int error)
 	if (req->cmd_flags & REQ_DONTPREP)
 		blk_unprep_request(req);
 
-
+	blk_account_io_latency(req);
 	blk_account_io_done(req);
 
 	if (req->end_io)
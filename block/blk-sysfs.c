@@ -266,6 +266,80 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+static ssize_t queue_latency_hist_show(struct request_queue *q,
+				       struct blk_latency_hist *hist, char *page)
+{
+	struct blk_latency_hist snap;
+	ssize_t len;
+	int i, t;
+
+	spin_lock_irq(q->queue_lock);
+	snap = *hist;
+	spin_unlock_irq(q->queue_lock);
+
+	len = sprintf(page, "usecs\tread\twrite\tsync_write\tflush\n");
+	for (i = 0; i < BLK_LAT_NR_BUCKETS; i++) {
+		if (i < BLK_LAT_NR_BUCKETS - 1)
+			len += sprintf(page + len, "<%lu", 1UL << i);
+		else
+			len += sprintf(page + len, ">=%lu", 1UL << (i - 1));
+		for (t = 0; t < BLK_LAT_NR_TYPES; t++)
+			len += sprintf(page + len, "\t%lu",
+				       snap.stat[t].buckets[i]);
+		len += sprintf(page + len, "\n");
+	}
+
+	len += sprintf(page + len, "nr");
+	for (t = 0; t < BLK_LAT_NR_TYPES; t++)
+		len += sprintf(page + len, "\t%lu", snap.stat[t].nr);
+	len += sprintf(page + len, "\navg");
+	for (t = 0; t < BLK_LAT_NR_TYPES; t++)
+		len += sprintf(page + len, "\t%llu", snap.stat[t].nr ?
+			       div_u64(snap.stat[t].total_us, snap.stat[t].nr) :
+			       0ULL);
+	len += sprintf(page + len, "\nmax");
+	for (t = 0; t < BLK_LAT_NR_TYPES; t++)
+		len += sprintf(page + len, "\t%lu", snap.stat[t].max_us);
+	len += sprintf(page + len, "\n");
+
+	return len;
+}
+
+static ssize_t queue_latency_hist_store(struct request_queue *q,
+					struct blk_latency_hist *hist,
+					size_t count)
+{
+	spin_lock_irq(q->queue_lock);
+	memset(hist, 0, sizeof(*hist));
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+
+static ssize_t queue_q2d_hist_show(struct request_queue *q, char *page)
+{
+	return queue_latency_hist_show(q, &q->q2d_hist, page);
+}
+
+static ssize_t
+queue_q2d_hist_store(struct request_queue *q, const char *page, size_t count)
+{
+	return queue_latency_hist_store(q, &q->q2d_hist, count);
+}
+
+static ssize_t queue_d2c_hist_show(struct request_queue *q, char *page)
+{
+	return queue_latency_hist_show(q, &q->d2c_hist, page);
+}
+
+static ssize_t
+queue_d2c_hist_store(struct request_queue *q, const char *page, size_t count)
+{
+	return queue_latency_hist_store(q, &q->d2c_hist, count);
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -380,6 +454,20 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+static struct queue_sysfs_entry queue_q2d_hist_entry = {
+	.attr = {.name = "q2d_latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_q2d_hist_show,
+	.store = queue_q2d_hist_store,
+};
+
+static struct queue_sysfs_entry queue_d2c_hist_entry = {
+	.attr = {.name = "d2c_latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_d2c_hist_show,
+	.store = queue_d2c_hist_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -402,6 +490,10 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_LATENCY_HIST
+	&queue_q2d_hist_entry.attr,
+	&queue_d2c_hist_entry.attr,
+#endif
 	NULL,
 };
 
@@ -0,0 +1,429 @@
+/*
+ *  ROW (Read Over Write) i/o scheduler.
+ *
+ *  A scheduler for flash based block devices, where seeks are free and
+ *  idling for a process to issue its next request only wastes device
+ *  time.  Requests are kept in per class FIFOs (sync reads, sync writes,
+ *  async writes) and are dispatched by class priority.  Each class may
+ *  dispatch up to its quantum of requests per round, so reads always go
+ *  first but cannot shut writes out completely, and a write that has
+ *  waited longer than its class' starvation limit is dispatched ahead
+ *  of everything else, within what is left of its quantum.
+ *
+ *  See Documentation/block/row-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+
+enum row_class {
+	ROW_SYNC_READ,
+	ROW_SYNC_WRITE,
+	ROW_ASYNC_WRITE,
+	ROW_NR_CLASSES,
+};
+
+/* requests a class may dispatch per round */
+static const int row_quantum[ROW_NR_CLASSES] = { 100, 20, 5 };
+/* max time a request may wait before it is dispatched out of turn */
+static const int row_starve_ms[ROW_NR_CLASSES] = { 0, 100, 500 };
+/* upper limit for the starvation tunables */
+#define ROW_MAX_STARVE_MS	60000
+
+/*
+ * Completion latency histogram.  Bucket 0 counts requests that took less
+ * than ROW_LAT_MIN_US, each following bucket doubles the limit, and the
+ * last one has no upper limit.
+ */
+#define ROW_LAT_BUCKETS		16
+#define ROW_LAT_MIN_SHIFT	7	/* 128 us */
+#define ROW_LAT_MIN_US		(1U << ROW_LAT_MIN_SHIFT)
+
+struct row_lat_stats {
+	unsigned long hist[ROW_LAT_BUCKETS];
+	unsigned long nr;
+	u64 total_us;
+	u32 max_us;
+};
+
+struct row_queue {
+	struct list_head fifo;
+	int quantum;
+	int starve_expire;		/* in jiffies, 0 disables */
+	int dispatched;			/* in the current round */
+	struct row_lat_stats lat;
+};
+
+struct row_data {
+	struct request_queue *queue;
+	struct row_queue rq[ROW_NR_CLASSES];
+};
+
+/*
+ * The class and the time the request entered the scheduler are kept in
+ * the elevator private pointers; the starvation deadline goes in the
+ * fifo time like deadline does.
+ */
+#define RQ_ROW_CLASS(rq)	((enum row_class)(long)(rq)->elevator_private[0])
+#define RQ_ROW_TIME(rq)		((u32)(unsigned long)(rq)->elevator_private[1])
+
+static inline u32 row_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+static enum row_class row_classify(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return ROW_SYNC_READ;
+	if (rq_is_sync(rq))
+		return ROW_SYNC_WRITE;
+	return ROW_ASYNC_WRITE;
+}
+
+static void row_add_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	enum row_class cls = row_classify(rq);
+	struct row_queue *rowq = &rd->rq[cls];
+
+	rq->elevator_private[0] = (void *)(long)cls;
+	rq->elevator_private[1] = (void *)(unsigned long)row_now_us();
+
+	rq_set_fifo_time(rq, jiffies + rowq->starve_expire);
+	list_add_tail(&rq->queuelist, &rowq->fifo);
+}
+
+static void row_merged_requests(struct request_queue *q, struct request *rq,
+				struct request *next)
+{
+	/*
+	 * if next has waited longer than rq, rq takes over its place in
+	 * the fifo as well as its times (next will be deleted)
+	 */
+	if (RQ_ROW_CLASS(rq) == RQ_ROW_CLASS(next) &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq_set_fifo_time(rq, rq_fifo_time(next));
+		rq->elevator_private[1] = next->elevator_private[1];
+	}
+
+	rq_fifo_clear(next);
+}
+
+static struct request *
+row_former_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	if (rq->queuelist.prev == &rd->rq[RQ_ROW_CLASS(rq)].fifo)
+		return NULL;
+	return rq_entry_fifo(rq->queuelist.prev);
+}
+
+static struct request *
+row_latter_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	if (rq->queuelist.next == &rd->rq[RQ_ROW_CLASS(rq)].fifo)
+		return NULL;
+	return rq_entry_fifo(rq->queuelist.next);
+}
+
+/*
+ * Find a class whose oldest request has waited past its starvation
+ * limit.  Higher priority classes are checked first.  Out of turn
+ * dispatches count against the quantum, so a class that has used it up
+ * waits for the next round like any other: a backlog of starved writes
+ * can't hold reads back by more than one write quantum.
+ */
+static int row_starved_class(struct row_data *rd)
+{
+	int cls;
+
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++) {
+		struct row_queue *rowq = &rd->rq[cls];
+
+		if (!rowq->starve_expire || list_empty(&rowq->fifo) ||
+		    rowq->dispatched >= rowq->quantum)
+			continue;
+		if (time_after(jiffies, rq_fifo_time(rq_entry_fifo(
+						rowq->fifo.next))))
+			return cls;
+	}
+
+	return -1;
+}
+
+/*
+ * Pick the highest priority class that has requests and quantum left in
+ * this round.  When every busy class has used up its quantum, a new
+ * round starts.
+ */
+static int row_next_class(struct row_data *rd)
+{
+	int cls;
+
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++)
+		if (!list_empty(&rd->rq[cls].fifo) &&
+		    rd->rq[cls].dispatched < rd->rq[cls].quantum)
+			return cls;
+
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++)
+		rd->rq[cls].dispatched = 0;
+
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++)
+		if (!list_empty(&rd->rq[cls].fifo))
+			return cls;
+
+	return -1;
+}
+
+/*
+ * There is no idling: if anything is queued, something is dispatched.
+ */
+static int row_dispatch_requests(struct request_queue *q, int force)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_queue *rowq;
+	struct request *rq;
+	int cls;
+
+	cls = row_starved_class(rd);
+	if (cls < 0)
+		cls = row_next_class(rd);
+	if (cls < 0)
+		return 0;
+
+	rowq = &rd->rq[cls];
+	rq = rq_entry_fifo(rowq->fifo.next);
+	rq_fifo_clear(rq);
+	elv_dispatch_add_tail(q, rq);
+	rowq->dispatched++;
+
+	return 1;
+}
+
+static void row_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_lat_stats *lat = &rd->rq[RQ_ROW_CLASS(rq)].lat;
+	u32 us = row_now_us() - RQ_ROW_TIME(rq);
+	int bucket;
+
+	bucket = fls(us >> ROW_LAT_MIN_SHIFT);
+	if (bucket >= ROW_LAT_BUCKETS)
+		bucket = ROW_LAT_BUCKETS - 1;
+
+	lat->hist[bucket]++;
+	lat->nr++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+}
+
+static void row_exit_queue(struct elevator_queue *e)
+{
+	struct row_data *rd = e->elevator_data;
+	int cls;
+
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++)
+		BUG_ON(!list_empty(&rd->rq[cls].fifo));
+
+	kfree(rd);
+}
+
+/*
+ * initialize elevator private data (row_data).
+ */
+static void *row_init_queue(struct request_queue *q)
+{
+	struct row_data *rd;
+	int cls;
+
+	rd = kmalloc_node(sizeof(*rd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!rd)
+		return NULL;
+
+	rd->queue = q;
+	for (cls = 0; cls < ROW_NR_CLASSES; cls++) {
+		INIT_LIST_HEAD(&rd->rq[cls].fifo);
+		rd->rq[cls].quantum = row_quantum[cls];
+		rd->rq[cls].starve_expire = msecs_to_jiffies(row_starve_ms[cls]);
+	}
+	return rd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+row_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+row_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return row_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(row_read_quantum_show, rd->rq[ROW_SYNC_READ].quantum, 0);
+SHOW_FUNCTION(row_sync_write_quantum_show, rd->rq[ROW_SYNC_WRITE].quantum, 0);
+SHOW_FUNCTION(row_async_write_quantum_show, rd->rq[ROW_ASYNC_WRITE].quantum, 0);
+SHOW_FUNCTION(row_sync_write_starve_show,
+	      rd->rq[ROW_SYNC_WRITE].starve_expire, 1);
+SHOW_FUNCTION(row_async_write_starve_show,
+	      rd->rq[ROW_ASYNC_WRITE].starve_expire, 1);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data;							\
+	int ret = row_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(row_read_quantum_store, &rd->rq[ROW_SYNC_READ].quantum,
+	       1, INT_MAX, 0);
+STORE_FUNCTION(row_sync_write_quantum_store, &rd->rq[ROW_SYNC_WRITE].quantum,
+	       1, INT_MAX, 0);
+STORE_FUNCTION(row_async_write_quantum_store,
+	       &rd->rq[ROW_ASYNC_WRITE].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_sync_write_starve_store,
+	       &rd->rq[ROW_SYNC_WRITE].starve_expire, 0, ROW_MAX_STARVE_MS, 1);
+STORE_FUNCTION(row_async_write_starve_store,
+	       &rd->rq[ROW_ASYNC_WRITE].starve_expire, 0, ROW_MAX_STARVE_MS, 1);
+#undef STORE_FUNCTION
+
+static ssize_t row_lat_show(struct row_data *rd, struct row_lat_stats *lat,
+			    char *page)
+{
+	struct row_lat_stats snap;
+	char *p = page;
+	int i;
+
+	spin_lock_irq(rd->queue->queue_lock);
+	snap = *lat;
+	spin_unlock_irq(rd->queue->queue_lock);
+
+	p += sprintf(p, "requests %lu\n", snap.nr);
+	p += sprintf(p, "avg_us %llu\n", snap.nr ?
+		     div_u64(snap.total_us, snap.nr) : 0ULL);
+	p += sprintf(p, "max_us %u\n", snap.max_us);
+	for (i = 0; i < ROW_LAT_BUCKETS - 1; i++)
+		p += sprintf(p, "<%u %lu\n", ROW_LAT_MIN_US << i,
+			     snap.hist[i]);
+	p += sprintf(p, ">=%u %lu\n", ROW_LAT_MIN_US << i, snap.hist[i]);
+
+	return p - page;
+}
+
+/* any write clears the histogram */
+static ssize_t row_lat_store(struct row_data *rd, struct row_lat_stats *lat,
+			     size_t count)
+{
+	spin_lock_irq(rd->queue->queue_lock);
+	memset(lat, 0, sizeof(*lat));
+	spin_unlock_irq(rd->queue->queue_lock);
+
+	return count;
+}
+
+#define LAT_FUNCTIONS(__NAME, __CLASS)					\
+static ssize_t row_##__NAME##_lat_show(struct elevator_queue *e, char *page) \
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	return row_lat_show(rd, &rd->rq[__CLASS].lat, page);		\
+}									\
+static ssize_t row_##__NAME##_lat_store(struct elevator_queue *e,	\
+					const char *page, size_t count)	\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	return row_lat_store(rd, &rd->rq[__CLASS].lat, count);		\
+}
+LAT_FUNCTIONS(read, ROW_SYNC_READ);
+LAT_FUNCTIONS(sync_write, ROW_SYNC_WRITE);
+LAT_FUNCTIONS(async_write, ROW_ASYNC_WRITE);
+#undef LAT_FUNCTIONS
+
+#define ROW_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
+				      row_##name##_store)
+
+static struct elv_fs_entry row_attrs[] = {
+	ROW_ATTR(read_quantum),
+	ROW_ATTR(sync_write_quantum),
+	ROW_ATTR(async_write_quantum),
+	ROW_ATTR(sync_write_starve),
+	ROW_ATTR(async_write_starve),
+	ROW_ATTR(read_lat),
+	ROW_ATTR(sync_write_lat),
+	ROW_ATTR(async_write_lat),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_row = {
+	.ops = {
+		.elevator_merge_req_fn =	row_merged_requests,
+		.elevator_dispatch_fn =		row_dispatch_requests,
+		.elevator_add_req_fn =		row_add_request,
+		.elevator_completed_req_fn =	row_completed_request,
+		.elevator_former_req_fn =	row_former_request,
+		.elevator_latter_req_fn =	row_latter_request,
+		.elevator_init_fn =		row_init_queue,
+		.elevator_exit_fn =		row_exit_queue,
+	},
+
+	.elevator_attrs = row_attrs,
+	.elevator_name = "row",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init row_init(void)
+{
+	elv_register(&iosched_row);
+
+	return 0;
+}
+
+static void __exit row_exit(void)
+{
+	elv_unregister(&iosched_row);
+}
+
+module_init(row_init);
+module_exit(row_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Read Over Write IO scheduler");
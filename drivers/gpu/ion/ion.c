@@ -19,12 +19,14 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
+#include <linux/idr.h>
 #include <linux/ion.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/rbtree.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -39,14 +41,17 @@
  * struct ion_device - the metadata of the ion device node
  * @dev:		the actual misc device
  * @buffers:	an rb tree of all the existing buffers
- * @lock:		lock protecting the buffers & heaps trees
+ * @buffer_lock:	lock protecting the tree of buffers
+ * @lock:		rwsem protecting the heaps & clients trees, allocations
+ *			only take it for reading
  * @heaps:		list of all the heaps in the system
  * @user_clients:	list of all the clients created from userspace
  */
 struct ion_device {
 	struct miscdevice dev;
 	struct rb_root buffers;
-	struct mutex lock;
+	struct mutex buffer_lock;
+	struct rw_semaphore lock;
 	struct rb_root heaps;
 	long (*custom_ioctl) (struct ion_client *client, unsigned int cmd,
 			      unsigned long arg);
@@ -60,8 +65,13 @@ struct ion_device {
  * @ref:		for reference counting the client
  * @node:		node in the tree of all clients
  * @dev:		backpointer to ion device
- * @handles:		an rb tree of all the handles in this client
- * @lock:		lock protecting the tree of handles
+ * @handles:		an rb tree of all the handles in this client, sorted
+ *			by buffer
+ * @handle_ptrs:	the same handles sorted by address, for validating
+ *			handle pointers from kernel callers
+ * @idr:		an idr space for the ids of the handles, which is
+ *			what userspace gets to see
+ * @lock:		lock protecting the tree of handles and the idr
  * @heap_mask:		mask of all supported heaps
  * @name:		used for debugging
  * @task:		used for debugging
@@ -75,6 +85,8 @@ struct ion_client {
 	struct rb_node node;
 	struct ion_device *dev;
 	struct rb_root handles;
+	struct rb_root handle_ptrs;
+	struct idr idr;
 	struct mutex lock;
 	unsigned int heap_mask;
 	char *name;
@@ -89,18 +101,24 @@ struct ion_client {
  * @client:		back pointer to the client the buffer resides in
  * @buffer:		pointer to the buffer
  * @node:		node in the client's handle rbtree
+ * @ptr_node:		node in the client's tree of handles by address
+ * @id:			id of the handle in the client's idr, 0 until added
  * @kmap_cnt:		count of times this client has mapped to kernel
  * @dmap_cnt:		count of times this client has mapped for dma
  * @usermap_cnt:	count of times this client has mapped for userspace
+ * @iommu_map_cnt:	count of times this client has mapped to an iommu
  *
- * Modifications to node, map_cnt or mapping should be protected by the
- * lock in the client.  Other fields are never changed after initialization.
+ * Modifications to node, id, map_cnt or mapping should be protected by the
+ * lock in the client, except for iommu_map_cnt which is protected by the
+ * lock in the buffer.  Other fields are never changed after initialization.
  */
 struct ion_handle {
 	struct kref ref;
 	struct ion_client *client;
 	struct ion_buffer *buffer;
 	struct rb_node node;
+	struct rb_node ptr_node;
+	int id;
 	unsigned int kmap_cnt;
 	unsigned int dmap_cnt;
 	unsigned int usermap_cnt;
@@ -125,7 +143,7 @@ static int ion_validate_buffer_flags(struct ion_buffer *buffer,
 	return 0;
 }
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->buffer_lock is held */
 static void ion_buffer_add(struct ion_device *dev,
 			   struct ion_buffer *buffer)
 {
@@ -206,7 +224,7 @@ static struct ion_iommu_map *ion_iommu_lookup(struct ion_buffer *buffer,
 	return NULL;
 }
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->lock is held for reading */
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
 				     unsigned long len,
@@ -231,7 +249,9 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->dev = dev;
 	buffer->size = len;
 	mutex_init(&buffer->lock);
+	mutex_lock(&dev->buffer_lock);
 	ion_buffer_add(dev, buffer);
+	mutex_unlock(&dev->buffer_lock);
 	return buffer;
 }
 
@@ -241,9 +261,9 @@ static void ion_buffer_destroy(struct kref *kref)
 	struct ion_device *dev = buffer->dev;
 
 	buffer->heap->ops->free(buffer);
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	rb_erase(&buffer->node, &dev->buffers);
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->buffer_lock);
 	kfree(buffer);
 }
 
@@ -267,6 +287,7 @@ static struct ion_handle *ion_handle_create(struct ion_client *client,
 		return ERR_PTR(-ENOMEM);
 	kref_init(&handle->ref);
 	rb_init_node(&handle->node);
+	rb_init_node(&handle->ptr_node);
 	handle->client = client;
 	ion_buffer_get(buffer);
 	handle->buffer = buffer;
@@ -285,6 +306,10 @@ static void ion_handle_destroy(struct kref *kref)
 	ion_buffer_put(handle->buffer);
 	if (!RB_EMPTY_NODE(&handle->node))
 		rb_erase(&handle->node, &handle->client->handles);
+	if (!RB_EMPTY_NODE(&handle->ptr_node))
+		rb_erase(&handle->ptr_node, &handle->client->handle_ptrs);
+	if (handle->id)
+		idr_remove(&handle->client->idr, handle->id);
 	kfree(handle);
 }
 
@@ -303,27 +328,43 @@ static int ion_handle_put(struct ion_handle *handle)
 	return kref_put(&handle->ref, ion_handle_destroy);
 }
 
+/* Client lock must be locked when calling */
 static struct ion_handle *ion_handle_lookup(struct ion_client *client,
 					    struct ion_buffer *buffer)
 {
-	struct rb_node *n;
+	struct rb_node *n = client->handles.rb_node;
 
-	for (n = rb_first(&client->handles); n; n = rb_next(n)) {
+	while (n) {
 		struct ion_handle *handle = rb_entry(n, struct ion_handle,
 						     node);
-		if (handle->buffer == buffer)
+		if (buffer < handle->buffer)
+			n = n->rb_left;
+		else if (buffer > handle->buffer)
+			n = n->rb_right;
+		else
 			return handle;
 	}
 	return NULL;
 }
 
+/* Client lock must be locked when calling */
+static struct ion_handle *ion_handle_find_by_id(struct ion_client *client,
+						int id)
+{
+	return idr_find(&client->idr, id);
+}
+
+/*
+ * Client lock must be locked when calling.  @handle comes from the
+ * caller and may be stale, so it is only compared, never dereferenced.
+ */
 static bool ion_handle_validate(struct ion_client *client, struct ion_handle *handle)
 {
-	struct rb_node *n = client->handles.rb_node;
+	struct rb_node *n = client->handle_ptrs.rb_node;
 
 	while (n) {
 		struct ion_handle *handle_node = rb_entry(n, struct ion_handle,
-							  node);
+							  ptr_node);
 		if (handle < handle_node)
 			n = n->rb_left;
 		else if (handle > handle_node)
@@ -334,33 +375,94 @@ static bool ion_handle_validate(struct ion_client *client, struct ion_handle *ha
 	return false;
 }
 
-static void ion_handle_add(struct ion_client *client, struct ion_handle *handle)
+/*
+ * Look up a handle by the id userspace passed in, and take a reference
+ * to it so that it stays around after the client lock is dropped.
+ */
+static struct ion_handle *ion_handle_get_by_id(struct ion_client *client,
+					       int id)
+{
+	struct ion_handle *handle;
+
+	mutex_lock(&client->lock);
+	handle = ion_handle_find_by_id(client, id);
+	if (handle)
+		ion_handle_get(handle);
+	mutex_unlock(&client->lock);
+
+	return handle ? handle : ERR_PTR(-EINVAL);
+}
+
+static void ion_handle_put_unlocked(struct ion_handle *handle)
+{
+	struct ion_client *client = handle->client;
+
+	mutex_lock(&client->lock);
+	ion_handle_put(handle);
+	mutex_unlock(&client->lock);
+}
+
+/* Client lock must be locked when calling */
+static int ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 {
 	struct rb_node **p = &client->handles.rb_node;
 	struct rb_node *parent = NULL;
 	struct ion_handle *entry;
+	int id;
+	int ret;
 
 	while (*p) {
 		parent = *p;
 		entry = rb_entry(parent, struct ion_handle, node);
 
-		if (handle < entry)
+		if (handle->buffer < entry->buffer) {
 			p = &(*p)->rb_left;
-		else if (handle > entry)
+		} else if (handle->buffer > entry->buffer) {
 			p = &(*p)->rb_right;
-		else
+		} else {
 			WARN(1, "%s: buffer already found.", __func__);
+			return -EEXIST;
+		}
 	}
 
+	do {
+		if (!idr_pre_get(&client->idr, GFP_KERNEL))
+			return -ENOMEM;
+		ret = idr_get_new_above(&client->idr, handle, 1, &id);
+	} while (ret == -EAGAIN);
+	if (ret)
+		return ret;
+	handle->id = id;
+
 	rb_link_node(&handle->node, parent, p);
 	rb_insert_color(&handle->node, &client->handles);
+
+	p = &client->handle_ptrs.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct ion_handle, ptr_node);
+		if (handle < entry)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&handle->ptr_node, parent, p);
+	rb_insert_color(&handle->ptr_node, &client->handle_ptrs);
+	return 0;
 }
 
-struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
-			     size_t align, unsigned int flags)
+/*
+ * @id, if not NULL, is set to the id of the new handle while the client
+ * lock is still held, for handing it to userspace.
+ */
+static struct ion_handle *__ion_alloc(struct ion_client *client, size_t len,
+				      size_t align, unsigned int flags,
+				      int *id)
 {
 	struct rb_node *n;
 	struct ion_handle *handle;
+	int ret;
 	struct ion_device *dev = client->dev;
 	struct ion_buffer *buffer = NULL;
 	unsigned long secure_allocation = flags & ION_SECURE;
@@ -374,9 +476,10 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	 * traverse the list of heaps available in this system in priority
 	 * order.  If the heap type is supported by the client, and matches the
 	 * request of the caller allocate from it.  Repeat until allocate has
-	 * succeeded or all heaps have been tried
+	 * succeeded or all heaps have been tried.  The heaps do their own
+	 * locking, so allocations only keep the heaps from changing.
 	 */
-	mutex_lock(&dev->lock);
+	down_read(&dev->lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		/* if the client doesn't support this heap type */
@@ -407,7 +510,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 			}
 		}
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->lock);
 
 	if (IS_ERR_OR_NULL(buffer)) {
 		pr_debug("ION is unable to allocate 0x%x bytes (alignment: "
@@ -429,7 +532,13 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	ion_buffer_put(buffer);
 
 	mutex_lock(&client->lock);
-	ion_handle_add(client, handle);
+	ret = ion_handle_add(client, handle);
+	if (ret) {
+		ion_handle_put(handle);
+		handle = ERR_PTR(ret);
+	} else if (id) {
+		*id = handle->id;
+	}
 	mutex_unlock(&client->lock);
 	return handle;
 
@@ -437,6 +546,12 @@ end:
 	ion_buffer_put(buffer);
 	return handle;
 }
+
+struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
+			     size_t align, unsigned int flags)
+{
+	return __ion_alloc(client, len, align, flags, NULL);
+}
 EXPORT_SYMBOL(ion_alloc);
 
 void ion_free(struct ion_client *client, struct ion_handle *handle)
@@ -613,6 +728,11 @@ int ion_map_iommu(struct ion_client *client, struct ion_handle *handle,
 	struct ion_iommu_map *iommu_map;
 	int ret = 0;
 
+	/*
+	 * Mapping into the iommu is slow.  Hold a reference to the handle
+	 * and only the buffer lock while doing it, so that the rest of the
+	 * client isn't held up.
+	 */
 	mutex_lock(&client->lock);
 	if (!ion_handle_validate(client, handle)) {
 		pr_err("%s: invalid handle passed to map_kernel.\n",
@@ -620,6 +740,8 @@ int ion_map_iommu(struct ion_client *client, struct ion_handle *handle,
 		mutex_unlock(&client->lock);
 		return -EINVAL;
 	}
+	ion_handle_get(handle);
+	mutex_unlock(&client->lock);
 
 	buffer = handle->buffer;
 	mutex_lock(&buffer->lock);
@@ -689,7 +811,7 @@ int ion_map_iommu(struct ion_client *client, struct ion_handle *handle,
 	*buffer_size = buffer->size;
 out:
 	mutex_unlock(&buffer->lock);
-	mutex_unlock(&client->lock);
+	ion_handle_put_unlocked(handle);
 	return ret;
 }
 EXPORT_SYMBOL(ion_map_iommu);
@@ -712,8 +834,16 @@ void ion_unmap_iommu(struct ion_client *client, struct ion_handle *handle,
 	struct ion_buffer *buffer;
 
 	mutex_lock(&client->lock);
-	buffer = handle->buffer;
+	if (!ion_handle_validate(client, handle)) {
+		pr_err("%s: invalid handle passed to unmap_iommu.\n",
+		       __func__);
+		mutex_unlock(&client->lock);
+		return;
+	}
+	ion_handle_get(handle);
+	mutex_unlock(&client->lock);
 
+	buffer = handle->buffer;
 	mutex_lock(&buffer->lock);
 
 	iommu_map = ion_iommu_lookup(buffer, domain_num, partition_num);
@@ -729,9 +859,7 @@ void ion_unmap_iommu(struct ion_client *client, struct ion_handle *handle,
 
 out:
 	mutex_unlock(&buffer->lock);
-
-	mutex_unlock(&client->lock);
-
+	ion_handle_put_unlocked(handle);
 }
 EXPORT_SYMBOL(ion_unmap_iommu);
 
@@ -835,10 +963,12 @@ struct ion_buffer *ion_share(struct ion_client *client,
 }
 EXPORT_SYMBOL(ion_share);
 
-struct ion_handle *ion_import(struct ion_client *client,
-			      struct ion_buffer *buffer)
+/* @id is as for __ion_alloc() */
+static struct ion_handle *__ion_import(struct ion_client *client,
+				       struct ion_buffer *buffer, int *id)
 {
 	struct ion_handle *handle = NULL;
+	int ret;
 
 	mutex_lock(&client->lock);
 	/* if a handle exists for this buffer just take a reference to it */
@@ -849,12 +979,26 @@ struct ion_handle *ion_import(struct ion_client *client,
 	}
 	handle = ion_handle_create(client, buffer);
 	if (IS_ERR_OR_NULL(handle))
-		goto end;
-	ion_handle_add(client, handle);
+		goto out;
+	ret = ion_handle_add(client, handle);
+	if (ret) {
+		ion_handle_put(handle);
+		handle = ERR_PTR(ret);
+		goto out;
+	}
 end:
+	if (id)
+		*id = handle->id;
+out:
 	mutex_unlock(&client->lock);
 	return handle;
 }
+
+struct ion_handle *ion_import(struct ion_client *client,
+			      struct ion_buffer *buffer)
+{
+	return __ion_import(client, buffer, NULL);
+}
 EXPORT_SYMBOL(ion_import);
 
 static int check_vaddr_bounds(unsigned long start, unsigned long end)
@@ -896,6 +1040,9 @@ static int ion_do_cache_op(struct ion_client *client, struct ion_handle *handle,
 		mutex_unlock(&client->lock);
 		return -EINVAL;
 	}
+	ion_handle_get(handle);
+	mutex_unlock(&client->lock);
+
 	buffer = handle->buffer;
 	mutex_lock(&buffer->lock);
 
@@ -917,16 +1064,23 @@ static int ion_do_cache_op(struct ion_client *client, struct ion_handle *handle,
 
 out:
 	mutex_unlock(&buffer->lock);
-	mutex_unlock(&client->lock);
+	ion_handle_put_unlocked(handle);
 	return ret;
 
 }
 
 static const struct file_operations ion_share_fops;
 
-struct ion_handle *ion_import_fd(struct ion_client *client, int fd)
+/*
+ * The share file holds a reference to the buffer, so the buffer can be
+ * used for as long as the file is.  fget_light() finds the file under
+ * rcu and doesn't touch its refcount unless the file table is shared.
+ */
+static struct ion_handle *__ion_import_fd(struct ion_client *client, int fd,
+					  int *id)
 {
-	struct file *file = fget(fd);
+	int fput_needed;
+	struct file *file = fget_light(fd, &fput_needed);
 	struct ion_handle *handle;
 
 	if (!file) {
@@ -939,11 +1093,16 @@ struct ion_handle *ion_import_fd(struct ion_client *client, int fd)
 		handle = ERR_PTR(-EINVAL);
 		goto end;
 	}
-	handle = ion_import(client, file->private_data);
+	handle = __ion_import(client, file->private_data, id);
 end:
-	fput(file);
+	fput_light(file, fput_needed);
 	return handle;
 }
+
+struct ion_handle *ion_import_fd(struct ion_client *client, int fd)
+{
+	return __ion_import_fd(client, fd, NULL);
+}
 EXPORT_SYMBOL(ion_import_fd);
 
 static int ion_debug_client_show(struct seq_file *s, void *unused)
@@ -990,12 +1149,12 @@ static struct ion_client *ion_client_lookup(struct ion_device *dev,
 	struct rb_node *n = dev->user_clients.rb_node;
 	struct ion_client *client;
 
-	mutex_lock(&dev->lock);
+	down_read(&dev->lock);
 	while (n) {
 		client = rb_entry(n, struct ion_client, node);
 		if (task == client->task) {
 			ion_client_get(client);
-			mutex_unlock(&dev->lock);
+			up_read(&dev->lock);
 			return client;
 		} else if (task < client->task) {
 			n = n->rb_left;
@@ -1003,7 +1162,7 @@ static struct ion_client *ion_client_lookup(struct ion_device *dev,
 			n = n->rb_right;
 		}
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->lock);
 	return NULL;
 }
 
@@ -1050,6 +1209,8 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 
 	client->dev = dev;
 	client->handles = RB_ROOT;
+	client->handle_ptrs = RB_ROOT;
+	idr_init(&client->idr);
 	mutex_init(&client->lock);
 
 	client->name = kzalloc(name_len+1, GFP_KERNEL);
@@ -1066,7 +1227,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	client->pid = pid;
 	kref_init(&client->ref);
 
-	mutex_lock(&dev->lock);
+	down_write(&dev->lock);
 	if (task) {
 		p = &dev->user_clients.rb_node;
 		while (*p) {
@@ -1099,7 +1260,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	client->debug_root = debugfs_create_file(name, 0664,
 						 dev->debug_root, client,
 						 &debug_client_fops);
-	mutex_unlock(&dev->lock);
+	up_write(&dev->lock);
 
 	return client;
 }
@@ -1116,7 +1277,8 @@ static void _ion_client_destroy(struct kref *kref)
 						     node);
 		ion_handle_destroy(&handle->ref);
 	}
-	mutex_lock(&dev->lock);
+	idr_destroy(&client->idr);
+	down_write(&dev->lock);
 	if (client->task) {
 		rb_erase(&client->node, &dev->user_clients);
 		put_task_struct(client->task);
@@ -1124,7 +1286,7 @@ static void _ion_client_destroy(struct kref *kref)
 		rb_erase(&client->node, &dev->kernel_clients);
 	}
 	debugfs_remove_recursive(client->debug_root);
-	mutex_unlock(&dev->lock);
+	up_write(&dev->lock);
 
 	kfree(client->name);
 	kfree(client);
@@ -1392,6 +1554,13 @@ err:
 	return -ENFILE;
 }
 
+/*
+ * Userspace sees handles by their id in the client's idr, carried in the
+ * handle fields of the ioctl structures.
+ */
+#define ion_handle_to_user(id)		((struct ion_handle *)(unsigned long)(id))
+#define ion_handle_from_user(h)		((int)(unsigned long)(h))
+
 static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct ion_client *client = filp->private_data;
@@ -1400,15 +1569,18 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case ION_IOC_ALLOC:
 	{
 		struct ion_allocation_data data;
+		struct ion_handle *handle;
+		int id;
 
 		if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
 			return -EFAULT;
-		data.handle = ion_alloc(client, data.len, data.align,
-					     data.flags);
+		handle = __ion_alloc(client, data.len, data.align,
+				     data.flags, &id);
 
-		if (IS_ERR_OR_NULL(data.handle))
+		if (IS_ERR_OR_NULL(handle))
 			return -ENOMEM;
 
+		data.handle = ion_handle_to_user(id);
 		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
 			return -EFAULT;
 		break;
@@ -1416,34 +1588,40 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case ION_IOC_FREE:
 	{
 		struct ion_handle_data data;
-		bool valid;
+		struct ion_handle *handle;
 
 		if (copy_from_user(&data, (void __user *)arg,
 				   sizeof(struct ion_handle_data)))
 			return -EFAULT;
 		mutex_lock(&client->lock);
-		valid = ion_handle_validate(client, data.handle);
-		mutex_unlock(&client->lock);
-		if (!valid)
+		handle = ion_handle_find_by_id(client,
+					ion_handle_from_user(data.handle));
+		if (!handle) {
+			mutex_unlock(&client->lock);
 			return -EINVAL;
-		ion_free(client, data.handle);
+		}
+		ion_handle_put(handle);
+		mutex_unlock(&client->lock);
 		break;
 	}
 	case ION_IOC_MAP:
 	case ION_IOC_SHARE:
 	{
 		struct ion_fd_data data;
+		struct ion_handle *handle;
 
 		if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
 			return -EFAULT;
 		mutex_lock(&client->lock);
-		if (!ion_handle_validate(client, data.handle)) {
+		handle = ion_handle_find_by_id(client,
+					ion_handle_from_user(data.handle));
+		if (!handle) {
 			pr_err("%s: invalid handle passed to share ioctl.\n",
 			       __func__);
 			mutex_unlock(&client->lock);
 			return -EINVAL;
 		}
-		data.fd = ion_ioctl_share(filp, client, data.handle);
+		data.fd = ion_ioctl_share(filp, client, handle);
 		mutex_unlock(&client->lock);
 		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
 			return -EFAULT;
@@ -1452,13 +1630,18 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case ION_IOC_IMPORT:
 	{
 		struct ion_fd_data data;
+		struct ion_handle *handle;
+		int id;
+
 		if (copy_from_user(&data, (void __user *)arg,
 				   sizeof(struct ion_fd_data)))
 			return -EFAULT;
 
-		data.handle = ion_import_fd(client, data.fd);
-		if (IS_ERR(data.handle))
+		handle = __ion_import_fd(client, data.fd, &id);
+		if (IS_ERR_OR_NULL(handle))
 			data.handle = NULL;
+		else
+			data.handle = ion_handle_to_user(id);
 		if (copy_to_user((void __user *)arg, &data,
 				 sizeof(struct ion_fd_data)))
 			return -EFAULT;
@@ -1505,15 +1688,20 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 					__func__, (int)handle);
 				return -EINVAL;
 			}
+		} else {
+			handle = ion_handle_get_by_id(client,
+					ion_handle_from_user(data.handle));
+			if (IS_ERR(handle))
+				return PTR_ERR(handle);
 		}
 
-		ret = ion_do_cache_op(client,
-					data.handle ? data.handle : handle,
-					data.vaddr, data.offset, data.length,
-					cmd);
+		ret = ion_do_cache_op(client, handle, data.vaddr, data.offset,
+				      data.length, cmd);
 
 		if (!data.handle)
 			ion_free(client, handle);
+		else
+			ion_handle_put_unlocked(handle);
 
 		break;
 
@@ -1521,12 +1709,18 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case ION_IOC_GET_FLAGS:
 	{
 		struct ion_flag_data data;
+		struct ion_handle *handle;
 		int ret;
 		if (copy_from_user(&data, (void __user *)arg,
 				   sizeof(struct ion_flag_data)))
 			return -EFAULT;
 
-		ret = ion_handle_get_flags(client, data.handle, &data.flags);
+		handle = ion_handle_get_by_id(client,
+					ion_handle_from_user(data.handle));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+		ret = ion_handle_get_flags(client, handle, &data.flags);
+		ion_handle_put_unlocked(handle);
 		if (ret < 0)
 			return ret;
 		if (copy_to_user((void __user *)arg, &data,
@@ -1644,7 +1838,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
-	mutex_lock(&dev->lock);
+	down_write(&dev->lock);
 	while (*p) {
 		parent = *p;
 		entry = rb_entry(parent, struct ion_heap, node);
@@ -1665,7 +1859,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
 			    &debug_heap_fops);
 end:
-	mutex_unlock(&dev->lock);
+	up_write(&dev->lock);
 }
 
 int ion_secure_heap(struct ion_device *dev, int heap_id)
@@ -1677,7 +1871,7 @@ int ion_secure_heap(struct ion_device *dev, int heap_id)
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
+	down_write(&dev->lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		if (heap->type != ION_HEAP_TYPE_CP)
@@ -1690,7 +1884,7 @@ int ion_secure_heap(struct ion_device *dev, int heap_id)
 			ret_val = -EINVAL;
 		break;
 	}
-	mutex_unlock(&dev->lock);
+	up_write(&dev->lock);
 	return ret_val;
 }
 
@@ -1703,7 +1897,7 @@ int ion_unsecure_heap(struct ion_device *dev, int heap_id)
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
+	down_write(&dev->lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		if (heap->type != ION_HEAP_TYPE_CP)
@@ -1716,7 +1910,7 @@ int ion_unsecure_heap(struct ion_device *dev, int heap_id)
 			ret_val = -EINVAL;
 		break;
 	}
-	mutex_unlock(&dev->lock);
+	up_write(&dev->lock);
 	return ret_val;
 }
 
@@ -1729,13 +1923,19 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 	/* mark all buffers as 1 */
 	seq_printf(s, "%16.s %16.s %16.s %16.s\n", "buffer", "heap", "size",
 		"ref cnt");
-	mutex_lock(&dev->lock);
+	down_read(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
 
 		buf->marked = 1;
 	}
+	/*
+	 * The client lock nests outside the buffer lock, drop it while
+	 * walking the clients.  Their handles keep the buffers around.
+	 */
+	mutex_unlock(&dev->buffer_lock);
 
 	/* now see which buffers we can access */
 	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n)) {
@@ -1770,6 +1970,7 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 
 	}
 	/* And anyone still marked as a 1 means a leaked handle somewhere */
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
@@ -1779,7 +1980,8 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 				(int)buf, buf->heap->name, buf->size,
 				atomic_read(&buf->ref.refcount));
 	}
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->buffer_lock);
+	up_read(&dev->lock);
 	return 0;
 }
 
@@ -1825,7 +2027,8 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 
 	idev->custom_ioctl = custom_ioctl;
 	idev->buffers = RB_ROOT;
-	mutex_init(&idev->lock);
+	init_rwsem(&idev->lock);
+	mutex_init(&idev->buffer_lock);
 	idev->heaps = RB_ROOT;
 	idev->user_clients = RB_ROOT;
 	idev->kernel_clients = RB_ROOT;
@@ -0,0 +1,176 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Pools of zeroed pages of one order for the ion heaps
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include "ion_priv.h"
+
+/*
+ * Pages are kept on page->lru.  Highmem and lowmem pages are kept apart
+ * so that a shrinker call that may not touch highmem can skip them.
+ */
+
+static struct page *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
+{
+	return alloc_pages(pool->gfp_mask, pool->order);
+}
+
+static void ion_page_pool_free_pages(struct ion_page_pool *pool,
+				     struct page *page)
+{
+	__free_pages(page, pool->order);
+}
+
+/* The caller must have zeroed the page */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	if (PageHighMem(page)) {
+		list_add_tail(&page->lru, &pool->high_items);
+		pool->high_count++;
+	} else {
+		list_add_tail(&page->lru, &pool->low_items);
+		pool->low_count++;
+	}
+	mutex_unlock(&pool->mutex);
+}
+
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
+{
+	struct page *page;
+
+	if (high) {
+		BUG_ON(!pool->high_count);
+		page = list_first_entry(&pool->high_items, struct page, lru);
+		pool->high_count--;
+	} else {
+		BUG_ON(!pool->low_count);
+		page = list_first_entry(&pool->low_items, struct page, lru);
+		pool->low_count--;
+	}
+
+	list_del(&page->lru);
+	return page;
+}
+
+/*
+ * Take a page from the pool, or allocate a new one if the pool is
+ * empty.  Pages in the pool are already zeroed.
+ */
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	mutex_lock(&pool->mutex);
+	if (pool->high_count)
+		page = ion_page_pool_remove(pool, true);
+	else if (pool->low_count)
+		page = ion_page_pool_remove(pool, false);
+	mutex_unlock(&pool->mutex);
+
+	if (!page)
+		page = ion_page_pool_alloc_pages(pool);
+
+	return page;
+}
+
+static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
+{
+	int total = pool->low_count;
+
+	if (high)
+		total += pool->high_count;
+
+	return total << pool->order;
+}
+
+/*
+ * Give up to @nr_to_scan pages back to the page allocator and return the
+ * number freed.  With @nr_to_scan zero, return the number of pages that
+ * could be freed.  Both are counted in order-0 pages.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
+			 int nr_to_scan)
+{
+	int nr_freed = 0;
+	bool high = !!(gfp_mask & __GFP_HIGHMEM);
+
+	if (nr_to_scan == 0) {
+		int total;
+
+		mutex_lock(&pool->mutex);
+		total = ion_page_pool_total(pool, high);
+		mutex_unlock(&pool->mutex);
+		return total;
+	}
+
+	mutex_lock(&pool->mutex);
+	while (nr_freed < nr_to_scan) {
+		struct page *page;
+
+		if (pool->low_count)
+			page = ion_page_pool_remove(pool, false);
+		else if (high && pool->high_count)
+			page = ion_page_pool_remove(pool, true);
+		else
+			break;
+
+		mutex_unlock(&pool->mutex);
+		ion_page_pool_free_pages(pool, page);
+		nr_freed += 1 << pool->order;
+		mutex_lock(&pool->mutex);
+	}
+	mutex_unlock(&pool->mutex);
+
+	return nr_freed;
+}
+
+int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	int count;
+
+	mutex_lock(&pool->mutex);
+	count = pool->high_count + pool->low_count;
+	mutex_unlock(&pool->mutex);
+
+	return count;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
+					     GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	pool->high_count = 0;
+	pool->low_count = 0;
+	INIT_LIST_HEAD(&pool->low_items);
+	INIT_LIST_HEAD(&pool->high_items);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+	mutex_init(&pool->mutex);
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	ion_page_pool_shrink(pool, __GFP_HIGHMEM, INT_MAX);
+	kfree(pool);
+}
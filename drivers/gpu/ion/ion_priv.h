@@ -243,6 +243,40 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
 
 
+/**
+ * struct ion_page_pool - pool of zeroed pages of one order
+ * @high_count:		number of highmem items in the pool
+ * @low_count:		number of lowmem items in the pool
+ * @high_items:		list of highmem pages, linked through page->lru
+ * @low_items:		list of lowmem pages, linked through page->lru
+ * @mutex:		protects the lists and counts
+ * @gfp_mask:		gfp mask used to allocate pages when the pool is empty
+ * @order:		order of the pages in the pool
+ *
+ * Keeps freed pages around so that they can be handed out again without
+ * going through the page allocator.  Everything in the pool is already
+ * zeroed; pages must be zeroed before they are given back with
+ * ion_page_pool_free().  ion_page_pool_shrink() returns pages to the
+ * system and is meant to be called from a shrinker.
+ */
+struct ion_page_pool {
+	int high_count;
+	int low_count;
+	struct list_head high_items;
+	struct list_head low_items;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
+			 int nr_to_scan);
+int ion_page_pool_count(struct ion_page_pool *);
+
 struct ion_heap *msm_get_contiguous_heap(void);
 /**
  * The carveout/cp heap returns physical addresses, since 0 may be a valid
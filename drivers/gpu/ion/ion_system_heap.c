@@ -16,9 +16,14 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/iommu.h>
@@ -30,51 +35,264 @@
 static atomic_t system_heap_allocated;
 static atomic_t system_contig_heap_allocated;
 
+/*
+ * The system heap hands out buffers made of chunks of 64K, 16K and 4K
+ * pages, largest first.  Bigger chunks take fewer allocator calls and
+ * can be mapped into the iommu with 64K entries.
+ *
+ * Freed chunks go onto the dirty list and a kernel thread zeroes them
+ * and puts them into the page pool of their order, so that neither
+ * allocation nor free has to clear memory.  A shrinker gives the pooled
+ * and dirty pages back when the system runs low on memory.
+ */
+static const unsigned int orders[] = {4, 2, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+/* Don't reclaim or compact for the high orders, fall back to order 0 */
+static const gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_ZERO |
+					   __GFP_NOWARN | __GFP_NORETRY) &
+					  ~__GFP_WAIT;
+static const gfp_t low_order_gfp_flags = GFP_HIGHUSER | __GFP_ZERO |
+					 __GFP_NOWARN;
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+	struct task_struct *zero_thread;
+	wait_queue_head_t waitq;
+	/* protects everything below */
+	spinlock_t lock;
+	struct list_head dirty;
+	int dirty_count;
+	unsigned long nr_allocs;
+	u64 total_alloc_us;
+	unsigned long max_alloc_us;
+};
+
+/*
+ * Chunks of a buffer are linked through page->lru, and the order of each
+ * chunk is kept in page_private() of its first page.
+ */
+struct ion_system_buffer_info {
+	struct list_head pages;
+	int nr_chunks;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static inline unsigned long order_to_size(int order)
+{
+	return PAGE_SIZE << order;
+}
+
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < order_to_size(orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+
+		set_page_private(page, orders[i]);
+		return page;
+	}
+
+	return NULL;
+}
+
+static void ion_system_heap_stat_alloc(struct ion_system_heap *heap,
+				       ktime_t start)
+{
+	unsigned long us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	spin_lock(&heap->lock);
+	heap->nr_allocs++;
+	heap->total_alloc_us += us;
+	if (us > heap->max_alloc_us)
+		heap->max_alloc_us = us;
+	spin_unlock(&heap->lock);
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer_info *info;
+	struct page *page, *tmp;
+	long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	ktime_t start = ktime_get();
+
+	info = kmalloc(sizeof(*info), GFP_KERNEL);
+	if (!info)
 		return -ENOMEM;
+	INIT_LIST_HEAD(&info->pages);
+	info->nr_chunks = 0;
+
+	while (size_remaining > 0) {
+		page = alloc_largest_available(sys_heap, size_remaining,
+					       max_order);
+		if (!page)
+			goto err;
+		list_add_tail(&page->lru, &info->pages);
+		max_order = page_private(page);
+		size_remaining -= order_to_size(max_order);
+		info->nr_chunks++;
+	}
 
+	buffer->priv_virt = info;
 	atomic_add(size, &system_heap_allocated);
+	ion_system_heap_stat_alloc(sys_heap, start);
 	return 0;
+
+err:
+	/* Nothing has been written to these yet, they are still clean */
+	list_for_each_entry_safe(page, tmp, &info->pages, lru) {
+		unsigned int order = page_private(page);
+
+		list_del(&page->lru);
+		set_page_private(page, 0);
+		ion_page_pool_free(sys_heap->pools[order_to_index(order)], page);
+	}
+	kfree(info);
+	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+
+	spin_lock(&sys_heap->lock);
+	list_splice_tail(&info->pages, &sys_heap->dirty);
+	sys_heap->dirty_count += PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	spin_unlock(&sys_heap->lock);
+	wake_up(&sys_heap->waitq);
+
+	kfree(info);
 	atomic_sub(buffer->size, &system_heap_allocated);
 }
 
+static struct page *ion_system_heap_get_dirty(struct ion_system_heap *heap)
+{
+	struct page *page = NULL;
+
+	spin_lock(&heap->lock);
+	if (!list_empty(&heap->dirty)) {
+		page = list_first_entry(&heap->dirty, struct page, lru);
+		list_del(&page->lru);
+		heap->dirty_count -= 1 << page_private(page);
+	}
+	spin_unlock(&heap->lock);
+
+	return page;
+}
+
+static int ion_system_heap_zero_thread(void *data)
+{
+	struct ion_system_heap *heap = data;
+	struct page *page;
+	unsigned int order;
+	int i;
+
+	set_freezable();
+	set_user_nice(current, 10);
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->waitq,
+				     !list_empty(&heap->dirty) ||
+				     kthread_should_stop());
+
+		while ((page = ion_system_heap_get_dirty(heap))) {
+			order = page_private(page);
+			for (i = 0; i < (1 << order); i++)
+				clear_highpage(page + i);
+			set_page_private(page, 0);
+			ion_page_pool_free(heap->pools[order_to_index(order)],
+					   page);
+			cond_resched();
+		}
+	}
+
+	return 0;
+}
+
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *heap = container_of(shrinker,
+						    struct ion_system_heap,
+						    shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	struct page *page;
+	int total;
+	int i;
+
+	/* Dirty pages would only be zeroed to sit in a pool, free them first */
+	while (nr_to_scan > 0 && (page = ion_system_heap_get_dirty(heap))) {
+		unsigned int order = page_private(page);
+
+		set_page_private(page, 0);
+		__free_pages(page, order);
+		nr_to_scan -= 1 << order;
+	}
+
+	for (i = 0; i < NUM_ORDERS && nr_to_scan > 0; i++)
+		nr_to_scan -= ion_page_pool_shrink(heap->pools[i],
+						   sc->gfp_mask, nr_to_scan);
+
+	spin_lock(&heap->lock);
+	total = heap->dirty_count;
+	spin_unlock(&heap->lock);
+	for (i = 0; i < NUM_ORDERS; i++)
+		total += ion_page_pool_shrink(heap->pools[i], sc->gfp_mask, 0);
+
+	return total;
+}
+
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	struct scatterlist *sglist, *sg;
 	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
+	sglist = vmalloc(info->nr_chunks * sizeof(struct scatterlist));
 	if (!sglist)
 		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
+	sg_init_table(sglist, info->nr_chunks);
+	sg = sglist;
+	list_for_each_entry(page, &info->pages, lru) {
+		sg_set_page(sg, page, order_to_size(page_private(page)), 0);
+		sg = sg_next(sg);
 	}
 	/* XXX do cache maintenance for dma? */
 	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
@@ -89,26 +307,72 @@ void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer,
 				 unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return buffer->priv_virt;
-	else {
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	struct page *page;
+	void *vaddr;
+	int i;
+
+	if (!ION_IS_CACHED(flags)) {
 		pr_err("%s: cannot map system heap uncached\n", __func__);
 		return ERR_PTR(-EINVAL);
 	}
+
+	pages = vmalloc(npages * sizeof(struct page *));
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+	tmp = pages;
+	list_for_each_entry(page, &info->pages, lru)
+		for (i = 0; i < (1 << page_private(page)); i++)
+			*(tmp++) = page + i;
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+
+	return vaddr ? vaddr : ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
-void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
+static unsigned int iommu_map_order(unsigned long iova, unsigned int order)
+{
+	if (order >= get_order(SZ_64K) && IS_ALIGNED(iova, SZ_64K))
+		return get_order(SZ_64K);
+	return get_order(SZ_4K);
+}
+
+static void ion_system_heap_iommu_unmap_chunks(struct iommu_domain *domain,
+					struct ion_system_buffer_info *info,
+					unsigned long iova, unsigned long len)
 {
+	unsigned long end = iova + len;
+	unsigned int order, map_order;
+	struct page *page;
 	int i;
+
+	list_for_each_entry(page, &info->pages, lru) {
+		order = page_private(page);
+		map_order = iommu_map_order(iova, order);
+		for (i = 0; i < (1 << order) && iova < end;
+		     i += 1 << map_order) {
+			iommu_unmap(domain, iova, map_order);
+			iova += order_to_size(map_order);
+		}
+	}
+}
+
+void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
+{
 	unsigned long temp_iova;
 	unsigned int domain_num;
 	unsigned int partition_num;
 	struct iommu_domain *domain;
+	struct ion_buffer *buffer = data->buffer;
 
 	if (!msm_use_iommu())
 		return;
@@ -123,8 +387,12 @@ void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
 		return;
 	}
 
-	temp_iova = data->iova_addr;
-	for (i = data->mapped_size; i > 0; i -= SZ_4K, temp_iova += SZ_4K)
+	ion_system_heap_iommu_unmap_chunks(domain, buffer->priv_virt,
+					   data->iova_addr, buffer->size);
+
+	for (temp_iova = data->iova_addr + buffer->size;
+	     temp_iova < data->iova_addr + data->mapped_size;
+	     temp_iova += SZ_4K)
 		iommu_unmap(domain, temp_iova, get_order(SZ_4K));
 
 	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
@@ -136,22 +404,49 @@ void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma, unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return remap_vmalloc_range(vma, buffer->priv_virt,
-						vma->vm_pgoff);
-	else {
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct page *page;
+	int ret;
+
+	if (!ION_IS_CACHED(flags)) {
 		pr_err("%s: cannot map system heap uncached\n", __func__);
 		return -EINVAL;
 	}
+
+	list_for_each_entry(page, &info->pages, lru) {
+		unsigned long len = order_to_size(page_private(page));
+		unsigned long pfn = page_to_pfn(page);
+
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		} else if (offset) {
+			pfn += offset >> PAGE_SHIFT;
+			len -= offset;
+			offset = 0;
+		}
+		len = min(len, vma->vm_end - addr);
+		ret = remap_pfn_range(vma, addr, pfn, len, vma->vm_page_prot);
+		if (ret)
+			return ret;
+		addr += len;
+		if (addr >= vma->vm_end)
+			break;
+	}
+
+	return 0;
 }
 
 int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 			void *vaddr, unsigned int offset, unsigned int length,
 			unsigned int cmd)
 {
-	unsigned long vstart, pstart;
-	void *vtemp;
-	unsigned long ln = 0;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	unsigned long vstart = (unsigned long) vaddr;
+	unsigned long pstart, len;
+	struct page *page;
 	void (*op)(unsigned long, unsigned long, unsigned long);
 
 	switch (cmd) {
@@ -168,23 +463,23 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 		return -EINVAL;
 	}
 
-	for (vtemp = buffer->priv_virt + offset,
-	     vstart = (unsigned long) vaddr;
-			ln < length;
-			vtemp += PAGE_SIZE, ln += PAGE_SIZE,
-			vstart += PAGE_SIZE) {
-		pstart = page_to_phys(vmalloc_to_page(vtemp));
-		/*
-		 * If vmalloc -> page -> phys is returning NULL, something
-		 * has really gone wrong...
-		 */
-		if (!pstart) {
-			WARN(1, "Could not translate %p to physical address\n",
-				vtemp);
-			return -EINVAL;
+	/* Each chunk is physically contiguous, do it in one go */
+	list_for_each_entry(page, &info->pages, lru) {
+		if (!length)
+			break;
+
+		len = order_to_size(page_private(page));
+		if (offset >= len) {
+			offset -= len;
+			continue;
 		}
+		pstart = page_to_phys(page) + offset;
+		len = min_t(unsigned long, len - offset, length);
+		offset = 0;
 
-		op(vstart, PAGE_SIZE, pstart);
+		op(vstart, len, pstart);
+		vstart += len;
+		length -= len;
 	}
 
 	return 0;
@@ -192,8 +487,31 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 
 static int ion_system_print_debug(struct ion_heap *heap, struct seq_file *s)
 {
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	unsigned long nr_allocs, max_alloc_us;
+	u64 avg_alloc_us;
+	int dirty_count;
+	int i;
+
+	spin_lock(&sys_heap->lock);
+	nr_allocs = sys_heap->nr_allocs;
+	avg_alloc_us = sys_heap->total_alloc_us;
+	max_alloc_us = sys_heap->max_alloc_us;
+	dirty_count = sys_heap->dirty_count;
+	spin_unlock(&sys_heap->lock);
+	if (nr_allocs)
+		do_div(avg_alloc_us, nr_allocs);
+
 	seq_printf(s, "total bytes currently allocated: %lx\n",
 			(unsigned long) atomic_read(&system_heap_allocated));
+	for (i = 0; i < NUM_ORDERS; i++)
+		seq_printf(s, "order %u pool: %d items\n", orders[i],
+			   ion_page_pool_count(sys_heap->pools[i]));
+	seq_printf(s, "pages waiting to be zeroed: %d\n", dirty_count);
+	seq_printf(s, "allocations: %lu avg %llu us max %lu us\n",
+		   nr_allocs, avg_alloc_us, max_alloc_us);
 
 	return 0;
 }
@@ -206,10 +524,13 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 				unsigned long iova_length,
 				unsigned long flags)
 {
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 	int ret, i;
 	unsigned long temp_iova;
 	struct iommu_domain *domain;
-	void *temp_phys;
+	struct page *page;
+	unsigned int order, map_order;
+	phys_addr_t phys;
 	unsigned long extra;
 
 	if (!ION_IS_CACHED(flags))
@@ -237,19 +558,20 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 	}
 
 	temp_iova = data->iova_addr;
-	temp_phys = buffer->vaddr;
-	for (i = buffer->size; i > 0; i -= SZ_4K, temp_iova += SZ_4K,
-						  temp_phys += SZ_4K) {
-		ret = iommu_map(domain, temp_iova,
-			page_to_phys(vmalloc_to_page(temp_phys)),
-			get_order(SZ_4K), ION_IS_CACHED(flags) ? 1 : 0);
-
-		if (ret) {
-			pr_err("%s: could not map %lx to %x in domain %p\n",
-				__func__, temp_iova,
-				page_to_phys(vmalloc_to_page(temp_phys)),
-				domain);
-			goto out2;
+	list_for_each_entry(page, &info->pages, lru) {
+		order = page_private(page);
+		map_order = iommu_map_order(temp_iova, order);
+		phys = page_to_phys(page);
+		for (i = 0; i < (1 << order); i += 1 << map_order) {
+			ret = iommu_map(domain, temp_iova, phys, map_order,
+					ION_IS_CACHED(flags) ? 1 : 0);
+			if (ret) {
+				pr_err("%s: could not map %lx to %x in domain %p\n",
+					__func__, temp_iova, phys, domain);
+				goto out2;
+			}
+			temp_iova += order_to_size(map_order);
+			phys += order_to_size(map_order);
 		}
 	}
 
@@ -259,9 +581,8 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 	return 0;
 
 out2:
-	for ( ; i < buffer->size; i += SZ_4K, temp_iova -= SZ_4K)
-		iommu_unmap(domain, temp_iova, get_order(SZ_4K));
-
+	ion_system_heap_iommu_unmap_chunks(domain, info, data->iova_addr,
+					   temp_iova - data->iova_addr);
 out1:
 	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
 						data->mapped_size);
@@ -269,7 +590,7 @@ out:
 	return ret;
 }
 
-static struct ion_heap_ops vmalloc_ops = {
+static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
 	.map_dma = ion_system_heap_map_dma,
@@ -283,21 +604,74 @@ static struct ion_heap_ops vmalloc_ops = {
 	.unmap_iommu = ion_system_heap_unmap_iommu,
 };
 
+static void ion_system_heap_destroy_pools(struct ion_system_heap *heap)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (heap->pools[i])
+			ion_page_pool_destroy(heap->pools[i]);
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	return heap;
+	heap->heap.ops = &system_heap_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+	spin_lock_init(&heap->lock);
+	INIT_LIST_HEAD(&heap->dirty);
+	init_waitqueue_head(&heap->waitq);
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = orders[i] ? high_order_gfp_flags :
+					      low_order_gfp_flags;
+
+		heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i]);
+		if (!heap->pools[i])
+			goto err;
+	}
+
+	heap->zero_thread = kthread_run(ion_system_heap_zero_thread, heap,
+					"ion_system_zero");
+	if (IS_ERR(heap->zero_thread)) {
+		pr_err("%s: could not start zeroing thread\n", __func__);
+		goto err;
+	}
+
+	heap->shrinker.shrink = ion_system_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+
+	return &heap->heap;
+
+err:
+	ion_system_heap_destroy_pools(heap);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct page *page;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	kthread_stop(sys_heap->zero_thread);
+	while ((page = ion_system_heap_get_dirty(sys_heap))) {
+		unsigned int order = page_private(page);
+
+		set_page_private(page, 0);
+		__free_pages(page, order);
+	}
+	ion_system_heap_destroy_pools(sys_heap);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -341,6 +715,54 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+				 struct ion_buffer *buffer,
+				 unsigned long flags)
+{
+	if (ION_IS_CACHED(flags))
+		return buffer->priv_virt;
+	else {
+		pr_err("%s: cannot map system heap uncached\n", __func__);
+		return ERR_PTR(-EINVAL);
+	}
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+				  struct ion_buffer *buffer)
+{
+}
+
+void ion_system_contig_heap_unmap_iommu(struct ion_iommu_map *data)
+{
+	int i;
+	unsigned long temp_iova;
+	unsigned int domain_num;
+	unsigned int partition_num;
+	struct iommu_domain *domain;
+
+	if (!msm_use_iommu())
+		return;
+
+	domain_num = iommu_map_domain(data);
+	partition_num = iommu_map_partition(data);
+
+	domain = msm_get_iommu_domain(domain_num);
+
+	if (!domain) {
+		WARN(1, "Could not get domain %d. Corruption?\n", domain_num);
+		return;
+	}
+
+	temp_iova = data->iova_addr;
+	for (i = data->mapped_size; i > 0; i -= SZ_4K, temp_iova += SZ_4K)
+		iommu_unmap(domain, temp_iova, get_order(SZ_4K));
+
+	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
+				data->mapped_size);
+
+	return;
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma,
@@ -474,13 +896,13 @@ static struct ion_heap_ops kmalloc_ops = {
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
 	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 	.cache_op = ion_system_contig_heap_cache_ops,
 	.print_debug = ion_system_contig_print_debug,
 	.map_iommu = ion_system_contig_heap_map_iommu,
-	.unmap_iommu = ion_system_heap_unmap_iommu,
+	.unmap_iommu = ion_system_contig_heap_unmap_iommu,
 };
 
 struct ion_heap *ion_system_contig_heap_create(struct ion_platform_heap *unused)
@@ -49,6 +49,32 @@ MODULE_PARM_DESC(ksgl_mmu_type,
 
 static struct ion_client *kgsl_ion_client;
 
+static inline struct kgsl_event *
+kgsl_first_event(struct kgsl_device_private *owner)
+{
+	return list_first_entry(&owner->events, struct kgsl_event, list);
+}
+
+/*
+ * Put @owner in device->event_owners by the timestamp of its first
+ * event.  Owners are ordered so that kgsl_timestamp_expired() can stop
+ * at the first one with nothing to retire.
+ * call with device->mutex locked
+ */
+static void kgsl_event_owner_queue(struct kgsl_device *device,
+	struct kgsl_device_private *owner)
+{
+	unsigned int ts = kgsl_first_event(owner)->timestamp;
+	struct kgsl_device_private *o;
+
+	list_for_each_entry(o, &device->event_owners, event_node) {
+		if (timestamp_cmp(kgsl_first_event(o)->timestamp, ts) > 0)
+			break;
+	}
+
+	list_add_tail(&owner->event_node, &o->event_node);
+}
+
 /**
  * kgsl_add_event - Add a new timstamp event for the KGSL device
  * @device - KGSL device for the new event
@@ -64,8 +90,7 @@ static int kgsl_add_event(struct kgsl_device *device, u32 ts,
 	void (*cb)(struct kgsl_device *, void *, u32), void *priv,
 	struct kgsl_device_private *owner)
 {
-	struct kgsl_event *event;
-	struct list_head *n;
+	struct kgsl_event *event, *e;
 	unsigned int cur = device->ftbl->readtimestamp(device,
 		KGSL_TIMESTAMP_RETIRED);
 
@@ -86,22 +111,28 @@ static int kgsl_add_event(struct kgsl_device *device, u32 ts,
 	event->timestamp = ts;
 	event->priv = priv;
 	event->func = cb;
-	event->owner = owner;
+	event->created = jiffies;
 
-	/* Add the event in order to the list */
+	trace_kgsl_register_event(device, ts);
 
-	for (n = device->events.next ; n != &device->events; n = n->next) {
-		struct kgsl_event *e =
-			list_entry(n, struct kgsl_event, list);
+	/*
+	 * Add the event in order to the owner's list.  Timestamps mostly
+	 * come in increasing order, so look from the end.
+	 */
 
-		if (timestamp_cmp(e->timestamp, ts) > 0) {
-			list_add(&event->list, n->prev);
+	list_for_each_entry_reverse(e, &owner->events, list) {
+		if (timestamp_cmp(e->timestamp, ts) <= 0)
 			break;
-		}
 	}
 
-	if (n == &device->events)
-		list_add_tail(&event->list, &device->events);
+	list_add(&event->list, &e->list);
+
+	/* A new first event moves the owner in the device list */
+
+	if (kgsl_first_event(owner) == event) {
+		list_del_init(&owner->event_node);
+		kgsl_event_owner_queue(device, owner);
+	}
 
 	queue_work(device->work_queue, &device->ts_expired_ws);
 	return 0;
@@ -120,21 +151,24 @@ static void kgsl_cancel_events(struct kgsl_device *device,
 	unsigned int cur = device->ftbl->readtimestamp(device,
 		KGSL_TIMESTAMP_RETIRED);
 
-	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
-		if (event->owner != owner)
-			continue;
+	list_for_each_entry_safe(event, event_tmp, &owner->events, list) {
 		/*
 		 * "cancel" the events by calling their callback.
 		 * Currently, events are used for lock and memory
 		 * management, so if the process is dying the right
 		 * thing to do is release or free.
 		 */
+		trace_kgsl_fire_event(device, event->timestamp,
+			jiffies_to_msecs(jiffies - event->created));
+
 		if (event->func)
 			event->func(device, event->priv, cur);
 
 		list_del(&event->list);
 		kfree(event);
 	}
+
+	list_del_init(&owner->event_node);
 }
 
 static inline struct kgsl_mem_entry *
@@ -190,15 +224,84 @@ kgsl_mem_entry_destroy(struct kref *kref)
 }
 EXPORT_SYMBOL(kgsl_mem_entry_destroy);
 
-static
-void kgsl_mem_entry_attach_process(struct kgsl_mem_entry *entry,
-				   struct kgsl_process_private *process)
+/*call with process->mem_lock locked */
+static void kgsl_mem_entry_insert(struct kgsl_process_private *process,
+				  struct kgsl_mem_entry *entry)
 {
-	spin_lock(&process->mem_lock);
-	list_add(&entry->list, &process->mem_list);
-	spin_unlock(&process->mem_lock);
+	struct rb_node **node = &process->mem_rb.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*node) {
+		struct kgsl_mem_entry *cur;
+
+		parent = *node;
+		cur = rb_entry(parent, struct kgsl_mem_entry, node);
+
+		if (entry->memdesc.gpuaddr < cur->memdesc.gpuaddr)
+			node = &parent->rb_left;
+		else
+			node = &parent->rb_right;
+	}
+
+	rb_link_node(&entry->node, parent, node);
+	rb_insert_color(&entry->node, &process->mem_rb);
+}
+
+/*
+ * Give the entry an id and add it to the process.  The process owns the
+ * reference taken by kgsl_mem_entry_create() from here on, so the entry
+ * can be freed by another thread as soon as this returns; the new id is
+ * returned so that the caller doesn't have to read it back.  On failure
+ * a negative error code is returned and the caller still owns the
+ * reference.  The entry must have been added to the process stats
+ * before calling so that kgsl_mem_entry_put() can undo everything.
+ */
+static int
+kgsl_mem_entry_attach_process(struct kgsl_mem_entry *entry,
+			      struct kgsl_process_private *process)
+{
+	int ret, id;
 
 	entry->priv = process;
+
+	while (1) {
+		if (idr_pre_get(&process->mem_idr, GFP_KERNEL) == 0)
+			return -ENOMEM;
+
+		spin_lock(&process->mem_lock);
+		ret = idr_get_new_above(&process->mem_idr, entry, 1, &id);
+		if (ret != -EAGAIN)
+			break;
+		spin_unlock(&process->mem_lock);
+	}
+
+	if (ret == 0) {
+		entry->id = id;
+		kgsl_mem_entry_insert(process, entry);
+	}
+	spin_unlock(&process->mem_lock);
+
+	return ret ? ret : id;
+}
+
+/*
+ * Remove the entry from its process.  Returns 0 if it had already been
+ * removed, otherwise the caller must drop the process's reference with
+ * kgsl_mem_entry_put() once mem_lock is released.
+ * call with entry->priv->mem_lock locked
+ */
+static int kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry)
+{
+	struct kgsl_process_private *process = entry->priv;
+
+	if (entry->id == 0)
+		return 0;
+
+	idr_remove(&process->mem_idr, entry->id);
+	entry->id = 0;
+	rb_erase(&entry->node, &process->mem_rb);
+
+	return 1;
 }
 
 /* Allocate a new context id */
@@ -261,8 +364,10 @@ static void kgsl_timestamp_expired(struct work_struct *work)
 {
 	struct kgsl_device *device = container_of(work, struct kgsl_device,
 		ts_expired_ws);
+	struct kgsl_device_private *owner;
 	struct kgsl_event *event, *event_tmp;
 	uint32_t ts_processed;
+	unsigned int count = 0;
 
 	mutex_lock(&device->mutex);
 
@@ -270,18 +375,41 @@ static void kgsl_timestamp_expired(struct work_struct *work)
 	ts_processed = device->ftbl->readtimestamp(device,
 		KGSL_TIMESTAMP_RETIRED);
 
-	/* Process expired events */
-	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
-		if (timestamp_cmp(ts_processed, event->timestamp) < 0)
+	/*
+	 * Process expired events.  Only owners whose first event has
+	 * expired are looked at, and of those only the expired events.
+	 */
+	while (!list_empty(&device->event_owners)) {
+		owner = list_first_entry(&device->event_owners,
+			struct kgsl_device_private, event_node);
+
+		if (timestamp_cmp(ts_processed,
+			kgsl_first_event(owner)->timestamp) < 0)
 			break;
 
-		if (event->func)
-			event->func(device, event->priv, ts_processed);
+		list_for_each_entry_safe(event, event_tmp, &owner->events,
+			list) {
+			if (timestamp_cmp(ts_processed, event->timestamp) < 0)
+				break;
 
-		list_del(&event->list);
-		kfree(event);
+			trace_kgsl_fire_event(device, event->timestamp,
+				jiffies_to_msecs(jiffies - event->created));
+
+			if (event->func)
+				event->func(device, event->priv, ts_processed);
+
+			list_del(&event->list);
+			kfree(event);
+			count++;
+		}
+
+		list_del_init(&owner->event_node);
+		if (!list_empty(&owner->events))
+			kgsl_event_owner_queue(device, owner);
 	}
 
+	trace_kgsl_retire_events(device, ts_processed, count);
+
 	mutex_unlock(&device->mutex);
 }
 
@@ -549,7 +677,8 @@ kgsl_get_process_private(struct kgsl_device_private *cur_dev_priv)
 	private->refcnt = 1;
 	private->pid = task_tgid_nr(current);
 
-	INIT_LIST_HEAD(&private->mem_list);
+	private->mem_rb = RB_ROOT;
+	idr_init(&private->mem_idr);
 
 	if (kgsl_mmu_enabled())
 	{
@@ -558,6 +687,7 @@ kgsl_get_process_private(struct kgsl_device_private *cur_dev_priv)
 		pt_name = task_tgid_nr(current);
 		private->pagetable = kgsl_mmu_getpagetable(pt_name);
 		if (private->pagetable == NULL) {
+			idr_destroy(&private->mem_idr);
 			kfree(private);
 			private = NULL;
 			goto out;
@@ -577,8 +707,8 @@ static void
 kgsl_put_process_private(struct kgsl_device *device,
 			 struct kgsl_process_private *private)
 {
-	struct kgsl_mem_entry *entry = NULL;
-	struct kgsl_mem_entry *entry_tmp = NULL;
+	struct kgsl_mem_entry *entry;
+	struct rb_node *node;
 
 	if (!private)
 		return;
@@ -592,10 +722,16 @@ kgsl_put_process_private(struct kgsl_device *device,
 
 	list_del(&private->list);
 
-	list_for_each_entry_safe(entry, entry_tmp, &private->mem_list, list) {
-		list_del(&entry->list);
+	spin_lock(&private->mem_lock);
+	while ((node = rb_first(&private->mem_rb)) != NULL) {
+		entry = rb_entry(node, struct kgsl_mem_entry, node);
+		kgsl_mem_entry_detach_process(entry);
+		spin_unlock(&private->mem_lock);
 		kgsl_mem_entry_put(entry);
+		spin_lock(&private->mem_lock);
 	}
+	spin_unlock(&private->mem_lock);
+	idr_destroy(&private->mem_idr);
 
 	kgsl_mmu_putpagetable(private->pagetable);
 	kfree(private);
@@ -682,6 +818,8 @@ static int kgsl_open(struct inode *inodep, struct file *filep)
 	}
 
 	dev_priv->device = device;
+	INIT_LIST_HEAD(&dev_priv->events);
+	INIT_LIST_HEAD(&dev_priv->event_node);
 	filep->private_data = dev_priv;
 
 	/* Get file (per process) private struct */
@@ -727,42 +865,75 @@ err_pmruntime:
 static struct kgsl_mem_entry *
 kgsl_sharedmem_find(struct kgsl_process_private *private, unsigned int gpuaddr)
 {
-	struct kgsl_mem_entry *entry = NULL, *result = NULL;
+	struct rb_node *node;
 
 	BUG_ON(private == NULL);
 
 	gpuaddr &= PAGE_MASK;
 
-	list_for_each_entry(entry, &private->mem_list, list) {
-		if (entry->memdesc.gpuaddr == gpuaddr) {
-			result = entry;
-			break;
-		}
+	node = private->mem_rb.rb_node;
+	while (node) {
+		struct kgsl_mem_entry *entry;
+
+		entry = rb_entry(node, struct kgsl_mem_entry, node);
+
+		if (gpuaddr < entry->memdesc.gpuaddr)
+			node = node->rb_left;
+		else if (gpuaddr > entry->memdesc.gpuaddr)
+			node = node->rb_right;
+		else
+			return entry;
 	}
-	return result;
+
+	return NULL;
 }
 
-/*call with private->mem_lock locked */
+/*
+ * Entries of one process don't overlap in the GPU address space, so the
+ * only candidate is the entry with the highest gpuaddr at or below
+ * @gpuaddr, which is on the path down the tree.
+ * call with private->mem_lock locked
+ */
 struct kgsl_mem_entry *
 kgsl_sharedmem_find_region(struct kgsl_process_private *private,
 				unsigned int gpuaddr,
 				size_t size)
 {
-	struct kgsl_mem_entry *entry = NULL, *result = NULL;
+	struct rb_node *node;
 
 	BUG_ON(private == NULL);
 
-	list_for_each_entry(entry, &private->mem_list, list) {
-		if (kgsl_gpuaddr_in_memdesc(&entry->memdesc, gpuaddr, size)) {
-			result = entry;
-			break;
+	node = private->mem_rb.rb_node;
+	while (node) {
+		struct kgsl_mem_entry *entry;
+
+		entry = rb_entry(node, struct kgsl_mem_entry, node);
+
+		if (gpuaddr < entry->memdesc.gpuaddr) {
+			node = node->rb_left;
+		} else {
+			if (kgsl_gpuaddr_in_memdesc(&entry->memdesc, gpuaddr,
+						    size))
+				return entry;
+			node = node->rb_right;
 		}
 	}
 
-	return result;
+	return NULL;
 }
 EXPORT_SYMBOL(kgsl_sharedmem_find_region);
 
+/*call with private->mem_lock locked */
+static inline struct kgsl_mem_entry *
+kgsl_sharedmem_find_id(struct kgsl_process_private *private, unsigned int id)
+{
+	/* idr_find() masks off the top bit of the id */
+	if (id == 0 || id > INT_MAX)
+		return NULL;
+
+	return idr_find(&private->mem_idr, id);
+}
+
 /*call all ioctl sub functions with driver locked*/
 static long kgsl_ioctl_device_getproperty(struct kgsl_device_private *dev_priv,
 					  unsigned int cmd, void *data)
@@ -1021,9 +1192,17 @@ static void kgsl_freemem_event_cb(struct kgsl_device *device,
 	void *priv, u32 timestamp)
 {
 	struct kgsl_mem_entry *entry = priv;
+	int detached;
+
+	/* The entry may have been freed by hand in the meantime */
 	spin_lock(&entry->priv->mem_lock);
-	list_del(&entry->list);
+	detached = kgsl_mem_entry_detach_process(entry);
 	spin_unlock(&entry->priv->mem_lock);
+
+	if (detached)
+		kgsl_mem_entry_put(entry);
+
+	/* and the reference held by the event */
 	kgsl_mem_entry_put(entry);
 }
 
@@ -1037,11 +1216,15 @@ static long kgsl_ioctl_cmdstream_freememontimestamp(struct kgsl_device_private
 
 	spin_lock(&dev_priv->process_priv->mem_lock);
 	entry = kgsl_sharedmem_find(dev_priv->process_priv, param->gpuaddr);
+	if (entry)
+		kgsl_mem_entry_get(entry);
 	spin_unlock(&dev_priv->process_priv->mem_lock);
 
 	if (entry) {
 		result = kgsl_add_event(dev_priv->device, param->timestamp,
 					kgsl_freemem_event_cb, entry, dev_priv);
+		if (result)
+			kgsl_mem_entry_put(entry);
 	} else {
 		KGSL_DRV_ERR(dev_priv->device,
 			"invalid gpuaddr %08x\n", param->gpuaddr);
@@ -1114,7 +1297,7 @@ static long kgsl_ioctl_sharedmem_free(struct kgsl_device_private *dev_priv,
 	spin_lock(&private->mem_lock);
 	entry = kgsl_sharedmem_find(private, param->gpuaddr);
 	if (entry)
-		list_del(&entry->list);
+		kgsl_mem_entry_detach_process(entry);
 	spin_unlock(&private->mem_lock);
 
 	if (entry) {
@@ -1212,15 +1395,20 @@ kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_device_private *dev_priv,
 		goto error_free_vmalloc;
 	}
 
-	param->gpuaddr = entry->memdesc.gpuaddr;
-
 	entry->memtype = KGSL_MEM_ENTRY_KERNEL;
 
-	kgsl_mem_entry_attach_process(entry, private);
-
 	/* Process specific statistics */
 	kgsl_process_add_stats(private, entry->memtype, len);
 
+	param->gpuaddr = entry->memdesc.gpuaddr;
+
+	result = kgsl_mem_entry_attach_process(entry, private);
+	if (result < 0) {
+		/* vm_insert_page() holds its own references to the pages */
+		kgsl_mem_entry_put(entry);
+		goto error;
+	}
+
 	kgsl_check_idle(dev_priv->device);
 	return 0;
 
@@ -1651,7 +1839,11 @@ static long kgsl_ioctl_map_user_mem(struct kgsl_device_private *dev_priv,
 
 	kgsl_process_add_stats(private, entry->memtype, param->len);
 
-	kgsl_mem_entry_attach_process(entry, private);
+	result = kgsl_mem_entry_attach_process(entry, private);
+	if (result < 0)
+		kgsl_mem_entry_put(entry);
+	else
+		result = 0;
 
 	kgsl_check_idle(dev_priv->device);
 	return result;
@@ -1714,16 +1906,114 @@ kgsl_ioctl_gpumem_alloc(struct kgsl_device_private *dev_priv,
 
 	if (result == 0) {
 		entry->memtype = KGSL_MEM_ENTRY_KERNEL;
-		kgsl_mem_entry_attach_process(entry, private);
+		entry->flags = param->flags;
+		kgsl_process_add_stats(private, entry->memtype, param->size);
+
 		param->gpuaddr = entry->memdesc.gpuaddr;
 
+		result = kgsl_mem_entry_attach_process(entry, private);
+		if (result < 0)
+			kgsl_mem_entry_put(entry);
+		else
+			result = 0;
+	} else
+		kfree(entry);
+
+	kgsl_check_idle(dev_priv->device);
+	return result;
+}
+
+static long
+kgsl_ioctl_gpumem_alloc_id(struct kgsl_device_private *dev_priv,
+			unsigned int cmd, void *data)
+{
+	struct kgsl_process_private *private = dev_priv->process_priv;
+	struct kgsl_gpumem_alloc_id *param = data;
+	struct kgsl_mem_entry *entry;
+	int result;
+
+	entry = kgsl_mem_entry_create();
+	if (entry == NULL)
+		return -ENOMEM;
+
+	result = kgsl_allocate_user(&entry->memdesc, private->pagetable,
+		param->size, param->flags);
+
+	if (result == 0) {
+		entry->memtype = KGSL_MEM_ENTRY_KERNEL;
+		entry->flags = param->flags;
 		kgsl_process_add_stats(private, entry->memtype, param->size);
+
+		param->gpuaddr = entry->memdesc.gpuaddr;
+		param->size = entry->memdesc.size;
+		param->mmapsize = PAGE_ALIGN(entry->memdesc.size);
+
+		result = kgsl_mem_entry_attach_process(entry, private);
+		if (result < 0) {
+			kgsl_mem_entry_put(entry);
+		} else {
+			param->id = result;
+			result = 0;
+		}
 	} else
 		kfree(entry);
 
 	kgsl_check_idle(dev_priv->device);
 	return result;
 }
+
+static long
+kgsl_ioctl_gpumem_free_id(struct kgsl_device_private *dev_priv,
+			unsigned int cmd, void *data)
+{
+	struct kgsl_process_private *private = dev_priv->process_priv;
+	struct kgsl_gpumem_free_id *param = data;
+	struct kgsl_mem_entry *entry;
+
+	spin_lock(&private->mem_lock);
+	entry = kgsl_sharedmem_find_id(private, param->id);
+	if (entry)
+		kgsl_mem_entry_detach_process(entry);
+	spin_unlock(&private->mem_lock);
+
+	if (entry == NULL) {
+		KGSL_CORE_ERR("invalid id %d\n", param->id);
+		return -EINVAL;
+	}
+
+	kgsl_mem_entry_put(entry);
+	return 0;
+}
+
+static long
+kgsl_ioctl_gpumem_get_info(struct kgsl_device_private *dev_priv,
+			unsigned int cmd, void *data)
+{
+	struct kgsl_process_private *private = dev_priv->process_priv;
+	struct kgsl_gpumem_get_info *param = data;
+	struct kgsl_mem_entry *entry;
+	int result = 0;
+
+	spin_lock(&private->mem_lock);
+	if (param->id != 0)
+		entry = kgsl_sharedmem_find_id(private, param->id);
+	else
+		entry = kgsl_sharedmem_find_region(private, param->gpuaddr, 1);
+
+	if (entry) {
+		param->gpuaddr = entry->memdesc.gpuaddr;
+		param->id = entry->id;
+		param->flags = entry->flags;
+		param->size = entry->memdesc.size;
+		param->mmapsize = PAGE_ALIGN(entry->memdesc.size);
+		param->useraddr = 0;
+	} else
+		result = -EINVAL;
+	spin_unlock(&private->mem_lock);
+
+	return result;
+}
+
 static long kgsl_ioctl_cff_syncmem(struct kgsl_device_private *dev_priv,
 					unsigned int cmd, void *data)
 {
@@ -1911,6 +2201,12 @@ static const struct {
 			kgsl_ioctl_cff_user_event, 0),
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_TIMESTAMP_EVENT,
 			kgsl_ioctl_timestamp_event, 1),
+	KGSL_IOCTL_FUNC(IOCTL_KGSL_GPUMEM_ALLOC_ID,
+			kgsl_ioctl_gpumem_alloc_id, 0),
+	KGSL_IOCTL_FUNC(IOCTL_KGSL_GPUMEM_FREE_ID,
+			kgsl_ioctl_gpumem_free_id, 0),
+	KGSL_IOCTL_FUNC(IOCTL_KGSL_GPUMEM_GET_INFO,
+			kgsl_ioctl_gpumem_get_info, 0),
 };
 
 static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
@@ -2063,7 +2359,7 @@ static int kgsl_mmap(struct file *file, struct vm_area_struct *vma)
 	unsigned long vma_offset = vma->vm_pgoff << PAGE_SHIFT;
 	struct kgsl_device_private *dev_priv = file->private_data;
 	struct kgsl_process_private *private = dev_priv->process_priv;
-	struct kgsl_mem_entry *tmp, *entry = NULL;
+	struct kgsl_mem_entry *entry;
 	struct kgsl_device *device = dev_priv->device;
 
 	/* Handle leagacy behavior for memstore */
@@ -2071,16 +2367,14 @@ static int kgsl_mmap(struct file *file, struct vm_area_struct *vma)
 	if (vma_offset == device->memstore.physaddr)
 		return kgsl_mmap_memstore(device, vma);
 
-	/* Find a chunk of GPU memory */
+	/* Find a chunk of GPU memory, by id as upstream does, or by gpuaddr */
 
 	spin_lock(&private->mem_lock);
-	list_for_each_entry(tmp, &private->mem_list, list) {
-		if (vma_offset == tmp->memdesc.gpuaddr) {
-			kgsl_mem_entry_get(tmp);
-			entry = tmp;
-			break;
-		}
-	}
+	entry = kgsl_sharedmem_find_id(private, vma->vm_pgoff);
+	if (entry == NULL)
+		entry = kgsl_sharedmem_find(private, vma_offset);
+	if (entry)
+		kgsl_mem_entry_get(entry);
 	spin_unlock(&private->mem_lock);
 
 	if (entry == NULL)
@@ -2216,7 +2510,7 @@ kgsl_register_device(struct kgsl_device *device)
 	INIT_WORK(&device->idle_check_ws, kgsl_idle_check);
 	INIT_WORK(&device->ts_expired_ws, kgsl_timestamp_expired);
 
-	INIT_LIST_HEAD(&device->events);
+	INIT_LIST_HEAD(&device->event_owners);
 
 	ret = kgsl_mmu_init(device);
 	if (ret != 0)
@@ -2389,11 +2683,16 @@ static void kgsl_core_exit(void)
 	kgsl_cffdump_destroy();
 	kgsl_core_debugfs_close();
 	kgsl_sharedmem_uninit_sysfs();
+	kgsl_page_pool_uninit();
 }
 
 static int __init kgsl_core_init(void)
 {
 	int result = 0;
+
+	/* before anything that can fail, kgsl_core_exit() unregisters it */
+	kgsl_page_pool_init();
+
 	/* alloc major and minor device numbers */
 	result = alloc_chrdev_region(&kgsl_driver.major, 0, KGSL_DEVICE_MAX,
 				  KGSL_NAME);
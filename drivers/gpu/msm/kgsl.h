@@ -22,6 +22,7 @@
 #include <linux/cdev.h>
 #include <linux/regulator/consumer.h>
 #include <linux/mm.h>
+#include <linux/rbtree.h>
 
 #define KGSL_NAME "kgsl"
 
@@ -99,6 +100,8 @@ struct kgsl_driver {
 		unsigned int coherent_max;
 		unsigned int mapped;
 		unsigned int mapped_max;
+		unsigned int page_pool_hits;
+		unsigned int page_pool_misses;
 		unsigned int histogram[16];
 	} stats;
 };
@@ -143,7 +146,12 @@ struct kgsl_mem_entry {
 	struct kgsl_memdesc memdesc;
 	int memtype;
 	void *priv_data;
-	struct list_head list;
+	/* node in the owning process's mem_rb, keyed by gpuaddr */
+	struct rb_node node;
+	/* id in the owning process's mem_idr, 0 once detached */
+	int id;
+	/* flags of a GPUMEM_ALLOC(_ID), for GPUMEM_GET_INFO */
+	unsigned int flags;
 	uint32_t free_timestamp;
 	/* back pointer to private structure under whose context this
 	* allocation is made */
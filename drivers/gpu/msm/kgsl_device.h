@@ -125,8 +125,10 @@ struct kgsl_event {
 	uint32_t timestamp;
 	void (*func)(struct kgsl_device *, void *, u32);
 	void *priv;
+	/* node in the owner's events list */
 	struct list_head list;
-	struct kgsl_device_private *owner;
+	/* jiffies when the event was added */
+	unsigned long created;
 };
 
 
@@ -185,7 +187,11 @@ struct kgsl_device {
 	struct kgsl_pwrscale pwrscale;
 	struct kobject pwrscale_kobj;
 	struct work_struct ts_expired_ws;
-	struct list_head events;
+	/*
+	 * Instances with pending events, ordered by the timestamp of the
+	 * first event of each
+	 */
+	struct list_head event_owners;
 	s64 on_time;
 };
 
@@ -208,7 +214,9 @@ struct kgsl_process_private {
 	unsigned int refcnt;
 	pid_t pid;
 	spinlock_t mem_lock;
-	struct list_head mem_list;
+	/* mem entries by gpuaddr and by id, both under mem_lock */
+	struct rb_root mem_rb;
+	struct idr mem_idr;
 	struct kgsl_pagetable *pagetable;
 	struct list_head list;
 	struct kobject kobj;
@@ -222,6 +230,10 @@ struct kgsl_process_private {
 struct kgsl_device_private {
 	struct kgsl_device *device;
 	struct kgsl_process_private *process_priv;
+	/* Pending timestamp events of this instance, by timestamp */
+	struct list_head events;
+	/* node in device->event_owners while events isn't empty */
+	struct list_head event_node;
 };
 
 struct kgsl_power_stats {
@@ -15,6 +15,7 @@
 #include <asm/cacheflush.h>
 #include <linux/slab.h>
 #include <linux/kmemleak.h>
+#include <linux/highmem.h>
 
 #include "kgsl.h"
 #include "kgsl_sharedmem.h"
@@ -193,6 +194,22 @@ kgsl_process_init_sysfs(struct kgsl_process_private *private)
 	}
 }
 
+/*
+ * Pool of free pages for the vmalloc backed allocations.  Pages are
+ * zeroed and flushed out of the inner and outer caches before they go
+ * into the pool, so an allocation can use them as they are.  The pool
+ * holds at most CONFIG_MSM_KGSL_PAGE_POOL_PAGES pages and is emptied by
+ * a shrinker when memory runs low.
+ */
+static struct {
+	spinlock_t lock;
+	struct list_head pages;
+	unsigned int count;
+} kgsl_page_pool = {
+	.lock = __SPIN_LOCK_UNLOCKED(kgsl_page_pool.lock),
+	.pages = LIST_HEAD_INIT(kgsl_page_pool.pages),
+};
+
 static int kgsl_drv_memstat_show(struct device *dev,
 				 struct device_attribute *attr,
 				 char *buf)
@@ -215,6 +232,22 @@ static int kgsl_drv_memstat_show(struct device *dev,
 	return snprintf(buf, PAGE_SIZE, "%u\n", val);
 }
 
+static int kgsl_drv_page_pool_show(struct device *dev,
+				   struct device_attribute *attr,
+				   char *buf)
+{
+	unsigned int val = 0;
+
+	if (!strcmp(attr->attr.name, "page_pool"))
+		val = kgsl_page_pool.count << PAGE_SHIFT;
+	else if (!strcmp(attr->attr.name, "page_pool_hits"))
+		val = kgsl_driver.stats.page_pool_hits;
+	else if (!strcmp(attr->attr.name, "page_pool_misses"))
+		val = kgsl_driver.stats.page_pool_misses;
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", val);
+}
+
 static int kgsl_drv_histogram_show(struct device *dev,
 				   struct device_attribute *attr,
 				   char *buf)
@@ -236,6 +269,9 @@ DEVICE_ATTR(coherent, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(coherent_max, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped_max, 0444, kgsl_drv_memstat_show, NULL);
+DEVICE_ATTR(page_pool, 0444, kgsl_drv_page_pool_show, NULL);
+DEVICE_ATTR(page_pool_hits, 0444, kgsl_drv_page_pool_show, NULL);
+DEVICE_ATTR(page_pool_misses, 0444, kgsl_drv_page_pool_show, NULL);
 DEVICE_ATTR(histogram, 0444, kgsl_drv_histogram_show, NULL);
 
 static const struct device_attribute *drv_attr_list[] = {
@@ -245,6 +281,9 @@ static const struct device_attribute *drv_attr_list[] = {
 	&dev_attr_coherent_max,
 	&dev_attr_mapped,
 	&dev_attr_mapped_max,
+	&dev_attr_page_pool,
+	&dev_attr_page_pool_hits,
+	&dev_attr_page_pool_misses,
 	&dev_attr_histogram,
 	NULL
 };
@@ -278,15 +317,33 @@ static void _outer_cache_range_op(int op, unsigned long addr, size_t size)
 	}
 }
 
+/*
+ * Physically contiguous entries are merged so that the outer cache
+ * controller gets one range operation per run instead of one per entry.
+ */
 static void outer_cache_range_op_sg(struct scatterlist *sg, int sglen, int op)
 {
 	struct scatterlist *s;
+	unsigned int start = 0;
+	size_t size = 0;
 	int i;
 
 	for_each_sg(sg, s, sglen, i) {
 		unsigned int paddr = kgsl_get_sg_pa(s);
-		_outer_cache_range_op(op, paddr, s->length);
+
+		if (size && paddr == start + size) {
+			size += s->length;
+			continue;
+		}
+
+		if (size)
+			_outer_cache_range_op(op, start, size);
+		start = paddr;
+		size = s->length;
 	}
+
+	if (size)
+		_outer_cache_range_op(op, start, size);
 }
 
 #else
@@ -295,6 +352,122 @@ static void outer_cache_range_op_sg(struct scatterlist *sg, int sglen, int op)
 }
 #endif
 
+/*
+ * Fill @sg with up to @count pages from the pool and return the number
+ * of pages used.
+ */
+static int kgsl_page_pool_get(struct scatterlist *sg, int count)
+{
+	int i;
+
+	spin_lock(&kgsl_page_pool.lock);
+	for (i = 0; i < count && kgsl_page_pool.count; i++) {
+		struct page *page = list_first_entry(&kgsl_page_pool.pages,
+						     struct page, lru);
+
+		list_del(&page->lru);
+		kgsl_page_pool.count--;
+		sg_set_page(&sg[i], page, PAGE_SIZE, 0);
+	}
+	spin_unlock(&kgsl_page_pool.lock);
+
+	return i;
+}
+
+/*
+ * Free the pages in @sg, keeping as many as fit in the pool.  Pages that
+ * are still mapped somewhere else, such as into the vma of
+ * IOCTL_KGSL_SHAREDMEM_FROM_VMALLOC, are left to the page allocator.
+ */
+static void kgsl_page_pool_put(struct scatterlist *sg, int sglen)
+{
+	struct scatterlist *s;
+	LIST_HEAD(pages);
+	int room, count = 0, first = -1, last = -1;
+	int i;
+
+	spin_lock(&kgsl_page_pool.lock);
+	room = CONFIG_MSM_KGSL_PAGE_POOL_PAGES - kgsl_page_pool.count;
+	spin_unlock(&kgsl_page_pool.lock);
+
+	for_each_sg(sg, s, sglen, i) {
+		struct page *page = sg_page(s);
+
+		if (count >= room || page_count(page) != 1) {
+			__free_page(page);
+			continue;
+		}
+
+		clear_highpage(page);
+		flush_dcache_page(page);
+		list_add_tail(&page->lru, &pages);
+		count++;
+
+		if (first < 0)
+			first = i;
+		last = i;
+	}
+
+	if (count == 0)
+		return;
+
+	/* one pass over the part of the scatterlist that was kept */
+	outer_cache_range_op_sg(&sg[first], last - first + 1,
+				KGSL_CACHE_OP_FLUSH);
+
+	spin_lock(&kgsl_page_pool.lock);
+	list_splice_tail(&pages, &kgsl_page_pool.pages);
+	kgsl_page_pool.count += count;
+	spin_unlock(&kgsl_page_pool.lock);
+}
+
+static int kgsl_page_pool_shrink(struct shrinker *shrinker,
+				 struct shrink_control *sc)
+{
+	int nr_to_scan = sc->nr_to_scan;
+	struct page *page, *tmp;
+	LIST_HEAD(pages);
+	int count;
+
+	spin_lock(&kgsl_page_pool.lock);
+	while (nr_to_scan-- > 0 && kgsl_page_pool.count) {
+		page = list_first_entry(&kgsl_page_pool.pages,
+					struct page, lru);
+		list_move(&page->lru, &pages);
+		kgsl_page_pool.count--;
+	}
+	count = kgsl_page_pool.count;
+	spin_unlock(&kgsl_page_pool.lock);
+
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+
+	return count;
+}
+
+static struct shrinker kgsl_page_pool_shrinker = {
+	.shrink = kgsl_page_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+void kgsl_page_pool_init(void)
+{
+	register_shrinker(&kgsl_page_pool_shrinker);
+}
+
+void kgsl_page_pool_uninit(void)
+{
+	struct shrink_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.nr_to_scan = INT_MAX,
+	};
+
+	unregister_shrinker(&kgsl_page_pool_shrinker);
+	kgsl_page_pool_shrink(&kgsl_page_pool_shrinker, &sc);
+}
+
 static int kgsl_vmalloc_vmfault(struct kgsl_memdesc *memdesc,
 				struct vm_area_struct *vma,
 				struct vm_fault *vmf)
@@ -323,14 +496,11 @@ static int kgsl_vmalloc_vmflags(struct kgsl_memdesc *memdesc)
 
 static void kgsl_vmalloc_free(struct kgsl_memdesc *memdesc)
 {
-	int i = 0;
-	struct scatterlist *sg;
 	kgsl_driver.stats.vmalloc -= memdesc->size;
 	if (memdesc->hostptr)
 		vunmap(memdesc->hostptr);
 	if (memdesc->sg)
-		for_each_sg(memdesc->sg, sg, memdesc->sglen, i)
-			__free_page(sg_page(sg));
+		kgsl_page_pool_put(memdesc->sg, memdesc->sglen);
 }
 
 static int kgsl_contiguous_vmflags(struct kgsl_memdesc *memdesc)
@@ -456,7 +626,7 @@ _kgsl_sharedmem_vmalloc(struct kgsl_memdesc *memdesc,
 {
 	int order, ret = 0;
 	int sglen = PAGE_ALIGN(size) / PAGE_SIZE;
-	int i;
+	int i, hits;
 
 	memdesc->size = size;
 	memdesc->pagetable = pagetable;
@@ -474,7 +644,12 @@ _kgsl_sharedmem_vmalloc(struct kgsl_memdesc *memdesc,
 	memdesc->sglen = sglen;
 	sg_init_table(memdesc->sg, sglen);
 
-	for (i = 0; i < memdesc->sglen; i++) {
+	/* Pooled pages are already clean, only new ones need flushing */
+	hits = kgsl_page_pool_get(memdesc->sg, sglen);
+	kgsl_driver.stats.page_pool_hits += hits;
+	kgsl_driver.stats.page_pool_misses += sglen - hits;
+
+	for (i = hits; i < memdesc->sglen; i++) {
 		struct page *page = alloc_page(GFP_KERNEL | __GFP_ZERO |
 						__GFP_HIGHMEM);
 		if (!page) {
@@ -485,7 +660,7 @@ _kgsl_sharedmem_vmalloc(struct kgsl_memdesc *memdesc,
 		flush_dcache_page(page);
 		sg_set_page(&memdesc->sg[i], page, PAGE_SIZE, 0);
 	}
-	outer_cache_range_op_sg(memdesc->sg, memdesc->sglen,
+	outer_cache_range_op_sg(&memdesc->sg[hits], memdesc->sglen - hits,
 				KGSL_CACHE_OP_FLUSH);
 
 	ret = kgsl_mmu_map(pagetable, memdesc, protflags);
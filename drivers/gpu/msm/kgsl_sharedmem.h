@@ -71,6 +71,9 @@ void kgsl_process_uninit_sysfs(struct kgsl_process_private *private);
 int kgsl_sharedmem_init_sysfs(void);
 void kgsl_sharedmem_uninit_sysfs(void);
 
+void kgsl_page_pool_init(void);
+void kgsl_page_pool_uninit(void);
+
 static inline unsigned int kgsl_get_sg_pa(struct scatterlist *sg)
 {
 	/*
@@ -257,6 +257,93 @@ DEFINE_EVENT(kgsl_pwrstate_template, kgsl_pwr_request_state,
 	TP_ARGS(device, state)
 );
 
+/*
+ * Tracepoint for adding a timestamp event
+ */
+TRACE_EVENT(kgsl_register_event,
+
+	TP_PROTO(struct kgsl_device *device, unsigned int timestamp),
+
+	TP_ARGS(device, timestamp),
+
+	TP_STRUCT__entry(
+		__string(device_name, device->name)
+		__field(unsigned int, timestamp)
+	),
+
+	TP_fast_assign(
+		__assign_str(device_name, device->name);
+		__entry->timestamp = timestamp;
+	),
+
+	TP_printk(
+		"d_name=%s timestamp=%u",
+		__get_str(device_name),
+		__entry->timestamp
+	)
+);
+
+/*
+ * Tracepoint for calling the callback of a timestamp event.  age is the
+ * time since the event was added, in ms.
+ */
+TRACE_EVENT(kgsl_fire_event,
+
+	TP_PROTO(struct kgsl_device *device, unsigned int timestamp,
+		unsigned int age),
+
+	TP_ARGS(device, timestamp, age),
+
+	TP_STRUCT__entry(
+		__string(device_name, device->name)
+		__field(unsigned int, timestamp)
+		__field(unsigned int, age)
+	),
+
+	TP_fast_assign(
+		__assign_str(device_name, device->name);
+		__entry->timestamp = timestamp;
+		__entry->age = age;
+	),
+
+	TP_printk(
+		"d_name=%s timestamp=%u age=%u",
+		__get_str(device_name),
+		__entry->timestamp,
+		__entry->age
+	)
+);
+
+/*
+ * Tracepoint for the end of a pass over the expired events
+ */
+TRACE_EVENT(kgsl_retire_events,
+
+	TP_PROTO(struct kgsl_device *device, unsigned int timestamp,
+		unsigned int count),
+
+	TP_ARGS(device, timestamp, count),
+
+	TP_STRUCT__entry(
+		__string(device_name, device->name)
+		__field(unsigned int, timestamp)
+		__field(unsigned int, count)
+	),
+
+	TP_fast_assign(
+		__assign_str(device_name, device->name);
+		__entry->timestamp = timestamp;
+		__entry->count = count;
+	),
+
+	TP_printk(
+		"d_name=%s timestamp=%u count=%u",
+		__get_str(device_name),
+		__entry->timestamp,
+		__entry->count
+	)
+);
+
 #endif /* _KGSL_TRACE_H */
 
 /* This part must be outside protection */
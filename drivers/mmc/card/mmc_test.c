@@ -148,6 +148,16 @@ struct mmc_test_card {
 	struct mmc_test_general_result	*gr;
 };
 
+/**
+ * struct mmc_test_async_req - state for a non-blocking test request.
+ * @areq: async request handed to mmc_start_req()
+ * @test: test information, used to check the result on completion
+ */
+struct mmc_test_async_req {
+	struct mmc_async_req areq;
+	struct mmc_test_card *test;
+};
+
 /*******************************************************************/
 /*  General helper functions                                       */
 /*******************************************************************/
@@ -745,6 +755,101 @@ static int mmc_test_simple_transfer(struct mmc_test_card *test,
 	return mmc_test_check_result(test, &mrq);
 }
 
+static void mmc_test_nonblock_reset(struct mmc_request *mrq,
+				    struct mmc_command *cmd,
+				    struct mmc_command *stop,
+				    struct mmc_data *data)
+{
+	memset(mrq, 0, sizeof(struct mmc_request));
+	memset(cmd, 0, sizeof(struct mmc_command));
+	memset(data, 0, sizeof(struct mmc_data));
+	memset(stop, 0, sizeof(struct mmc_command));
+
+	mrq->cmd = cmd;
+	mrq->data = data;
+	mrq->stop = stop;
+}
+
+/*
+ * Checks a completed non-blocking request, called by mmc_start_req()
+ */
+static int mmc_test_check_result_async(struct mmc_card *card,
+				       struct mmc_async_req *areq)
+{
+	struct mmc_test_async_req *test_async =
+		container_of(areq, struct mmc_test_async_req, areq);
+
+	mmc_test_wait_busy(test_async->test);
+
+	return mmc_test_check_result(test_async->test, areq->mrq);
+}
+
+/*
+ * Issues @count transfers back to back through mmc_start_req(), so that
+ * the host can prepare each request while the previous one is active.
+ */
+static int mmc_test_nonblock_transfer(struct mmc_test_card *test,
+				      struct scatterlist *sg, unsigned sg_len,
+				      unsigned dev_addr, unsigned blocks,
+				      unsigned blksz, int write, int count)
+{
+	struct mmc_request mrq1;
+	struct mmc_command cmd1;
+	struct mmc_command stop1;
+	struct mmc_data data1;
+
+	struct mmc_request mrq2;
+	struct mmc_command cmd2;
+	struct mmc_command stop2;
+	struct mmc_data data2;
+
+	struct mmc_test_async_req test_areq[2];
+	struct mmc_async_req *done_areq;
+	struct mmc_async_req *cur_areq = &test_areq[0].areq;
+	struct mmc_async_req *other_areq = &test_areq[1].areq;
+	int i;
+	int ret = 0;
+
+	test_areq[0].test = test;
+	test_areq[1].test = test;
+
+	mmc_test_nonblock_reset(&mrq1, &cmd1, &stop1, &data1);
+	mmc_test_nonblock_reset(&mrq2, &cmd2, &stop2, &data2);
+
+	cur_areq->mrq = &mrq1;
+	cur_areq->err_check = mmc_test_check_result_async;
+	other_areq->mrq = &mrq2;
+	other_areq->err_check = mmc_test_check_result_async;
+
+	for (i = 0; i < count; i++) {
+		mmc_test_prepare_mrq(test, cur_areq->mrq, sg, sg_len, dev_addr,
+				     blocks, blksz, write);
+		done_areq = mmc_start_req(test->card->host, cur_areq, &ret);
+
+		if (ret || (!done_areq && i > 0))
+			goto err;
+
+		if (done_areq) {
+			if (done_areq->mrq == &mrq2)
+				mmc_test_nonblock_reset(&mrq2, &cmd2,
+							&stop2, &data2);
+			else
+				mmc_test_nonblock_reset(&mrq1, &cmd1,
+							&stop1, &data1);
+		}
+		done_areq = cur_areq;
+		cur_areq = other_areq;
+		other_areq = done_areq;
+		dev_addr += blocks;
+	}
+
+	done_areq = mmc_start_req(test->card->host, NULL, &ret);
+
+	return ret;
+err:
+	return ret;
+}
+
 /*
  * Tests a transfer where the card will fail completely or partly
  */
@@ -1336,21 +1441,23 @@ static int mmc_test_area_transfer(struct mmc_test_card *test,
 }
 
 /*
- * Map and transfer bytes.
+ * Map and transfer bytes for multiple transfers.
  */
-static int mmc_test_area_io(struct mmc_test_card *test, unsigned long sz,
-			    unsigned int dev_addr, int write, int max_scatter,
-			    int timed)
+static int mmc_test_area_io_seq(struct mmc_test_card *test, unsigned long sz,
+				unsigned int dev_addr, int write,
+				int max_scatter, int timed, int count,
+				bool nonblock)
 {
 	struct timespec ts1, ts2;
-	int ret;
+	int ret = 0;
+	int i;
+	struct mmc_test_area *t = &test->area;
 
 	/*
 	 * In the case of a maximally scattered transfer, the maximum transfer
 	 * size is further limited by using PAGE_SIZE segments.
 	 */
 	if (max_scatter) {
-		struct mmc_test_area *t = &test->area;
 		unsigned long max_tfr;
 
 		if (t->max_seg_sz >= PAGE_SIZE)
@@ -1368,19 +1475,40 @@ static int mmc_test_area_io(struct mmc_test_card *test, unsigned long sz,
 	if (timed)
 		getnstimeofday(&ts1);
 
-	ret = mmc_test_area_transfer(test, dev_addr, write);
+	if (nonblock)
+		ret = mmc_test_nonblock_transfer(test, t->sg, t->sg_len,
+				 dev_addr, t->blocks, 512, write, count);
+	else
+		for (i = 0; i < count && ret == 0; i++) {
+			ret = mmc_test_area_transfer(test, dev_addr, write);
+			dev_addr += sz >> 9;
+		}
+
 	if (ret)
 		return ret;
 
 	if (timed)
 		getnstimeofday(&ts2);
 
-	if (timed)
+	if (timed && count > 1)
+		mmc_test_print_avg_rate(test, sz, count, &ts1, &ts2);
+	else if (timed)
 		mmc_test_print_rate(test, sz, &ts1, &ts2);
 
 	return 0;
 }
 
+/*
+ * Map and transfer bytes.
+ */
+static int mmc_test_area_io(struct mmc_test_card *test, unsigned long sz,
+			    unsigned int dev_addr, int write, int max_scatter,
+			    int timed)
+{
+	return mmc_test_area_io_seq(test, sz, dev_addr, write, max_scatter,
+				    timed, 1, false);
+}
+
 /*
  * Write the test area entirely.
  */
@@ -1954,6 +2082,251 @@ static int mmc_test_large_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_large_seq_perf(test, 1);
 }
 
+/*
+ * Sequential performance by transfer size, issuing the transfers either
+ * one at a time or pipelined through mmc_start_req().
+ */
+static int mmc_test_rw_multiple_size(struct mmc_test_card *test, int write,
+				     bool nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz, tot_sz;
+	unsigned int count;
+	int ret;
+
+	tot_sz = min_t(unsigned long, t->max_sz, 16 * 1024 * 1024);
+
+	for (sz = 4096; sz <= min_t(unsigned long, t->max_tfr, 4 << 20);
+	     sz <<= 1) {
+		if (write) {
+			ret = mmc_test_area_erase(test);
+			if (ret)
+				return ret;
+		}
+		count = tot_sz / sz;
+		ret = mmc_test_area_io_seq(test, sz, t->dev_addr, write, 0, 1,
+					   count, nonblock);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write performance by transfer size using blocking requests.
+ */
+static int mmc_test_profile_mult_write_blocking_perf(struct mmc_test_card *test)
+{
+	return mmc_test_rw_multiple_size(test, 1, false);
+}
+
+/*
+ * Write performance by transfer size using non-blocking requests.
+ */
+static int mmc_test_profile_mult_write_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_rw_multiple_size(test, 1, true);
+}
+
+/*
+ * Read performance by transfer size using blocking requests.
+ */
+static int mmc_test_profile_mult_read_blocking_perf(struct mmc_test_card *test)
+{
+	return mmc_test_rw_multiple_size(test, 0, false);
+}
+
+/*
+ * Read performance by transfer size using non-blocking requests.
+ */
+static int mmc_test_profile_mult_read_nonblock_perf(struct mmc_test_card *test)
+{
+	return mmc_test_rw_multiple_size(test, 0, true);
+}
+
+/*
+ * Write through the volatile cache and time the flush to the medium.
+ */
+static int mmc_test_cache_flush(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz;
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (!test->card->ext_csd.cache_ctrl)
+		return RESULT_UNSUP_CARD;
+
+	for (sz = 512; sz <= t->max_tfr; sz <<= 1) {
+		ret = mmc_test_area_io(test, sz, t->dev_addr, 1, 0, 0);
+		if (ret)
+			return ret;
+		getnstimeofday(&ts1);
+		ret = mmc_flush_cache(test->card);
+		if (ret)
+			return ret;
+		getnstimeofday(&ts2);
+		mmc_test_print_rate(test, sz, &ts1, &ts2);
+	}
+
+	return 0;
+}
+
+/*
+ * Start BKOPS regardless of the urgency level, then time how long HPI takes
+ * to get the card back to transfer state and check that it still reads.
+ */
+static int mmc_test_bkops_hpi(struct mmc_test_card *test)
+{
+	struct mmc_card *card = test->card;
+	struct mmc_test_area *t = &test->area;
+	struct mmc_command cmd = {0};
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (!card->ext_csd.bkops_en || !card->ext_csd.hpi_en)
+		return RESULT_UNSUP_CARD;
+
+	ret = mmc_start_bkops(card, true);
+	if (ret)
+		return ret;
+
+	getnstimeofday(&ts1);
+	ret = mmc_stop_bkops(card);
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+	mmc_test_print_rate(test, 0, &ts1, &ts2);
+
+	if (mmc_card_doing_bkops(card))
+		return RESULT_FAIL;
+
+	cmd.opcode = MMC_SEND_STATUS;
+	cmd.arg = card->rca << 16;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	ret = mmc_wait_for_cmd(card->host, &cmd, 0);
+	if (ret)
+		return ret;
+	if (R1_CURRENT_STATE(cmd.resp[0]) != R1_STATE_TRAN)
+		return RESULT_FAIL;
+
+	return mmc_test_area_io(test, t->max_tfr, t->dev_addr, 0, 0, 0);
+}
+
+/*
+ * Write @nr 4 KiB chunks, spread over the test area, as one packed write:
+ * a header block listing each chunk's CMD23 and CMD25 arguments, then
+ * the data of all chunks in a single CMD25.
+ */
+static int mmc_test_packed_write(struct mmc_test_card *test, u32 *hdr,
+				 struct scatterlist *sg, unsigned int nr)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	struct mmc_request mrq = {0};
+	struct mmc_command sbc = {0};
+	struct mmc_command cmd = {0};
+	struct mmc_command stop = {0};
+	struct mmc_data data = {0};
+	unsigned int i, sg_len, dev_addr;
+	int ret;
+
+	memset(hdr, 0, 512);
+	hdr[0] = (nr << 16) | (PACKED_CMD_WR << 8) | PACKED_CMD_VER;
+	for (i = 1; i <= nr; i++) {
+		dev_addr = t->dev_addr + (i - 1) * 16;
+		hdr[i * 2] = 8;
+		hdr[i * 2 + 1] = mmc_card_blockaddr(card) ?
+				 dev_addr : dev_addr << 9;
+	}
+
+	sg_init_table(sg, t->max_segs);
+	sg_set_buf(sg, hdr, 512);
+	ret = mmc_test_map_sg(t->mem, nr * 4096, sg + 1, 1, t->max_segs - 1,
+			      t->max_seg_sz, &sg_len);
+	if (ret)
+		return ret;
+
+	mrq.sbc = &sbc;
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mrq.stop = &stop;
+	mmc_test_prepare_mrq(test, &mrq, sg, sg_len + 1, t->dev_addr,
+			     nr * 8 + 1, 512, 1);
+
+	sbc.opcode = MMC_SET_BLOCK_COUNT;
+	sbc.arg = MMC_CMD23_ARG_PACKED | (nr * 8 + 1);
+	sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	mmc_test_wait_busy(test);
+
+	if (sbc.error)
+		return sbc.error;
+
+	return mmc_test_check_result(test, &mrq);
+}
+
+/*
+ * Small scattered writes issued one by one and as a packed write.
+ */
+static int mmc_test_packed_write_perf(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_card *card = test->card;
+	struct scatterlist *sg;
+	struct timespec ts1, ts2;
+	unsigned int nr, max_nr, i;
+	u32 *hdr;
+	int ret = 0;
+
+	if (!mmc_card_mmc(card) || card->ext_csd.max_packed_writes < 2)
+		return RESULT_UNSUP_CARD;
+
+	if (!mmc_host_cmd23(card->host) || t->max_segs < 2)
+		return RESULT_UNSUP_HOST;
+
+	max_nr = min_t(unsigned int, card->ext_csd.max_packed_writes,
+		       MMC_PACKED_MAX_ENTRIES);
+	max_nr = min_t(unsigned int, max_nr, (t->max_tfr - 512) / 4096);
+	max_nr = min_t(unsigned int, max_nr, t->max_sz / 8192);
+	if (max_nr < 2)
+		return RESULT_UNSUP_HOST;
+
+	hdr = kzalloc(512, GFP_KERNEL);
+	sg = kmalloc(sizeof(struct scatterlist) * t->max_segs, GFP_KERNEL);
+	if (!hdr || !sg) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	for (nr = 2; nr <= max_nr; nr <<= 1) {
+		getnstimeofday(&ts1);
+		for (i = 0; i < nr; i++) {
+			ret = mmc_test_area_io(test, 4096,
+					       t->dev_addr + i * 16, 1, 0, 0);
+			if (ret)
+				goto out_free;
+		}
+		getnstimeofday(&ts2);
+		mmc_test_print_avg_rate(test, 4096, nr, &ts1, &ts2);
+
+		getnstimeofday(&ts1);
+		ret = mmc_test_packed_write(test, hdr, sg, nr);
+		if (ret)
+			goto out_free;
+		getnstimeofday(&ts2);
+		mmc_test_print_rate(test, nr * 4096, &ts1, &ts2);
+	}
+
+out_free:
+	kfree(sg);
+	kfree(hdr);
+	return ret;
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2221,6 +2594,55 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Write performance with blocking req 4k to 4MB",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_mult_write_blocking_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Write performance with non-blocking req 4k to 4MB",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_mult_write_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Read performance with blocking req 4k to 4MB",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_mult_read_blocking_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Read performance with non-blocking req 4k to 4MB",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_mult_read_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Cache flush after write by transfer size",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_cache_flush,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "BKOPS start and stop by HPI",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_bkops_hpi,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Packed write performance 4k scattered",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_packed_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -47,67 +47,105 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
-static int mmc_queue_thread(void *d)
-{
-	struct mmc_queue *mq = d;
-	struct request_queue *q = mq->queue;
-	struct request *req;
-
 #ifdef CONFIG_MMC_PERF_PROFILING
-	ktime_t start, diff;
+/*
+ * With asynchronous requests issue_fn() returns once the previous request
+ * has completed and @req has been started, so the time spent here is
+ * charged to the direction of @req, or when draining with a NULL @req, to
+ * the direction of the request drained.  issue_fn() may complete and free
+ * any request it is handed or waits on, discards and flushes always, so
+ * nothing is read from them once it has been called: the direction of the
+ * request left in flight is kept in mq->perf_dir instead.
+ */
+static void mmc_queue_issue(struct mmc_queue *mq, struct request *req)
+{
 	struct mmc_host *host = mq->card->host;
-	unsigned long bytes_xfer;
+	unsigned long bytes_xfer = 0;
+	ktime_t start, diff;
+	int dir;
+
+	if (req) {
+		if (req->cmd_flags & (REQ_DISCARD | REQ_FLUSH))
+			dir = -1;
+		else
+			dir = rq_data_dir(req);
+		bytes_xfer = blk_rq_bytes(req);
+	} else {
+		dir = mq->perf_dir;
+	}
+	mq->perf_dir = req ? dir : -1;
+
+	if (!host->perf_enable || dir < 0) {
+		mq->issue_fn(mq, req);
+		return;
+	}
+
+	start = ktime_get();
+	mq->issue_fn(mq, req);
+	diff = ktime_sub(ktime_get(), start);
+
+	/* A packed write carries the requests queued behind @req too */
+	if (req && mmc_packed_cmd(mq->mqrq_cur->cmd_type))
+		bytes_xfer = mq->mqrq_cur->packed->blocks << 9;
+
+	if (dir == READ) {
+		host->perf.rbytes_mmcq += bytes_xfer;
+		host->perf.rtime_mmcq = ktime_add(host->perf.rtime_mmcq, diff);
+	} else {
+		host->perf.wbytes_mmcq += bytes_xfer;
+		host->perf.wtime_mmcq = ktime_add(host->perf.wtime_mmcq, diff);
+	}
+}
+#else
+static inline void mmc_queue_issue(struct mmc_queue *mq, struct request *req)
+{
+	mq->issue_fn(mq, req);
+}
 #endif
 
+static int mmc_queue_thread(void *d)
+{
+	struct mmc_queue *mq = d;
+	struct request_queue *q = mq->queue;
 
 	current->flags |= PF_MEMALLOC;
 
 	down(&mq->thread_sem);
 	do {
-		req = NULL;	/* Must be set to NULL at each iteration */
+		struct request *req = NULL;
+		struct mmc_queue_req *tmp;
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
 		req = blk_fetch_request(q);
-		mq->req = req;
+		mq->mqrq_cur->req = req;
 		spin_unlock_irq(q->queue_lock);
 
-		if (!req) {
+		/*
+		 * A NULL req with a previous request still in flight makes
+		 * issue_fn() wait for it to complete.
+		 */
+		if (req || mq->mqrq_prev->req) {
+			set_current_state(TASK_RUNNING);
+			mmc_queue_issue(mq, req);
+		} else {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
 				break;
 			}
+			/* Out of requests: let the card do BKOPS if it idles */
+			mmc_start_idle_bkops(mq->card);
 			up(&mq->thread_sem);
 			schedule();
 			down(&mq->thread_sem);
-			continue;
 		}
-		set_current_state(TASK_RUNNING);
 
-#ifdef CONFIG_MMC_PERF_PROFILING
-		if (host->perf_enable) {
-			bytes_xfer = blk_rq_bytes(req);
-			if (rq_data_dir(req) == READ) {
-				start = ktime_get();
-				mq->issue_fn(mq, req);
-				diff = ktime_sub(ktime_get(), start);
-				host->perf.rbytes_mmcq += bytes_xfer;
-				host->perf.rtime_mmcq =
-					ktime_add(host->perf.rtime_mmcq, diff);
-			} else {
-				start = ktime_get();
-				mq->issue_fn(mq, req);
-				diff = ktime_sub(ktime_get(), start);
-				host->perf.wbytes_mmcq += bytes_xfer;
-				host->perf.wtime_mmcq =
-					ktime_add(host->perf.wtime_mmcq, diff);
-			}
-		} else {
-			mq->issue_fn(mq, req);
-		}
-#else
-			mq->issue_fn(mq, req);
-#endif
+		/* Current request becomes previous request and vice versa. */
+		mq->mqrq_prev->brq.mrq.data = NULL;
+		mq->mqrq_prev->req = NULL;
+		tmp = mq->mqrq_prev;
+		mq->mqrq_prev = mq->mqrq_cur;
+		mq->mqrq_cur = tmp;
 	} while (1);
 	up(&mq->thread_sem);
 
@@ -133,10 +171,31 @@ static void mmc_request(struct request_queue *q)
 		return;
 	}
 
-	if (!mq->req)
+	if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
 		wake_up_process(mq->thread);
 }
 
+static void mmc_queue_free_bufs(struct mmc_queue *mq)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+		struct mmc_queue_req *mqrq = &mq->mqrq[i];
+
+		kfree(mqrq->bounce_sg);
+		mqrq->bounce_sg = NULL;
+
+		kfree(mqrq->sg);
+		mqrq->sg = NULL;
+
+		kfree(mqrq->bounce_buf);
+		mqrq->bounce_buf = NULL;
+
+		kfree(mqrq->packed);
+		mqrq->packed = NULL;
+	}
+}
+
 /**
  * mmc_init_queue - initialise a queue structure.
  * @mq: mmc queue
@@ -151,7 +210,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 {
 	struct mmc_host *host = card->host;
 	u64 limit = BLK_BOUNCE_HIGH;
-	int ret;
+	int ret, i;
 
 	if (mmc_dev(host)->dma_mask && *mmc_dev(host)->dma_mask)
 		limit = *mmc_dev(host)->dma_mask;
@@ -161,8 +220,11 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	if (!mq->queue)
 		return -ENOMEM;
 
+	memset(&mq->mqrq, 0, sizeof(mq->mqrq));
+	mq->mqrq_cur = &mq->mqrq[0];
+	mq->mqrq_prev = &mq->mqrq[1];
+	mq->perf_dir = -1;
 	mq->queue->queuedata = mq;
-	mq->req = NULL;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
@@ -191,53 +253,71 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 			bouncesz = host->max_blk_count * 512;
 
 		if (bouncesz > 512) {
-			mq->bounce_buf = kmalloc(bouncesz, GFP_KERNEL);
-			if (!mq->bounce_buf) {
-				printk(KERN_WARNING "%s: unable to "
-					"allocate bounce buffer\n",
-					mmc_card_name(card));
+			for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+				mq->mqrq[i].bounce_buf = kmalloc(bouncesz,
+								 GFP_KERNEL);
+				if (!mq->mqrq[i].bounce_buf) {
+					printk(KERN_WARNING "%s: unable to "
+						"allocate bounce buffer\n",
+						mmc_card_name(card));
+					break;
+				}
+			}
+			/* Bouncing is all or nothing for the two slots */
+			if (i < ARRAY_SIZE(mq->mqrq)) {
+				for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+					kfree(mq->mqrq[i].bounce_buf);
+					mq->mqrq[i].bounce_buf = NULL;
+				}
 			}
 		}
 
-		if (mq->bounce_buf) {
+		if (mq->mqrq_cur->bounce_buf) {
 			blk_queue_bounce_limit(mq->queue, BLK_BOUNCE_ANY);
 			blk_queue_max_hw_sectors(mq->queue, bouncesz / 512);
 			blk_queue_max_segments(mq->queue, bouncesz / 512);
 			blk_queue_max_segment_size(mq->queue, bouncesz);
 
-			mq->sg = kmalloc(sizeof(struct scatterlist),
-				GFP_KERNEL);
-			if (!mq->sg) {
-				ret = -ENOMEM;
-				goto cleanup_queue;
-			}
-			sg_init_table(mq->sg, 1);
-
-			mq->bounce_sg = kmalloc(sizeof(struct scatterlist) *
-				bouncesz / 512, GFP_KERNEL);
-			if (!mq->bounce_sg) {
-				ret = -ENOMEM;
-				goto cleanup_queue;
+			for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+				struct mmc_queue_req *mqrq = &mq->mqrq[i];
+
+				mqrq->sg = kmalloc(sizeof(struct scatterlist),
+					GFP_KERNEL);
+				if (!mqrq->sg) {
+					ret = -ENOMEM;
+					goto cleanup_queue;
+				}
+				sg_init_table(mqrq->sg, 1);
+
+				mqrq->bounce_sg = kmalloc(
+					sizeof(struct scatterlist) *
+					bouncesz / 512, GFP_KERNEL);
+				if (!mqrq->bounce_sg) {
+					ret = -ENOMEM;
+					goto cleanup_queue;
+				}
+				sg_init_table(mqrq->bounce_sg, bouncesz / 512);
 			}
-			sg_init_table(mq->bounce_sg, bouncesz / 512);
 		}
 	}
 #endif
 
-	if (!mq->bounce_buf) {
+	if (!mq->mqrq_cur->bounce_buf) {
 		blk_queue_bounce_limit(mq->queue, limit);
 		blk_queue_max_hw_sectors(mq->queue,
 			min(host->max_blk_count, host->max_req_size / 512));
 		blk_queue_max_segments(mq->queue, host->max_segs);
 		blk_queue_max_segment_size(mq->queue, host->max_seg_size);
 
-		mq->sg = kmalloc(sizeof(struct scatterlist) *
-			host->max_segs, GFP_KERNEL);
-		if (!mq->sg) {
-			ret = -ENOMEM;
-			goto cleanup_queue;
+		for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+			mq->mqrq[i].sg = kmalloc(sizeof(struct scatterlist) *
+				host->max_segs, GFP_KERNEL);
+			if (!mq->mqrq[i].sg) {
+				ret = -ENOMEM;
+				goto cleanup_queue;
+			}
+			sg_init_table(mq->mqrq[i].sg, host->max_segs);
 		}
-		sg_init_table(mq->sg, host->max_segs);
 	}
 
 	sema_init(&mq->thread_sem, 1);
@@ -247,21 +327,12 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	if (IS_ERR(mq->thread)) {
 		ret = PTR_ERR(mq->thread);
-		goto free_bounce_sg;
+		goto cleanup_queue;
 	}
 
 	return 0;
- free_bounce_sg:
- 	if (mq->bounce_sg)
- 		kfree(mq->bounce_sg);
- 	mq->bounce_sg = NULL;
  cleanup_queue:
- 	if (mq->sg)
-		kfree(mq->sg);
-	mq->sg = NULL;
-	if (mq->bounce_buf)
-		kfree(mq->bounce_buf);
-	mq->bounce_buf = NULL;
+	mmc_queue_free_bufs(mq);
 	blk_cleanup_queue(mq->queue);
 	return ret;
 }
@@ -283,21 +354,47 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	blk_start_queue(q);
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
- 	if (mq->bounce_sg)
- 		kfree(mq->bounce_sg);
- 	mq->bounce_sg = NULL;
-
-	kfree(mq->sg);
-	mq->sg = NULL;
-
-	if (mq->bounce_buf)
-		kfree(mq->bounce_buf);
-	mq->bounce_buf = NULL;
+	mmc_queue_free_bufs(mq);
 
 	mq->card = NULL;
 }
 EXPORT_SYMBOL(mmc_cleanup_queue);
 
+/**
+ * mmc_packed_init - allocate the packed command descriptors
+ * @mq: mmc queue
+ * @card: mmc card attached to @mq
+ *
+ * Each of the two request slots gets its own descriptor, so a packed
+ * command can be prepared while the previous one is in flight.
+ */
+int mmc_packed_init(struct mmc_queue *mq, struct mmc_card *card)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+		struct mmc_queue_req *mqrq = &mq->mqrq[i];
+
+		mqrq->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+		if (!mqrq->packed) {
+			pr_warning("%s: unable to allocate packed cmd\n",
+				   mmc_card_name(card));
+			goto err;
+		}
+		INIT_LIST_HEAD(&mqrq->packed->list);
+		mqrq->packed->idx_failure = MMC_PACKED_NR_IDX;
+	}
+
+	return 0;
+
+err:
+	for (i = 0; i < ARRAY_SIZE(mq->mqrq); i++) {
+		kfree(mq->mqrq[i].packed);
+		mq->mqrq[i].packed = NULL;
+	}
+	return -ENOMEM;
+}
+
 /**
  * mmc_queue_suspend - suspend a MMC request queue
  * @mq: MMC queue to suspend
@@ -342,30 +439,72 @@ void mmc_queue_resume(struct mmc_queue *mq)
 	}
 }
 
+/* sg_mark_end() counterpart, so the next run can follow this entry */
+static inline void mmc_sg_unmark_end(struct scatterlist *sg)
+{
+	sg->page_link &= ~0x02;
+}
+
+/*
+ * Map a packed write: the header block first, then the data of every
+ * request in the group, back to back in a single sg list.
+ */
+static unsigned int mmc_queue_packed_map_sg(struct mmc_queue *mq,
+					    struct mmc_packed *packed,
+					    struct scatterlist *sg)
+{
+	struct scatterlist *__sg = sg;
+	unsigned int sg_len = 0;
+	struct request *req;
+
+	sg_set_buf(__sg, packed->cmd_hdr, sizeof(packed->cmd_hdr));
+	mmc_sg_unmark_end(__sg++);
+	sg_len++;
+
+	list_for_each_entry(req, &packed->list, queuelist) {
+		sg_len += blk_rq_map_sg(mq->queue, req, __sg);
+		__sg = sg + sg_len;
+		mmc_sg_unmark_end(__sg - 1);
+	}
+	sg_mark_end(sg + (sg_len - 1));
+
+	return sg_len;
+}
+
+static unsigned int mmc_queue_rq_map_sg(struct mmc_queue *mq,
+					struct mmc_queue_req *mqrq,
+					struct scatterlist *sg)
+{
+	if (mmc_packed_cmd(mqrq->cmd_type))
+		return mmc_queue_packed_map_sg(mq, mqrq->packed, sg);
+
+	return blk_rq_map_sg(mq->queue, mqrq->req, sg);
+}
+
 /*
  * Prepare the sg list(s) to be handed of to the host driver
  */
-unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
+unsigned int mmc_queue_map_sg(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
 {
 	unsigned int sg_len;
 	size_t buflen;
 	struct scatterlist *sg;
 	int i;
 
-	if (!mq->bounce_buf)
-		return blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+	if (!mqrq->bounce_buf)
+		return mmc_queue_rq_map_sg(mq, mqrq, mqrq->sg);
 
-	BUG_ON(!mq->bounce_sg);
+	BUG_ON(!mqrq->bounce_sg);
 
-	sg_len = blk_rq_map_sg(mq->queue, mq->req, mq->bounce_sg);
+	sg_len = mmc_queue_rq_map_sg(mq, mqrq, mqrq->bounce_sg);
 
-	mq->bounce_sg_len = sg_len;
+	mqrq->bounce_sg_len = sg_len;
 
 	buflen = 0;
-	for_each_sg(mq->bounce_sg, sg, sg_len, i)
+	for_each_sg(mqrq->bounce_sg, sg, sg_len, i)
 		buflen += sg->length;
 
-	sg_init_one(mq->sg, mq->bounce_buf, buflen);
+	sg_init_one(mqrq->sg, mqrq->bounce_buf, buflen);
 
 	return 1;
 }
@@ -374,31 +513,30 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
  * If writing, bounce the data to the buffer before the request
  * is sent to the host driver
  */
-void mmc_queue_bounce_pre(struct mmc_queue *mq)
+void mmc_queue_bounce_pre(struct mmc_queue_req *mqrq)
 {
-	if (!mq->bounce_buf)
+	if (!mqrq->bounce_buf)
 		return;
 
-	if (rq_data_dir(mq->req) != WRITE)
+	if (rq_data_dir(mqrq->req) != WRITE)
 		return;
 
-	sg_copy_to_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+	sg_copy_to_buffer(mqrq->bounce_sg, mqrq->bounce_sg_len,
+		mqrq->bounce_buf, mqrq->sg[0].length);
 }
 
 /*
  * If reading, bounce the data from the buffer after the request
  * has been handled by the host driver
  */
-void mmc_queue_bounce_post(struct mmc_queue *mq)
+void mmc_queue_bounce_post(struct mmc_queue_req *mqrq)
 {
-	if (!mq->bounce_buf)
+	if (!mqrq->bounce_buf)
 		return;
 
-	if (rq_data_dir(mq->req) != READ)
+	if (rq_data_dir(mqrq->req) != READ)
 		return;
 
-	sg_copy_from_buffer(mq->bounce_sg, mq->bounce_sg_len,
-		mq->bounce_buf, mq->sg[0].length);
+	sg_copy_from_buffer(mqrq->bounce_sg, mqrq->bounce_sg_len,
+		mqrq->bounce_buf, mqrq->sg[0].length);
 }
-
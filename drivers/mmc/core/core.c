@@ -22,6 +22,7 @@
 #include <linux/device.h>
 #include <linux/delay.h>
 #include <linux/pagemap.h>
+#include <linux/slab.h>
 #include <linux/err.h>
 #include <linux/leds.h>
 #include <linux/scatterlist.h>
@@ -232,9 +233,139 @@ mmc_start_request(struct mmc_host *host, struct mmc_request *mrq)
 
 static void mmc_wait_done(struct mmc_request *mrq)
 {
-	complete(mrq->done_data);
+	complete(&mrq->completion);
 }
 
+static void __mmc_start_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	init_completion(&mrq->completion);
+	mrq->done = mmc_wait_done;
+	if (mmc_card_removed(host->card)) {
+		mrq->cmd->error = -ENOMEDIUM;
+		complete(&mrq->completion);
+		return;
+	}
+	mmc_start_request(host, mrq);
+}
+
+static void mmc_wait_for_req_done(struct mmc_host *host,
+				  struct mmc_request *mrq)
+{
+	wait_for_completion_io(&mrq->completion);
+}
+
+/**
+ *	mmc_pre_req - Prepare for a new request
+ *	@host: MMC host to prepare command
+ *	@mrq: MMC request to prepare for
+ *	@is_first_req: true if there is no previous started request
+ *		that may run in parallel to this call, otherwise false
+ *
+ *	mmc_pre_req() is called in prior to mmc_start_req() to let
+ *	host prepare for the new request. Preparation of a request may be
+ *	performed while another request is running on the host.
+ */
+static void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+/**
+ *	mmc_post_req - Post process a completed request
+ *	@host: MMC host to post process command
+ *	@mrq: MMC request to post process for
+ *	@err: Error, if non zero, clean up any resources made in pre_req
+ *
+ *	Let the host post process a completed request. Post processing of
+ *	a request may be performed while another request is running.
+ */
+static void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq,
+			 int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+/**
+ *	mmc_start_req - start a non-blocking request
+ *	@host: MMC host to start command
+ *	@areq: async request to start
+ *	@error: out parameter returns 0 for success, otherwise non zero
+ *
+ *	Start a new MMC custom command request for a host.
+ *	If there is an ongoing async request wait for completion
+ *	of that request and start the new one and return.
+ *	Does not wait for the new request to complete.
+ *
+ *	Returns the completed request, NULL in case of none completed.
+ *	Wait for an ongoing request (previously started) to complete and
+ *	return the completed request. If there is no ongoing request, NULL
+ *	is returned without waiting. NULL is not an error condition.
+ */
+struct mmc_async_req *mmc_start_req(struct mmc_host *host,
+				    struct mmc_async_req *areq, int *error)
+{
+	int err = 0;
+	struct mmc_async_req *data = host->areq;
+#ifdef CONFIG_MMC_PERF_PROFILING
+	ktime_t wait_start;
+#endif
+
+	/* Prepare a new request */
+	if (areq) {
+		mmc_pre_req(host, areq->mrq, !host->areq);
+#ifdef CONFIG_MMC_PERF_PROFILING
+		if (host->perf_enable) {
+			host->perf.nr_async++;
+			if (host->areq)
+				host->perf.nr_overlap++;
+		}
+#endif
+	}
+
+	if (host->areq) {
+#ifdef CONFIG_MMC_PERF_PROFILING
+		wait_start = ktime_get();
+#endif
+		mmc_wait_for_req_done(host, host->areq->mrq);
+#ifdef CONFIG_MMC_PERF_PROFILING
+		if (host->perf_enable)
+			host->perf.wait_time = ktime_add(host->perf.wait_time,
+					ktime_sub(ktime_get(), wait_start));
+#endif
+		err = host->areq->err_check(host->card, host->areq);
+		if (err) {
+			/* post process the completed failed request */
+			mmc_post_req(host, host->areq->mrq, 0);
+			if (areq)
+				/*
+				 * Cancel the new prepared request, because
+				 * it can't run until the failed
+				 * request has been properly handled.
+				 */
+				mmc_post_req(host, areq->mrq, -EINVAL);
+
+			host->areq = NULL;
+			goto out;
+		}
+	}
+
+	if (areq)
+		__mmc_start_req(host, areq->mrq);
+
+	if (host->areq)
+		mmc_post_req(host, host->areq->mrq, 0);
+
+	host->areq = areq;
+ out:
+	if (error)
+		*error = err;
+	return data;
+}
+EXPORT_SYMBOL(mmc_start_req);
+
 /**
  *	mmc_wait_for_req - start a request and wait for completion
  *	@host: MMC host to start command
@@ -246,18 +377,8 @@ static void mmc_wait_done(struct mmc_request *mrq)
  */
 void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 {
-	DECLARE_COMPLETION_ONSTACK(complete);
-
-	mrq->done_data = &complete;
-	mrq->done = mmc_wait_done;
-	if (mmc_card_removed(host->card)) {
-		mrq->cmd->error = -ENOMEDIUM;
-		return;
-	}
-
-	mmc_start_request(host, mrq);
-
-	wait_for_completion_io(&complete);
+	__mmc_start_req(host, mrq);
+	mmc_wait_for_req_done(host, mrq);
 }
 
 EXPORT_SYMBOL(mmc_wait_for_req);
@@ -291,6 +412,292 @@ int mmc_wait_for_cmd(struct mmc_host *host, struct mmc_command *cmd, int retries
 
 EXPORT_SYMBOL(mmc_wait_for_cmd);
 
+/**
+ *	mmc_interrupt_hpi - Issue for High priority Interrupt
+ *	@card: the MMC card associated with the HPI transfer
+ *
+ *	Issued High Priority Interrupt, and check for card status
+ *	util out-of prg-state.
+ */
+int mmc_interrupt_hpi(struct mmc_card *card)
+{
+	int err;
+	u32 status;
+	unsigned long prg_wait;
+
+	BUG_ON(!card);
+
+	if (!card->ext_csd.hpi_en) {
+		pr_info("%s: HPI enable bit unset\n", mmc_hostname(card->host));
+		return 1;
+	}
+
+	mmc_claim_host(card->host);
+	err = mmc_send_status(card, &status);
+	if (err) {
+		pr_err("%s: Get card status fail\n", mmc_hostname(card->host));
+		goto out;
+	}
+
+	switch (R1_CURRENT_STATE(status)) {
+	case R1_STATE_IDLE:
+	case R1_STATE_READY:
+	case R1_STATE_STBY:
+	case R1_STATE_TRAN:
+		/*
+		 * In idle and transfer states, HPI is not needed and the caller
+		 * can issue the next intended command immediately
+		 */
+		goto out;
+	case R1_STATE_PRG:
+		break;
+	default:
+		/* In all other states, it's illegal to issue HPI */
+		pr_debug("%s: HPI cannot be sent. Card state=%d\n",
+			mmc_hostname(card->host), R1_CURRENT_STATE(status));
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = mmc_send_hpi_cmd(card, &status);
+	if (err)
+		goto out;
+
+	prg_wait = jiffies + msecs_to_jiffies(card->ext_csd.out_of_int_time);
+	do {
+		err = mmc_send_status(card, &status);
+
+		if (!err && R1_CURRENT_STATE(status) == R1_STATE_TRAN)
+			break;
+		if (time_after(jiffies, prg_wait))
+			err = -ETIMEDOUT;
+	} while (!err);
+
+out:
+	mmc_release_host(card->host);
+	return err;
+}
+EXPORT_SYMBOL(mmc_interrupt_hpi);
+
+static int mmc_read_bkops_status(struct mmc_card *card)
+{
+	int err;
+	u8 *ext_csd;
+
+	/* The EXT_CSD format is mandated to be DMA-able, so no stack buffer */
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return -ENOMEM;
+
+	err = mmc_send_ext_csd(card, ext_csd);
+	if (!err)
+		card->ext_csd.raw_bkops_status = ext_csd[EXT_CSD_BKOPS_STATUS];
+
+	kfree(ext_csd);
+	return err;
+}
+
+/**
+ *	mmc_start_bkops - start BKOPS for supported cards
+ *	@card: MMC card to start BKOPS
+ *	@force: start BKOPS even if the card does not report a need for it
+ *
+ *	Start background operations whenever requested.  The switch is
+ *	sent without waiting for busy, so the card is left in the
+ *	programming state until BKOPS completes or mmc_stop_bkops()
+ *	interrupts it, so cards without HPI enabled are refused.  The
+ *	host must be claimed.
+ */
+int mmc_start_bkops(struct mmc_card *card, bool force)
+{
+	int err;
+	u8 level;
+
+	BUG_ON(!card);
+
+	if (!card->ext_csd.bkops_en || mmc_card_doing_bkops(card))
+		return 0;
+
+	/* Without HPI nothing could stop them again, e.g. for suspend */
+	if (!card->ext_csd.hpi_en)
+		return force ? -EOPNOTSUPP : 0;
+
+	err = mmc_read_bkops_status(card);
+	if (err) {
+		pr_err("%s: Didn't read bkops status : %d\n",
+		       mmc_hostname(card->host), err);
+		return err;
+	}
+
+	level = card->ext_csd.raw_bkops_status & EXT_CSD_BKOPS_LEVEL_MASK;
+	card->bkops_info.level[level]++;
+	if (!level && !force)
+		return 0;
+
+	err = __mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+			   EXT_CSD_BKOPS_START, 1, 0, false);
+	if (err) {
+		pr_warning("%s: error %d starting bkops\n",
+			   mmc_hostname(card->host), err);
+		return err;
+	}
+
+	mmc_card_set_doing_bkops(card);
+	card->bkops_info.nr_started++;
+
+	return 0;
+}
+EXPORT_SYMBOL(mmc_start_bkops);
+
+/**
+ *	mmc_stop_bkops - stop ongoing BKOPS
+ *	@card: MMC card to check BKOPS
+ *
+ *	Send HPI command to stop ongoing background operations to
+ *	allow rapid servicing of foreground operations, e.g. read/
+ *	writes. Wait until the card comes out of the programming state
+ *	to avoid errors in servicing read/write requests.
+ */
+int mmc_stop_bkops(struct mmc_card *card)
+{
+	int err = 0;
+	u32 status;
+
+	BUG_ON(!card);
+
+	if (!mmc_card_doing_bkops(card))
+		return 0;
+
+	/* Count the stops that actually had to preempt the card */
+	if (!mmc_send_status(card, &status) &&
+	    R1_CURRENT_STATE(status) == R1_STATE_PRG)
+		card->bkops_info.nr_hpi++;
+
+	err = mmc_interrupt_hpi(card);
+
+	/*
+	 * If err is EINVAL, we can't issue an HPI.
+	 * It should complete the BKOPS.
+	 */
+	if (!err || (err == -EINVAL)) {
+		mmc_card_clr_doing_bkops(card);
+		card->bkops_info.nr_stopped++;
+		err = 0;
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(mmc_stop_bkops);
+
+void mmc_bkops_work(struct work_struct *work)
+{
+	struct mmc_card *card = container_of(work, struct mmc_card,
+					     bkops_info.dw.work);
+
+	mmc_claim_host(card->host);
+	if (!mmc_card_removed(card))
+		mmc_start_bkops(card, false);
+	mmc_release_host(card->host);
+}
+
+/**
+ *	mmc_start_idle_bkops - arm idle time BKOPS
+ *	@card: MMC card that just ran out of requests
+ *
+ *	Called by the mmc queue when it goes idle.  BKOPS are only
+ *	started once the card has stayed idle for bkops_info.delay_ms,
+ *	and only if the card can be preempted with HPI.
+ */
+void mmc_start_idle_bkops(struct mmc_card *card)
+{
+	if (!mmc_card_mmc(card) || !card->ext_csd.bkops_en ||
+	    !card->ext_csd.hpi_en || !(card->host->caps2 & MMC_CAP2_BKOPS))
+		return;
+
+	schedule_delayed_work(&card->bkops_info.dw,
+			      msecs_to_jiffies(card->bkops_info.delay_ms));
+}
+EXPORT_SYMBOL(mmc_start_idle_bkops);
+
+/**
+ *	mmc_cancel_idle_bkops - disarm idle time BKOPS
+ *	@card: MMC card about to receive a request
+ *
+ *	Must be called without the host claimed, as the work claims it.
+ *	BKOPS already running on the card are stopped separately by
+ *	mmc_stop_bkops() once the host is claimed.
+ */
+void mmc_cancel_idle_bkops(struct mmc_card *card)
+{
+	if (!mmc_card_mmc(card))
+		return;
+
+	cancel_delayed_work_sync(&card->bkops_info.dw);
+}
+EXPORT_SYMBOL(mmc_cancel_idle_bkops);
+
+/*
+ * Flush the cache to the non-volatile storage.
+ */
+int mmc_flush_cache(struct mmc_card *card)
+{
+	struct mmc_host *host = card->host;
+	int err = 0;
+
+	if (!(host->caps2 & MMC_CAP2_CACHE_CTRL))
+		return err;
+
+	if (mmc_card_mmc(card) &&
+	    (card->ext_csd.cache_size > 0) &&
+	    (card->ext_csd.cache_ctrl & 1)) {
+		err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+				 EXT_CSD_FLUSH_CACHE, 1, 0);
+		if (err)
+			pr_err("%s: cache flush error %d\n",
+			       mmc_hostname(card->host), err);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(mmc_flush_cache);
+
+/*
+ * Turn the cache ON/OFF.
+ * Turning the cache OFF shall trigger flushing of the data
+ * to the non-volatile storage.
+ */
+int mmc_cache_ctrl(struct mmc_host *host, u8 enable)
+{
+	struct mmc_card *card = host->card;
+	unsigned int timeout;
+	int err = 0;
+
+	if (!(host->caps2 & MMC_CAP2_CACHE_CTRL) ||
+	    mmc_card_is_removable(host))
+		return err;
+
+	if (card && mmc_card_mmc(card) &&
+	    (card->ext_csd.cache_size > 0)) {
+		enable = !!enable;
+
+		if (card->ext_csd.cache_ctrl ^ enable) {
+			timeout = enable ? card->ext_csd.generic_cmd6_time : 0;
+			err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_CACHE_CTRL, enable, timeout);
+			if (err)
+				pr_err("%s: cache %s error %d\n",
+				       mmc_hostname(card->host),
+				       enable ? "on" : "off",
+				       err);
+			else
+				card->ext_csd.cache_ctrl = enable;
+		}
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(mmc_cache_ctrl);
+
 /**
  *	mmc_set_data_timeout - set the timeout for a data command
  *	@data: data phase for command
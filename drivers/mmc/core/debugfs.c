@@ -284,6 +284,146 @@ static const struct file_operations mmc_dbg_ext_csd_fops = {
 	.llseek		= default_llseek,
 };
 
+static int mmc_bkops_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_bkops_info *bi = &card->bkops_info;
+
+	seq_printf(s, "cache:\t\t%u KiB, %s\n", card->ext_csd.cache_size,
+		   card->ext_csd.cache_ctrl ? "on" : "off");
+	seq_printf(s, "hpi:\t\t%s (CMD%u)\n",
+		   card->ext_csd.hpi_en ? "enabled" :
+		   card->ext_csd.hpi ? "supported" : "unsupported",
+		   card->ext_csd.hpi_cmd);
+	seq_printf(s, "bkops:\t\t%s\n",
+		   card->ext_csd.bkops_en ? "enabled" :
+		   card->ext_csd.bkops ? "supported" : "unsupported");
+	seq_printf(s, "idle delay:\t%u ms\n", bi->delay_ms);
+	seq_printf(s, "doing bkops:\t%d\n", !!mmc_card_doing_bkops(card));
+	seq_printf(s, "started:\t%u\n", bi->nr_started);
+	seq_printf(s, "stopped:\t%u\n", bi->nr_stopped);
+	seq_printf(s, "stopped by hpi:\t%u\n", bi->nr_hpi);
+	seq_printf(s, "idle level:\t%u %u %u %u\n", bi->level[0],
+		   bi->level[1], bi->level[2], bi->level[3]);
+
+	return 0;
+}
+
+static int mmc_bkops_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_bkops_stats_show, inode->i_private);
+}
+
+static const struct file_operations mmc_dbg_bkops_stats_fops = {
+	.open		= mmc_bkops_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* Write 1 to start BKOPS right away, 0 to stop it with HPI */
+static int mmc_bkops_set(void *data, u64 val)
+{
+	struct mmc_card *card = data;
+	int err;
+
+	mmc_claim_host(card->host);
+	if (val)
+		err = mmc_start_bkops(card, true);
+	else
+		err = mmc_stop_bkops(card);
+	mmc_release_host(card->host);
+
+	return err;
+}
+DEFINE_SIMPLE_ATTRIBUTE(mmc_dbg_bkops_fops, NULL, mmc_bkops_set, "%llu\n");
+
+static int mmc_flush_cache_set(void *data, u64 val)
+{
+	struct mmc_card *card = data;
+	int err;
+
+	mmc_claim_host(card->host);
+	err = mmc_stop_bkops(card);
+	if (!err)
+		err = mmc_flush_cache(card);
+	mmc_release_host(card->host);
+
+	return err;
+}
+DEFINE_SIMPLE_ATTRIBUTE(mmc_dbg_flush_cache_fops, NULL, mmc_flush_cache_set,
+			"%llu\n");
+
+static const char * const mmc_pack_stop_reasons[MAX_REASONS] = {
+	[EXCEEDS_SEGMENTS]	= "exceeding max segments",
+	[EXCEEDS_SECTORS]	= "exceeding max sectors",
+	[WRONG_DATA_DIR]	= "wrong data direction",
+	[FLUSH_OR_DISCARD]	= "flush or discard",
+	[EMPTY_QUEUE]		= "empty queue",
+	[REL_WRITE]		= "reliable write",
+	[THRESHOLD]		= "max packed writes reached",
+};
+
+static int mmc_wr_pack_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_wr_pack_stats *stats = &card->wr_pack_stats;
+	struct mmc_wr_pack_stats snap;
+	int i;
+
+	spin_lock(&stats->lock);
+	memcpy(snap.packing_events, stats->packing_events,
+	       sizeof(snap.packing_events));
+	memcpy(snap.pack_stop_reason, stats->pack_stop_reason,
+	       sizeof(snap.pack_stop_reason));
+	spin_unlock(&stats->lock);
+
+	seq_printf(s, "max packed writes:\t%u\n",
+		   card->ext_csd.max_packed_writes);
+
+	seq_printf(s, "packing depth:\n");
+	for (i = 1; i <= MMC_PACKED_MAX_ENTRIES; i++)
+		if (snap.packing_events[i])
+			seq_printf(s, "%d:\t%u\n", i, snap.packing_events[i]);
+
+	seq_printf(s, "packing stopped by:\n");
+	for (i = 0; i < MAX_REASONS; i++)
+		seq_printf(s, "%s:\t%u\n", mmc_pack_stop_reasons[i],
+			   snap.pack_stop_reason[i]);
+
+	return 0;
+}
+
+static int mmc_wr_pack_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_wr_pack_stats_show, inode->i_private);
+}
+
+/* Any write clears the counters */
+static ssize_t mmc_wr_pack_stats_write(struct file *filp,
+				       const char __user *ubuf, size_t cnt,
+				       loff_t *ppos)
+{
+	struct seq_file *s = filp->private_data;
+	struct mmc_card *card = s->private;
+	struct mmc_wr_pack_stats *stats = &card->wr_pack_stats;
+
+	spin_lock(&stats->lock);
+	memset(stats->packing_events, 0, sizeof(stats->packing_events));
+	memset(stats->pack_stop_reason, 0, sizeof(stats->pack_stop_reason));
+	spin_unlock(&stats->lock);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_wr_pack_stats_fops = {
+	.open		= mmc_wr_pack_stats_open,
+	.read		= seq_read,
+	.write		= mmc_wr_pack_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_card_debugfs(struct mmc_card *card)
 {
 	struct mmc_host	*host = card->host;
@@ -316,6 +456,33 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					&mmc_dbg_ext_csd_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) && card->ext_csd.rev >= 5) {
+		if (!debugfs_create_file("bkops_stats", S_IRUSR, root, card,
+					&mmc_dbg_bkops_stats_fops))
+			goto err;
+
+		if (!debugfs_create_u32("bkops_delay_ms", S_IRUSR | S_IWUSR,
+					root, &card->bkops_info.delay_ms))
+			goto err;
+
+		if (card->ext_csd.bkops_en && card->ext_csd.hpi_en)
+			if (!debugfs_create_file("bkops", S_IWUSR, root, card,
+						&mmc_dbg_bkops_fops))
+				goto err;
+
+		if (card->ext_csd.cache_ctrl)
+			if (!debugfs_create_file("flush_cache", S_IWUSR, root,
+						card, &mmc_dbg_flush_cache_fops))
+				goto err;
+	}
+
+	if (mmc_card_mmc(card) && mmc_host_packed_wr(card->host) &&
+	    card->ext_csd.max_packed_writes)
+		if (!debugfs_create_file("wr_pack_stats", S_IRUSR | S_IWUSR,
+					root, card,
+					&mmc_dbg_wr_pack_stats_fops))
+			goto err;
+
 	return;
 
 err:
@@ -363,8 +363,9 @@ static ssize_t
 show_perf(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	struct mmc_host *host = dev_get_drvdata(dev);
-	int64_t rtime_mmcq, wtime_mmcq, rtime_drv, wtime_drv;
+	int64_t rtime_mmcq, wtime_mmcq, rtime_drv, wtime_drv, wait_time;
 	unsigned long rbytes_mmcq, wbytes_mmcq, rbytes_drv, wbytes_drv;
+	unsigned long nr_async, nr_overlap;
 
 	spin_lock(&host->lock);
 
@@ -378,6 +379,10 @@ show_perf(struct device *dev, struct device_attribute *attr, char *buf)
 	rtime_drv = ktime_to_us(host->perf.rtime_drv);
 	wtime_drv = ktime_to_us(host->perf.wtime_drv);
 
+	nr_async = host->perf.nr_async;
+	nr_overlap = host->perf.nr_overlap;
+	wait_time = ktime_to_us(host->perf.wait_time);
+
 	spin_unlock(&host->lock);
 
 	return snprintf(buf, PAGE_SIZE, "Write performance at MMCQ Level:"
@@ -387,10 +392,15 @@ show_perf(struct device *dev, struct device_attribute *attr, char *buf)
 					"Write performance at driver Level:"
 					"%lu bytes in %lld microseconds\n"
 					"Read performance at driver Level:"
-					"%lu bytes in %lld microseconds\n",
+					"%lu bytes in %lld microseconds\n"
+					"Async requests: %lu, prepared during "
+					"an active transfer: %lu\n"
+					"Blocked on active request: "
+					"%lld microseconds\n",
 					wbytes_mmcq, wtime_mmcq, rbytes_mmcq,
 					rtime_mmcq, wbytes_drv, wtime_drv,
-					rbytes_drv, rtime_drv);
+					rbytes_drv, rtime_drv, nr_async,
+					nr_overlap, wait_time);
 }
 
 static ssize_t
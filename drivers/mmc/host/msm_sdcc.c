@@ -437,6 +437,29 @@ msmsdcc_dma_exec_func(struct msm_dmov_cmd *cmd)
 	}
 }
 
+/*
+ * Buffers mapped ahead of time by msmsdcc_pre_req() stay mapped until
+ * msmsdcc_post_req(), so the transfer paths must not map or unmap them.
+ */
+static int msmsdcc_map_sg(struct msmsdcc_host *host, struct mmc_data *data,
+			  enum dma_data_direction dir)
+{
+	if (data->host_cookie)
+		return data->sg_len;
+
+	return dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len, dir);
+}
+
+static void msmsdcc_unmap_sg(struct msmsdcc_host *host, struct mmc_data *data,
+			     struct scatterlist *sg, int nents,
+			     enum dma_data_direction dir)
+{
+	if (data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(host->mmc), sg, nents, dir);
+}
+
 static void
 msmsdcc_dma_complete_tlet(unsigned long data)
 {
@@ -473,8 +496,8 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	msmsdcc_unmap_sg(host, mrq->data, host->dma.sg, host->dma.num_ents,
+			 host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -640,7 +663,7 @@ static void msmsdcc_sps_complete_tlet(unsigned long data)
 	}
 
 	/* Unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
+	msmsdcc_unmap_sg(host, mrq->data, host->sps.sg, host->sps.num_ents,
 			 host->sps.dir);
 
 	host->sps.sg = NULL;
@@ -711,7 +734,7 @@ static void msmsdcc_sps_exit_curr_xfer(struct msmsdcc_host *host)
 		mrq->data->error = -EIO;
 
 	/* Unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
+	msmsdcc_unmap_sg(host, mrq->data, host->sps.sg, host->sps.num_ents,
 			 host->sps.dir);
 
 	host->sps.sg = NULL;
@@ -807,8 +830,7 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 	else
 		host->dma.dir = DMA_TO_DEVICE;
 
-	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
-			host->dma.num_ents, host->dma.dir);
+	n = msmsdcc_map_sg(host, data, host->dma.dir);
 
 	if (n != host->dma.num_ents) {
 		pr_err("%s: Unable to map in all sg elements\n",
@@ -884,8 +906,8 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 
 unmap:
 	if (err) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
-				host->dma.num_ents, host->dma.dir);
+		msmsdcc_unmap_sg(host, data, host->dma.sg,
+				 host->dma.num_ents, host->dma.dir);
 		pr_err("%s: cannot do DMA, fall back to PIO mode err=%d\n",
 				mmc_hostname(host->mmc), err);
 	}
@@ -931,8 +953,7 @@ static int msmsdcc_sps_start_xfer(struct msmsdcc_host *host,
 	}
 
 	/* Make sg buffers DMA ready */
-	rc = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-			host->sps.dir);
+	rc = msmsdcc_map_sg(host, data, host->sps.dir);
 
 	if (rc != data->sg_len) {
 		pr_err("%s: Unable to map in all sg elements, rc=%d\n",
@@ -984,8 +1005,8 @@ static int msmsdcc_sps_start_xfer(struct msmsdcc_host *host,
 
 dma_map_err:
 	/* unmap sg buffers */
-	dma_unmap_sg(mmc_dev(host->mmc), host->sps.sg, host->sps.num_ents,
-			host->sps.dir);
+	msmsdcc_unmap_sg(host, data, host->sps.sg, host->sps.num_ents,
+			 host->sps.dir);
 out:
 	return rc;
 }
@@ -1112,6 +1133,14 @@ msmsdcc_start_data(struct msmsdcc_host *host, struct mmc_data *data,
 
 	/* Is data transfer in PIO mode required? */
 	if (!(datactrl & MCI_DPSM_DMAENABLE)) {
+		/* Drop a mapping made by pre_req before the CPU touches data */
+		if (data->host_cookie) {
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+				     (data->flags & MMC_DATA_READ) ?
+				     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+			data->host_cookie = 0;
+		}
+
 		if (data->flags & MMC_DATA_READ) {
 			pio_irqmask = MCI_RXFIFOHALFFULLMASK;
 			if (host->curr.xfer_remain < MCI_FIFOSIZE)
@@ -1831,6 +1860,50 @@ msmsdcc_request_start(struct msmsdcc_host *host, struct mmc_request *mrq)
 	}
 }
 
+/*
+ * Map the data buffers of the next request for DMA while the current
+ * request is still being transferred.
+ */
+static void
+msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	enum dma_data_direction dir;
+
+	if (!data || data->host_cookie)
+		return;
+
+	if (!msmsdcc_is_dma_possible(host, data))
+		return;
+
+	if (data->sg_len > msmsdcc_get_nr_sg(host))
+		return;
+
+	dir = (data->flags & MMC_DATA_READ) ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	/* On failure the request is mapped as usual when it is started */
+	if (dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len, dir) !=
+	    data->sg_len)
+		return;
+
+	data->host_cookie = 1;
+}
+
+static void
+msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq, int err)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     (data->flags & MMC_DATA_READ) ?
+		     DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	data->host_cookie = 0;
+}
+
 static void
 msmsdcc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 {
@@ -3384,6 +3457,8 @@ exit:
 static const struct mmc_host_ops msmsdcc_ops = {
 	.enable		= msmsdcc_enable,
 	.disable	= msmsdcc_disable,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
@@ -4492,8 +4567,11 @@ msmsdcc_probe(struct platform_device *pdev)
 	 * status is to use the AUTO_PROG_DONE status provided by SDCC4
 	 * controller. So let's enable the CMD23 for SDCC4 only.
 	 */
-	if (!plat->disable_cmd23 && host->sdcc_version)
+	if (!plat->disable_cmd23 && host->sdcc_version) {
 		mmc->caps |= MMC_CAP_CMD23;
+		/* Packed writes are framed by CMD23 */
+		mmc->caps2 |= MMC_CAP2_PACKED_WR;
+	}
 
 	mmc->caps |= plat->uhs_caps;
 	/*
@@ -4506,6 +4584,7 @@ msmsdcc_probe(struct platform_device *pdev)
 				MMC_CAP_SET_XPC_180);
 
 	mmc->caps2 |= MMC_CAP2_BOOTPART_NOACC;
+	mmc->caps2 |= MMC_CAP2_CACHE_CTRL | MMC_CAP2_BKOPS;
 
 	if (plat->nonremovable)
 		mmc->caps |= MMC_CAP_NONREMOVABLE;
@@ -37,8 +37,9 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
+static DEFINE_MUTEX(binder_procs_lock);
 
 static HLIST_HEAD(binder_procs);
 static HLIST_HEAD(binder_deferred_list);
@@ -154,6 +155,31 @@ struct binder_stats {
 };
 
 static struct binder_stats binder_stats;
+static unsigned long binder_lock_contended;
+
+/*
+ * binder_main_lock protects the node/ref/transaction graph and the todo
+ * lists. The list of open procs has its own binder_procs_lock, which nests
+ * inside binder_main_lock, so that open and the debugfs walkers do not
+ * need to take the main lock just to add or find a proc.
+ *
+ * binder_transaction() drops binder_main_lock while it copies the payload
+ * from the sender. It holds the target proc with tmp_ref meanwhile: a proc
+ * released while tmp_ref is raised is marked is_dead and freed by
+ * whoever drops the last tmp_ref.
+ */
+static inline void binder_lock(void)
+{
+	if (!mutex_trylock(&binder_main_lock)) {
+		mutex_lock(&binder_main_lock);
+		binder_lock_contended++;
+	}
+}
+
+static inline void binder_unlock(void)
+{
+	mutex_unlock(&binder_main_lock);
+}
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
@@ -274,6 +300,12 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+struct binder_lru_page {
+	struct list_head lru;
+	struct page *page_ptr;
+	struct binder_proc *proc;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -300,7 +332,7 @@ struct binder_proc {
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -313,6 +345,11 @@ struct binder_proc {
 	int ready_threads;
 	long default_priority;
 	struct dentry *debugfs_entry;
+	unsigned long pages_mapped;
+	unsigned long pages_unmapped;
+	unsigned long pages_reused;
+	int tmp_ref;
+	bool is_dead;
 };
 
 enum {
@@ -360,6 +397,7 @@ struct binder_transaction {
 
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
+static void binder_deferred_free_proc(struct binder_proc *proc);
 
 /*
  * copied from get_unused_fd_flags
@@ -608,6 +646,33 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+/*
+ * Pages of a proc's transaction area are not unmapped when the buffers
+ * using them are freed. They stay mapped in the kernel and in the proc's
+ * vma and are parked on binder_lru instead, so the next transaction that
+ * lands on them skips alloc_page, map_vm_area and vm_insert_page. The
+ * shrinker hands them back to the system under memory pressure. The lru
+ * is protected by binder_main_lock.
+ */
+static LIST_HEAD(binder_lru);
+static int binder_lru_count;
+
+static void binder_lru_add(struct binder_lru_page *page)
+{
+	if (list_empty(&page->lru)) {
+		list_add_tail(&page->lru, &binder_lru);
+		binder_lru_count++;
+	}
+}
+
+static void binder_lru_del(struct binder_lru_page *page)
+{
+	if (!list_empty(&page->lru)) {
+		list_del_init(&page->lru);
+		binder_lru_count--;
+	}
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -615,8 +680,9 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
-	struct page **page;
+	struct binder_lru_page *page;
 	struct mm_struct *mm;
+	int need_map = 0;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -625,6 +691,20 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0)
+		goto free_range;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (page->page_ptr) {
+			binder_lru_del(page);
+			proc->pages_reused++;
+		} else
+			need_map = 1;
+	}
+	if (!need_map)
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -635,9 +715,6 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
 		       "binder: %d: binder_alloc_buf failed to "
@@ -650,17 +727,20 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
+		if (page->page_ptr)
+			continue;
+		page->page_ptr = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (page->page_ptr == NULL) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
+		page->proc = proc;
+		INIT_LIST_HEAD(&page->lru);
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
+		page_array_ptr = &page->page_ptr;
 		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -671,7 +751,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = vm_insert_page(vma, user_page_addr, page->page_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
@@ -679,6 +759,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			       proc->pid, user_page_addr);
 			goto err_vm_insert_page_failed;
 		}
+		proc->pages_mapped++;
 		/* vm_insert_page does not seem to increment the refcount */
 	}
 	if (mm) {
@@ -687,29 +768,89 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
 err_alloc_page_failed:
-		;
-	}
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+	/* whatever did get mapped stays cached for the next allocation */
+	allocate = -ENOMEM;
+
+free_range:
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (page->page_ptr)
+			binder_lru_add(page);
+	}
+	return allocate < 0 ? allocate : 0;
 }
 
+/*
+ * Unmap and free a page taken off binder_lru. Called with binder_main_lock
+ * held. Returns -EAGAIN, with the page back on the lru, if the owner's
+ * mmap_sem is contended.
+ */
+static int binder_free_lru_page(struct binder_lru_page *page)
+{
+	struct binder_proc *proc = page->proc;
+	void *page_addr = proc->buffer + (page - proc->pages) * PAGE_SIZE;
+	struct mm_struct *mm;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm) {
+		if (!down_write_trylock(&mm->mmap_sem)) {
+			mmput(mm);
+			binder_lru_add(page);
+			return -EAGAIN;
+		}
+		if (proc->vma)
+			zap_page_range(proc->vma, (uintptr_t)page_addr +
+				proc->user_buffer_offset, PAGE_SIZE, NULL);
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
+	proc->pages_unmapped++;
+	return 0;
+}
+
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct binder_lru_page *page;
+	int nr_to_scan = sc->nr_to_scan;
+
+	if (!nr_to_scan)
+		return binder_lru_count;
+
+	/* binder_update_page_range may have got us here through alloc_page */
+	if (!mutex_trylock(&binder_main_lock))
+		return -1;
+
+	while (nr_to_scan-- > 0 && !list_empty(&binder_lru)) {
+		page = list_first_entry(&binder_lru, struct binder_lru_page,
+					lru);
+		binder_lru_del(page);
+		if (binder_free_lru_page(page))
+			break;
+	}
+	binder_unlock();
+
+	return binder_lru_count;
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
 					      size_t offsets_size, int is_async)
@@ -1311,6 +1452,21 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 	}
 }
 
+/*
+ * Drop a reference taken with tmp_ref++ to keep a proc around while
+ * binder_main_lock was dropped. Returns true if the proc was released in
+ * the meantime; the last reference then frees it.
+ */
+static bool binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	proc->tmp_ref--;
+	if (!proc->is_dead)
+		return false;
+	if (!proc->tmp_ref)
+		binder_deferred_free_proc(proc);
+	return true;
+}
+
 static void binder_transaction_buffer_release(struct binder_proc *proc,
 					      struct binder_buffer *buffer,
 					      size_t *failed_at)
@@ -1408,10 +1564,16 @@ static void binder_transaction(struct binder_proc *proc,
 	struct list_head *target_list;
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
-	struct binder_transaction_log_entry *e;
+	struct binder_transaction_log_entry log_entry, *e = &log_entry;
+	const char *copy_failed = NULL;
 	uint32_t return_error;
 
-	e = binder_transaction_log_add(&binder_transaction_log);
+	/*
+	 * binder_main_lock is dropped for the payload copy, and a slot in
+	 * the ring may be reused meanwhile, so build the entry here and
+	 * add it to the log once the outcome is known.
+	 */
+	memset(e, 0, sizeof(*e));
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
 	e->from_proc = proc->pid;
 	e->from_thread = thread->pid;
@@ -1508,14 +1670,6 @@ static void binder_transaction(struct binder_proc *proc,
 			}
 		}
 	}
-	if (target_thread) {
-		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
@@ -1578,15 +1732,64 @@ static void binder_transaction(struct binder_proc *proc,
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
+	/*
+	 * Copy the payload without binder_main_lock, so that a large or
+	 * faulting copy does not hold up every other binder user. Nobody
+	 * else can reach the new buffer until it is queued, and tmp_ref
+	 * keeps the target's buffer area mapped if the target is released
+	 * in the meantime. Everything else is looked up again afterwards.
+	 */
+	target_proc->tmp_ref++;
+	binder_unlock();
+	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size))
+		copy_failed = "data";
+	else if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size))
+		copy_failed = "offsets";
+	binder_lock();
+
+	if (binder_proc_dec_tmpref(target_proc)) {
+		/* The release freed t->buffer, and maybe target_node */
+		return_error = BR_DEAD_REPLY;
+		goto err_target_released;
 	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+	if (reply) {
+		target_thread = in_reply_to->from;
+		if (target_thread == NULL) {
+			return_error = BR_DEAD_REPLY;
+			goto err_copy_data_failed;
+		}
+		if (target_thread->transaction_stack != in_reply_to) {
+			binder_user_error("binder: %d:%d reply target %d:%d "
+				"started another transaction\n",
+				proc->pid, thread->pid,
+				target_proc->pid, target_thread->pid);
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			goto err_copy_data_failed;
+		}
+	} else if (target_thread) {
+		struct binder_transaction *tmp;
+
+		/* It may have exited, pick again */
+		target_thread = NULL;
+		for (tmp = thread->transaction_stack; tmp;
+		     tmp = tmp->from_parent)
+			if (tmp->from && tmp->from->proc == target_proc)
+				target_thread = tmp->from;
+		t->to_thread = target_thread;
+	}
+	if (target_thread) {
+		e->to_thread = target_thread->pid;
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
+	}
+
+	if (copy_failed) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
+			"%s ptr\n", proc->pid, thread->pid, copy_failed);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
@@ -1780,6 +1983,7 @@ static void binder_transaction(struct binder_proc *proc,
 	list_add_tail(&tcomplete->entry, &thread->todo);
 	if (target_wait)
 		wake_up_interruptible(target_wait);
+	*binder_transaction_log_add(&binder_transaction_log) = *e;
 	return;
 
 err_get_unused_fd_failed:
@@ -1794,6 +1998,7 @@ err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
+err_target_released:
 err_binder_alloc_buf_failed:
 	kfree(tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
@@ -1811,6 +2016,7 @@ err_no_context_mgr_node:
 		     proc->pid, thread->pid, return_error,
 		     tr->data_size, tr->offsets_size);
 
+	*binder_transaction_log_add(&binder_transaction_log) = *e;
 	{
 		struct binder_transaction_log_entry *fe;
 		fe = binder_transaction_log_add(&binder_transaction_log_failed);
@@ -2287,7 +2493,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2311,7 +2517,7 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock();
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2653,12 +2859,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2692,7 +2898,15 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	if (cmd == BINDER_VERSION) {
+		if (size != sizeof(struct binder_version))
+			return -EINVAL;
+		if (put_user(BINDER_CURRENT_PROTOCOL_VERSION, &((struct binder_version *)ubuf)->protocol_version))
+			return -EINVAL;
+		return 0;
+	}
+
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2786,16 +3000,6 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		binder_free_thread(proc, thread);
 		thread = NULL;
 		break;
-	case BINDER_VERSION:
-		if (size != sizeof(struct binder_version)) {
-			ret = -EINVAL;
-			goto err;
-		}
-		if (put_user(BINDER_CURRENT_PROTOCOL_VERSION, &((struct binder_version *)ubuf)->protocol_version)) {
-			ret = -EINVAL;
-			goto err;
-		}
-		break;
 	default:
 		ret = -EINVAL;
 		goto err;
@@ -2804,7 +3008,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -2951,13 +3155,14 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
-	binder_stats_created(BINDER_STAT_PROC);
-	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+
+	mutex_lock(&binder_procs_lock);
+	binder_stats_created(BINDER_STAT_PROC);
+	hlist_add_head(&proc->proc_node, &binder_procs);
+	mutex_unlock(&binder_procs_lock);
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -3011,12 +3216,18 @@ static void binder_deferred_release(struct binder_proc *proc)
 	struct hlist_node *pos;
 	struct binder_transaction *t;
 	struct rb_node *n;
-	int threads, nodes, incoming_refs, outgoing_refs, buffers, active_transactions, page_count;
+	int threads, nodes, incoming_refs, outgoing_refs, buffers, active_transactions;
 
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	proc->is_dead = true;
+
+	mutex_lock(&binder_procs_lock);
 	hlist_del(&proc->proc_node);
+	binder_stats_deleted(BINDER_STAT_PROC);
+	mutex_unlock(&binder_procs_lock);
+
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder_release: %d context_mgr_node gone\n",
@@ -3096,13 +3307,36 @@ static void binder_deferred_release(struct binder_proc *proc)
 		buffers++;
 	}
 
-	binder_stats_deleted(BINDER_STAT_PROC);
+	if (proc->pages) {
+		int i;
+		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+			if (proc->pages[i].page_ptr)
+				binder_lru_del(&proc->pages[i]);
+		}
+	}
+
+	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
+		     "binder_release: %d threads %d, nodes %d (ref %d), "
+		     "refs %d, active transactions %d, buffers %d\n",
+		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
+		     active_transactions, buffers);
+}
+
+/*
+ * Called after binder_deferred_release() once binder_main_lock has been
+ * dropped. Nothing can reach the proc any more, so unmapping and freeing a
+ * large transaction area does not stall unrelated binder users. If a
+ * transaction held tmp_ref across the release, it is instead called from
+ * binder_proc_dec_tmpref() with the lock held.
+ */
+static void binder_deferred_free_proc(struct binder_proc *proc)
+{
+	int page_count = 0;
 
-	page_count = 0;
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
+			if (proc->pages[i].page_ptr) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
 				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 					     "binder_release: %d: "
@@ -3111,7 +3345,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 					     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
-				__free_page(proc->pages[i]);
+				__free_page(proc->pages[i].page_ptr);
 				page_count++;
 			}
 		}
@@ -3122,11 +3356,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	put_task_struct(proc->tsk);
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
-		     "binder_release: %d threads %d, nodes %d (ref %d), "
-		     "refs %d, active transactions %d, buffers %d, "
-		     "pages %d\n",
-		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
-		     active_transactions, buffers, page_count);
+		     "binder_release: %d pages %d\n", proc->pid, page_count);
 
 	kfree(proc);
 }
@@ -3134,11 +3364,12 @@ static void binder_deferred_release(struct binder_proc *proc)
 static void binder_deferred_func(struct work_struct *work)
 {
 	struct binder_proc *proc;
+	struct binder_proc *released;
 	struct files_struct *files;
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3162,12 +3393,19 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
-		if (defer & BINDER_DEFERRED_RELEASE)
-			binder_deferred_release(proc); /* frees proc */
+		released = NULL;
+		if (defer & BINDER_DEFERRED_RELEASE) {
+			binder_deferred_release(proc);
+			/* else the last tmp_ref holder frees it */
+			if (!proc->tmp_ref)
+				released = proc;
+		}
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
+		if (released)
+			binder_deferred_free_proc(released); /* frees proc */
 	} while (proc);
 }
 static DECLARE_WORK(binder_deferred_work, binder_deferred_func);
@@ -3481,6 +3719,9 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  pages mapped: %lu unmapped: %lu reused: %lu\n",
+		   proc->pages_mapped, proc->pages_unmapped,
+		   proc->pages_reused);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3505,8 +3746,10 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	struct binder_node *node;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		binder_lock();
+		mutex_lock(&binder_procs_lock);
+	}
 
 	seq_puts(m, "binder state:\n");
 
@@ -3517,8 +3760,10 @@ static int binder_state_show(struct seq_file *m, void *unused)
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		binder_unlock();
+	}
 	return 0;
 }
 
@@ -3528,17 +3773,23 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	struct hlist_node *pos;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		binder_lock();
+		mutex_lock(&binder_procs_lock);
+	}
 
 	seq_puts(m, "binder stats:\n");
 
+	seq_printf(m, "lock contended: %lu\n", binder_lock_contended);
+	seq_printf(m, "lru pages: %d\n", binder_lru_count);
 	print_binder_stats(m, "", &binder_stats);
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		binder_unlock();
+	}
 	return 0;
 }
 
@@ -3548,14 +3799,18 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	struct hlist_node *pos;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		binder_lock();
+		mutex_lock(&binder_procs_lock);
+	}
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	if (do_lock) {
+		mutex_unlock(&binder_procs_lock);
+		binder_unlock();
+	}
 	return 0;
 }
 
@@ -3565,11 +3820,11 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3632,6 +3887,8 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	if (!ret)
+		register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -36,17 +36,20 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Positions in the log are free-running sequence numbers; logger_offset()
+ * turns them into buffer offsets. Writers are serialized by 'mutex'. Readers
+ * never take it: they copy an entry out and then check that 'head' has not
+ * moved past it, retrying from 'head' if a writer lapped them meanwhile.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct mutex		mutex;	/* mutex serializing writers */
+	size_t			w_off;	/* sequence number of the write head */
+	size_t			head;	/* sequence number of the oldest entry */
 	size_t			size;	/* size of the log */
     struct logger_log_info  *log_info;
 };
@@ -55,17 +58,29 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by 'mutex', which only
+ * serializes readers sharing this file.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* mutex protecting r_off */
+	size_t			r_off;	/* sequence number of the read head */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/*
+ * logger_lapped - has the writer overwritten the entry at sequence 'seq'?
+ *
+ * Pairs with the smp_wmb() in fix_up_head().
+ */
+static inline int logger_lapped(struct logger_log *log, size_t seq)
+{
+	smp_rmb();
+	return (long)(seq - ACCESS_ONCE(log->head)) < 0;
+}
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -93,7 +108,8 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Unless the caller holds log->mutex, the result is only meaningful once
+ * logger_lapped() has confirmed the entry was not overwritten.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -112,15 +128,11 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
- *
- * Caller must hold log->mutex.
+ * do_read_log_to_user - reads exactly 'count' bytes from offset 'off' of
+ * 'log' into the user-space buffer 'buf'. Returns 'count' on success.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static ssize_t do_read_log_to_user(struct logger_log *log, size_t off,
+				   char __user *buf, size_t count)
 {
 	size_t len;
 
@@ -129,8 +141,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the current read head offset up to 'count' bytes or to the end of
 	 * the log, whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
+	len = min(count, log->size - off);
+	if (copy_to_user(buf, log->buffer + off, len))
 		return -EFAULT;
 
 	/*
@@ -141,40 +153,83 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off + count);
-
 	return count;
 }
 
 /*
- * logger_read - our log's read() method
+ * logger_readable - is there anything for 'reader' to read? Pulls a lapped
+ * reader forward to the oldest entry still in the log.
  *
- * Behavior:
+ * Caller must hold reader->mutex.
+ */
+static int logger_readable(struct logger_log *log,
+			   struct logger_reader *reader)
+{
+	if (logger_lapped(log, reader->r_off))
+		reader->r_off = ACCESS_ONCE(log->head);
+	return ACCESS_ONCE(log->w_off) != reader->r_off;
+}
+
+/*
+ * logger_read_entry - copy the next entry to 'buf' and advance the reader.
  *
- * 	- O_NONBLOCK works
- * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * Returns the entry length, 0 if the log is empty, -EINVAL if 'count' is
+ * too small for the entry, -EFAULT, or -EIO if the log is corrupt.
  *
- * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
- * buffer is insufficient to hold next entry.
+ * Caller must hold reader->mutex.
  */
-static ssize_t logger_read(struct file *file, char __user *buf,
-			   size_t count, loff_t *pos)
+static ssize_t logger_read_entry(struct logger_log *log,
+				 struct logger_reader *reader,
+				 char __user *buf, size_t count)
 {
-	struct logger_reader *reader = file->private_data;
-	struct logger_log *log = reader->log;
+	size_t r, len;
 	ssize_t ret;
+
+	while (logger_readable(log, reader)) {
+		/* pairs with the smp_wmb() before w_off is published */
+		smp_rmb();
+		r = reader->r_off;
+		len = get_entry_len(log, logger_offset(r));
+		if (unlikely(len > LOGGER_ENTRY_MAX_LEN))
+			ret = -EIO;
+		else if (count < len)
+			ret = -EINVAL;
+		else
+			ret = do_read_log_to_user(log, logger_offset(r),
+						  buf, len);
+
+		/* a torn entry is discarded and we retry from the new head */
+		if (logger_lapped(log, r))
+			continue;
+		if (ret > 0)
+			reader->r_off = r + ret;
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * logger_wait - wait until 'reader' has something to read.
+ *
+ * Returns 0 when there is, -EAGAIN or -EINTR otherwise.
+ */
+static int logger_wait(struct file *file, struct logger_reader *reader)
+{
+	struct logger_log *log = reader->log;
+	int ret;
 	DEFINE_WAIT(wait);
 
-start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
-		if (!ret)
+		mutex_lock(&reader->mutex);
+		ret = logger_readable(log, reader);
+		mutex_unlock(&reader->mutex);
+		if (ret) {
+			ret = 0;
 			break;
+		}
 
 		if (file->f_flags & O_NONBLOCK) {
 			ret = -EAGAIN;
@@ -190,138 +245,148 @@ start:
 	}
 
 	finish_wait(&log->wq, &wait);
-	if (ret)
-		return ret;
-
-	mutex_lock(&log->mutex);
-
-	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
-		goto start;
-	}
-
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
-
-out:
-	mutex_unlock(&log->mutex);
-
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * logger_read - our log's read() method
+ *
+ * Behavior:
+ *
+ * 	- O_NONBLOCK works
+ * 	- If there are no log entries to read, blocks until log is written to
+ * 	- Atomically reads exactly one log entry
  *
- * Caller must hold log->mutex.
+ * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
+ * buffer is insufficient to hold next entry.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static ssize_t logger_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *pos)
 {
-	size_t count = 0;
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log = reader->log;
+	ssize_t ret;
 
 	do {
-		size_t nr = get_entry_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+		ret = logger_wait(file, reader);
+		if (ret)
+			return ret;
 
-	return off;
+		mutex_lock(&reader->mutex);
+		ret = logger_read_entry(log, reader, buf, count);
+		mutex_unlock(&reader->mutex);
+		/* if we raced with another reader of this file, wait again */
+	} while (ret == 0);
+
+	return ret;
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * logger_read_batch - the LOGGER_READ_BATCH ioctl
+ *
+ * Like read(), but copies as many whole entries as fit in the buffer
+ * instead of exactly one. Returns the number of bytes copied.
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
+static long logger_read_batch(struct file *file, void __user *arg)
 {
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log = reader->log;
+	struct logger_batch batch;
+	size_t done = 0;
+	ssize_t ret;
 
-	return 0;
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	if (!batch.len)
+		return -EINVAL;
+
+	do {
+		ret = logger_wait(file, reader);
+		if (ret)
+			return ret;
+
+		mutex_lock(&reader->mutex);
+		while (done < batch.len) {
+			ret = logger_read_entry(log, reader, batch.buf + done,
+						batch.len - done);
+			if (ret <= 0)
+				break;
+			done += ret;
+		}
+		mutex_unlock(&reader->mutex);
+	} while (ret == 0 && done == 0);
+
+	/* a short buffer only fails the call if nothing fit at all */
+	if (done)
+		return done;
+	return ret;
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * fix_up_head - pull the start head forward to the first entry that will
+ * survive a write of 'len' bytes. Readers behind the new head notice that
+ * they were lapped the next time they read; they are not walked here.
  *
  * The caller needs to hold log->mutex.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void fix_up_head(struct logger_log *log, size_t len)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
+	size_t head = log->head;
+	size_t end = log->w_off + len;
 
-	if (clock_interval(old, new, log->head))
-	{
-		log->head = get_next_entry(log, log->head, len);
-		log->log_info->head = log->head;
-	}
+	if (end - head < log->size)
+		return;
+
+	do {
+		head += get_entry_len(log, logger_offset(head));
+	} while (end - head >= log->size);
 
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	log->head = head;
+	log->log_info->head = logger_offset(head);
+	/* readers must see the new head before the data is overwritten */
+	smp_wmb();
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'len' bytes from 'buf' to 'log' at sequence 'w'
  *
  * The caller needs to hold log->mutex.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t w, const void *buf,
+			 size_t count)
 {
+	size_t off = logger_offset(w);
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-	log->log_info->w_off = log->w_off;
-
 }
 
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * the log 'log' at sequence 'w'
  *
  * The caller needs to hold log->mutex.
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t w,
 				      const void __user *buf, size_t count)
 {
+	size_t off = logger_offset(w);
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-	log->log_info->w_off = log->w_off;
-
 	return count;
 }
 
@@ -334,10 +399,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
 	ssize_t ret = 0;
+	size_t w;
 
 	now = current_kernel_time();
 
@@ -354,14 +419,16 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	mutex_lock(&log->mutex);
 
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Pull the head forward to the first readable entry after (what will
+	 * be) the new write offset. We do this now because if we partially
+	 * fail, we can end up with clobbered log entries that encroach on
+	 * readable buffer.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	fix_up_head(log, sizeof(struct logger_entry) + header.len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	w = log->w_off;
+	do_write_log(log, w, &header, sizeof(struct logger_entry));
+	w += sizeof(struct logger_entry);
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -371,18 +438,22 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, w, iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			log->log_info->w_off = log->w_off;
 			mutex_unlock(&log->mutex);
 			return nr;
 		}
 
 		iov++;
+		w += nr;
 		ret += nr;
 	}
 
+	/* the entry only becomes visible to readers once it is complete */
+	smp_wmb();
+	log->w_off = w;
+	log->log_info->w_off = logger_offset(w);
+
 	mutex_unlock(&log->mutex);
 
 	/* wake up any blocked readers */
@@ -419,12 +490,8 @@ static int logger_open(struct inode *inode, struct file *file)
 			return -ENOMEM;
 
 		reader->log = log;
-		INIT_LIST_HEAD(&reader->list);
-
-		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		mutex_init(&reader->mutex);
+		reader->r_off = ACCESS_ONCE(log->head);
 
 		file->private_data = reader;
 	} else
@@ -442,7 +509,6 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		list_del(&reader->list);
 		kfree(reader);
 	}
 
@@ -472,10 +538,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	mutex_lock(&reader->mutex);
+	if (logger_readable(log, reader))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -486,8 +552,6 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
-
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
@@ -498,10 +562,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		mutex_lock(&reader->mutex);
+		logger_readable(log, reader);
+		ret = ACCESS_ONCE(log->w_off) - reader->r_off;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -509,26 +573,38 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
-			ret = get_entry_len(log, reader->r_off);
-		else
+		mutex_lock(&reader->mutex);
+		ret = 0;
+		while (logger_readable(log, reader)) {
+			smp_rmb();
+			ret = get_entry_len(log, logger_offset(reader->r_off));
+			if (!logger_lapped(log, reader->r_off))
+				break;
 			ret = 0;
+		}
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
+		/* every reader is now behind the head and skips to it */
+		mutex_lock(&log->mutex);
 		log->head = log->w_off;
-		log->log_info->head = log->head;
+		log->log_info->head = logger_offset(log->head);
+		mutex_unlock(&log->mutex);
 		ret = 0;
 		break;
+	case LOGGER_READ_BATCH:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		ret = logger_read_batch(file, (void __user *)arg);
+		break;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	return ret;
 }
 
@@ -560,7 +636,6 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
 	.w_off = 0, \
 	.head = 0, \
@@ -50,6 +50,16 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_READ_BATCH		_IOWR(__LOGGERIO, 5, struct logger_batch)
+
+/*
+ * struct logger_batch - argument to LOGGER_READ_BATCH, which copies as many
+ * whole entries as fit in 'len' bytes at 'buf'
+ */
+struct logger_batch {
+	char __user	*buf;
+	size_t		len;
+};
 
 /*****************************************************************************************/
 /* Refer from kcjlogger.c to this definition. Be careful when you change.                */
@@ -91,7 +101,6 @@ static struct logger_log VAR = { \
                 .parent = NULL, \
         }, \
         .wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-        .readers = LIST_HEAD_INIT(VAR .readers), \
         .mutex = __MUTEX_INITIALIZER(VAR .mutex), \
         .w_off = 0, \
         .head = 0, \
@@ -37,6 +37,10 @@
 #include <linux/notifier.h>
 #include <linux/memory.h>
 #include <linux/memory_hotplug.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -108,12 +112,141 @@ static int lmk_hotplug_callback(struct notifier_block *self,
 
 
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+/*
+ * lowmem_consider - is 'p' a better victim than the current selection?
+ * Updates the selection if so.
+ */
+static void lowmem_consider(struct task_struct *p, int min_adj,
+			    struct task_struct **selected,
+			    int *selected_tasksize, int *selected_oom_adj)
 {
+	struct mm_struct *mm;
+	struct signal_struct *sig;
+	int oom_adj;
+	int tasksize;
+
+	task_lock(p);
+	mm = p->mm;
+	sig = p->signal;
+	if (!mm || !sig) {
+		task_unlock(p);
+		return;
+	}
+	oom_adj = sig->oom_adj;
+	if (oom_adj < min_adj) {
+		task_unlock(p);
+		return;
+	}
+	tasksize = get_mm_rss(mm);
+	task_unlock(p);
+	if (tasksize <= 0)
+		return;
+	if (*selected) {
+		if (oom_adj < *selected_oom_adj)
+			return;
+		if (oom_adj == *selected_oom_adj &&
+		    tasksize <= *selected_tasksize)
+			return;
+	}
+	*selected = p;
+	*selected_tasksize = tasksize;
+	*selected_oom_adj = oom_adj;
+	lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+		     p->pid, p->comm, oom_adj, tasksize);
+}
+
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+#define LOWMEM_BATCH	32
+
+/*
+ * lowmem_select - pick the process to kill. Buckets are visited from the
+ * highest oom_adj down and the walk stops at the first bucket holding a
+ * candidate, so only processes we might actually kill are looked at.
+ *
+ * oom_adj_bucket_lock nests inside task_lock() and siglock elsewhere, so
+ * it must not be held across lowmem_consider(). Candidates are taken off
+ * a bucket in batches with a reference held and looked at once the lock
+ * is dropped. A process that changes bucket in between may be missed or
+ * looked at twice, which only matters for that one pass.
+ *
+ * Returns the victim with a reference held, or NULL.
+ */
+static struct task_struct *lowmem_select(int min_adj, int *selected_tasksize,
+					 int *selected_oom_adj)
+{
+	struct task_struct *batch[LOWMEM_BATCH];
+	struct task_struct *selected = NULL;
+	struct task_struct *prev;
 	struct task_struct *p;
+	struct hlist_node *pos;
+	unsigned long flags;
+	int adj, skip, seen, n, i;
+	bool more;
+
+	for (adj = OOM_ADJUST_MAX; adj >= max(min_adj, OOM_DISABLE); adj--) {
+		skip = 0;
+		do {
+			n = 0;
+			seen = 0;
+			more = false;
+			spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+			hlist_for_each_entry(p, pos,
+					     &oom_adj_buckets[adj - OOM_DISABLE],
+					     oom_adj_node) {
+				if (seen++ < skip)
+					continue;
+				if (n == LOWMEM_BATCH) {
+					more = true;
+					break;
+				}
+				get_task_struct(p);
+				batch[n++] = p;
+			}
+			spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+			skip += n;
+
+			prev = selected;
+			for (i = 0; i < n; i++)
+				lowmem_consider(batch[i], min_adj, &selected,
+						selected_tasksize,
+						selected_oom_adj);
+			if (selected != prev) {
+				get_task_struct(selected);
+				if (prev)
+					put_task_struct(prev);
+			}
+			for (i = 0; i < n; i++)
+				put_task_struct(batch[i]);
+		} while (more);
+		if (selected)
+			break;
+	}
+
+	return selected;
+}
+#else
+static struct task_struct *lowmem_select(int min_adj, int *selected_tasksize,
+					 int *selected_oom_adj)
+{
 	struct task_struct *selected = NULL;
+	struct task_struct *p;
+
+	read_lock(&tasklist_lock);
+	for_each_process(p)
+		lowmem_consider(p, min_adj, &selected,
+				selected_tasksize, selected_oom_adj);
+	if (selected)
+		get_task_struct(selected);
+	read_unlock(&tasklist_lock);
+
+	return selected;
+}
+#endif
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct task_struct *selected;
 	int rem = 0;
-	int tasksize;
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
@@ -123,6 +256,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int other_file = global_page_state(NR_FILE_PAGES) -
 						global_page_state(NR_SHMEM);
 	struct zone *zone;
+	ktime_t start;
 
 	if (offlining) {
 		/* Discount all free space in the section being offlined */
@@ -173,53 +307,24 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-	}
+	start = ktime_get();
+	selected = lowmem_select(min_adj, &selected_tasksize,
+				 &selected_oom_adj);
+	trace_lowmem_select(selected, min_adj, selected_oom_adj,
+			    selected_tasksize,
+			    ktime_to_ns(ktime_sub(ktime_get(), start)));
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
 			     selected_oom_adj, selected_tasksize);
 		lowmem_deathpending = selected;
 		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
+		send_sig(SIGKILL, selected, 0);
+		put_task_struct(selected);
 		rem -= selected_tasksize;
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
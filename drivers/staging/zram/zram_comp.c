@@ -0,0 +1,156 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/kernel.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/lzo.h>
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+#include <linux/lz4.h>
+#endif
+
+#include "zram_comp.h"
+
+static int zram_lzo_compress(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem)
+{
+	int ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, workmem);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zram_lzo_decompress(const unsigned char *src, size_t src_len,
+			unsigned char *dst)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static const struct zram_backend zram_lzo = {
+	.name		= "lzo",
+	.workmem_size	= LZO1X_MEM_COMPRESS,
+	.compress	= zram_lzo_compress,
+	.decompress	= zram_lzo_decompress,
+};
+
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+static int zram_lz4_compress(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem)
+{
+	int ret = lz4_compress(src, PAGE_SIZE, dst, dst_len, workmem);
+
+	return ret == LZ4_E_OK ? 0 : ret;
+}
+
+static int zram_lz4_decompress(const unsigned char *src, size_t src_len,
+			unsigned char *dst)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret = lz4_decompress_safe(src, src_len, dst, &dst_len);
+
+	return ret == LZ4_E_OK ? 0 : ret;
+}
+
+static const struct zram_backend zram_lz4 = {
+	.name		= "lz4",
+	.workmem_size	= LZ4_MEM_COMPRESS,
+	.compress	= zram_lz4_compress,
+	.decompress	= zram_lz4_decompress,
+};
+#endif
+
+static const struct zram_backend *backends[] = {
+	&zram_lzo,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	&zram_lz4,
+#endif
+	NULL
+};
+
+const struct zram_backend *zram_backend_default = &zram_lzo;
+
+const struct zram_backend *zram_backend_find(const char *name)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (sysfs_streq(name, backends[i]->name))
+			return backends[i];
+	}
+
+	return NULL;
+}
+
+/* List the available backends, with the current one in brackets */
+ssize_t zram_backend_show(const struct zram_backend *cur, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (backends[i] == cur)
+			sz += sprintf(buf + sz, "[%s] ", backends[i]->name);
+		else
+			sz += sprintf(buf + sz, "%s ", backends[i]->name);
+	}
+	sz += sprintf(buf + sz, "\n");
+
+	return sz;
+}
+
+void zram_strm_destroy(struct zram_strm __percpu *strms)
+{
+	int cpu;
+
+	if (!strms)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_strm *strm = per_cpu_ptr(strms, cpu);
+
+		kfree(strm->workmem);
+		free_pages((unsigned long)strm->buffer, 1);
+	}
+
+	free_percpu(strms);
+}
+
+struct zram_strm __percpu *zram_strm_create(
+				const struct zram_backend *backend)
+{
+	struct zram_strm __percpu *strms;
+	int cpu;
+
+	strms = alloc_percpu(struct zram_strm);
+	if (!strms)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_strm *strm = per_cpu_ptr(strms, cpu);
+
+		mutex_init(&strm->lock);
+		strm->workmem = kzalloc(backend->workmem_size, GFP_KERNEL);
+		strm->buffer = (void *)__get_free_pages(GFP_KERNEL |
+							__GFP_ZERO, 1);
+		if (!strm->workmem || !strm->buffer) {
+			zram_strm_destroy(strms);
+			return NULL;
+		}
+	}
+
+	return strms;
+}
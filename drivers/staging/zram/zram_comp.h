@@ -0,0 +1,75 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_COMP_H_
+#define _ZRAM_COMP_H_
+
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+
+/* Longest backend name accepted through sysfs */
+#define ZRAM_BACKEND_NAME_LEN	16
+
+/* A compression algorithm zram can store pages with */
+struct zram_backend {
+	const char *name;
+	size_t workmem_size;
+
+	/*
+	 * Compress one PAGE_SIZE page. 'dst' is two pages long, which
+	 * covers the worst case expansion of every backend.
+	 */
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem);
+
+	/* Decompress an object back into one PAGE_SIZE page */
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst);
+};
+
+/*
+ * Compression stream: the working memory and output buffer needed for
+ * one compression in flight. There is one per CPU, so writers running
+ * on different CPUs compress in parallel. The mutex only matters when a
+ * writer is migrated and two of them end up on the same stream.
+ */
+struct zram_strm {
+	struct mutex lock;
+	void *workmem;
+	void *buffer;
+};
+
+extern const struct zram_backend *zram_backend_default;
+
+const struct zram_backend *zram_backend_find(const char *name);
+ssize_t zram_backend_show(const struct zram_backend *cur, char *buf);
+
+struct zram_strm __percpu *zram_strm_create(
+				const struct zram_backend *backend);
+void zram_strm_destroy(struct zram_strm __percpu *strms);
+
+static inline struct zram_strm *zram_strm_get(struct zram_strm __percpu *strms)
+{
+	struct zram_strm *strm = per_cpu_ptr(strms, raw_smp_processor_id());
+
+	mutex_lock(&strm->lock);
+	return strm;
+}
+
+static inline void zram_strm_put(struct zram_strm *strm)
+{
+	mutex_unlock(&strm->lock);
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ *
+ * Content based deduplication of stored pages. Every stored object is
+ * indexed by a checksum of its uncompressed contents. A write whose
+ * checksum matches an indexed object is checked byte for byte against
+ * it and, if identical, takes a reference instead of being compressed
+ * and stored again.
+ */
+
+#include <linux/kernel.h>
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+u32 zram_dedup_checksum(void *mem)
+{
+	return jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/* Does @entry hold the same data as the uncompressed page @mem? */
+static int zram_dedup_match(struct zram *zram, struct zram_strm *strm,
+			struct zram_entry *entry, void *mem)
+{
+	unsigned char *cmem;
+	int match;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE) {
+		match = !memcmp(mem, cmem, PAGE_SIZE);
+	} else {
+		/* Nothing is compressed yet, so the stream is free to use */
+		match = !zram->backend->decompress(cmem, entry->len,
+						strm->buffer) &&
+			!memcmp(mem, strm->buffer, PAGE_SIZE);
+	}
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/**
+ * zram_dedup_find - look for a stored copy of a page
+ * @zram: device to search
+ * @strm: caller's compression stream, used as scratch space
+ * @mem: the page, mapped
+ * @checksum: zram_dedup_checksum() of @mem
+ *
+ * Returns the matching entry with a reference taken for the caller, or
+ * NULL. Only the first entry with a matching checksum is tried; on the
+ * rare collision the page is simply stored again.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct zram_strm *strm,
+				void *mem, u32 checksum)
+{
+	struct rb_node *node;
+	struct zram_entry *entry = NULL;
+
+	spin_lock(&zram->dedup_lock);
+	node = zram->dedup_root.rb_node;
+	while (node) {
+		struct zram_entry *cur = rb_entry(node, struct zram_entry,
+						rb_node);
+
+		if (checksum < cur->checksum) {
+			node = node->rb_left;
+		} else if (checksum > cur->checksum) {
+			node = node->rb_right;
+		} else {
+			entry = cur;
+			entry->refcount++;
+			break;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	if (!entry)
+		return NULL;
+
+	if (zram_dedup_match(zram, strm, entry, mem))
+		return entry;
+
+	zram_dedup_put(zram, entry);
+	return NULL;
+}
+
+/*
+ * Index a newly stored object. Returns its entry, holding the one
+ * reference of the caller's table slot, or NULL on allocation failure.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				u16 len, u32 checksum)
+{
+	struct rb_node **p, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->handle = handle;
+
+	spin_lock(&zram->dedup_lock);
+	p = &zram->dedup_root.rb_node;
+	while (*p) {
+		struct zram_entry *cur;
+
+		parent = *p;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, p);
+	rb_insert_color(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/*
+ * Drop a reference. Returns 1 if it was the last one, in which case the
+ * object has been freed.
+ */
+int zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	int refcount;
+
+	spin_lock(&zram->dedup_lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	if (refcount)
+		return 0;
+
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+	return 1;
+}
@@ -0,0 +1,67 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+
+struct zram;
+struct zram_strm;
+
+/*
+ * A stored object that may be shared by several table entries. With
+ * dedup enabled, table[].handle points to one of these instead of
+ * holding the zsmalloc handle itself.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	u16 len;
+	int refcount;		/* protected by zram->dedup_lock */
+	unsigned long handle;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u32 zram_dedup_checksum(void *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram, struct zram_strm *strm,
+				void *mem, u32 checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				u16 len, u32 checksum);
+int zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+#else
+static inline u32 zram_dedup_checksum(void *mem)
+{
+	return 0;
+}
+
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+			struct zram_strm *strm, void *mem, u32 checksum)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+			unsigned long handle, u16 len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline int zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	return 0;
+}
+#endif
+
+#endif
@@ -23,15 +23,19 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -42,14 +46,14 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -74,33 +78,71 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	return zram->table[index].flags & BIT(flag);
+	return zram->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags |= BIT(flag);
+	zram->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags &= ~BIT(flag);
+	zram->table[index].value &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static size_t zram_get_obj_size(struct zram *zram, u32 index)
+{
+	return zram->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram *zram, u32 index, size_t size)
+{
+	unsigned long flags = zram->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
+}
+
+/*
+ * The slot lock keeps a table entry and the object it refers to stable.
+ * It is a spinlock: nothing may sleep while holding it.
+ */
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_LOCK, &zram->table[index].value);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_LOCK, &zram->table[index].value);
+}
+
+/* zsmalloc handle of the object backing a table entry */
+static unsigned long zram_get_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram->table[index].handle;
+
+	if (zram->use_dedup)
+		return ((struct zram_entry *)handle)->handle;
+
+	return handle;
+}
+
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
@@ -133,75 +175,231 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static unsigned long zram_alloc_bd_blk(struct zram *zram)
 {
-	u32 clen;
-	void *obj;
+	unsigned long blk;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	/* Block 0 is never handed out, so 0 can mean failure */
+	do {
+		blk = find_next_zero_bit(zram->bd_bitmap,
+					zram->nr_bd_pages, 1);
+		if (blk >= zram->nr_bd_pages)
+			return 0;
+	} while (test_and_set_bit(blk, zram->bd_bitmap));
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
-		return;
+	return blk;
+}
+
+static void zram_free_bd_blk(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bd_bitmap));
+}
+
+static void zram_bd_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously read or write one page of the backing device */
+static int zram_bd_rw_page(struct zram *zram, int rw, unsigned long blk,
+			struct page *page)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	ktime_t start = ktime_get();
+	struct bio *bio;
+	u64 delta;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bd_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
 	}
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (rw == READ) {
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+		zram_stat64_add(zram, &zram->stats.bd_read_time, delta);
+	} else {
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+		zram_stat64_add(zram, &zram->stats.bd_write_time, delta);
+	}
+
+	return ret;
+}
+
+struct zram_bd_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk;
+	struct page *page;
+	int ret;
+};
+
+static void zram_bd_read_work(struct work_struct *work)
+{
+	struct zram_bd_work *zw = container_of(work, struct zram_bd_work,
+						work);
+
+	zw->ret = zram_bd_rw_page(zw->zram, READ, zw->blk, zw->page);
+}
+
+/*
+ * Bios submitted from within make_request are only queued until it
+ * returns, so waiting on one here would deadlock. Hand the read to a
+ * worker and wait for that instead.
+ */
+static int zram_read_from_bdev(struct zram *zram, unsigned long blk,
+			struct page *page)
+{
+	struct zram_bd_work zw = {
+		.zram = zram,
+		.blk = blk,
+		.page = page,
+	};
+
+	INIT_WORK_ONSTACK(&zw.work, zram_bd_read_work);
+	queue_work(system_unbound_wq, &zw.work);
+	flush_work(&zw.work);
+	destroy_work_on_stack(&zw.work);
+
+	return zw.ret;
+}
+#else
+static void zram_free_bd_blk(struct zram *zram, unsigned long blk)
+{
+}
+
+static int zram_read_from_bdev(struct zram *zram, unsigned long blk,
+			struct page *page)
+{
+	return -EIO;
+}
+#endif
+
+/* Caller must hold the slot lock, or otherwise own the slot */
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	unsigned long handle = zram->table[index].handle;
+	size_t size = zram_get_obj_size(zram, index);
+
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_free_bd_blk(zram, handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		goto out;
+	}
+
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_stat_dec(&zram->stats.pages_same);
+		if (!handle)
+			zram_stat_dec(&zram->stats.pages_zero);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	if (unlikely(!handle))
+		goto out;
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		zram_stat_dec(&zram->stats.pages_expand);
+	else if (size <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	if (!zram->use_dedup) {
+		zs_free(zram->mem_pool, handle);
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	} else if (zram_dedup_put(zram, (struct zram_entry *)handle)) {
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	} else {
+		zram_stat64_sub(zram, &zram->stats.dup_data_size, size);
+		zram_stat_dec(&zram->stats.pages_dedup);
+	}
+
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+out:
+	/* Clear the size and every flag but the slot lock itself */
+	zram->table[index].handle = 0;
+	zram->table[index].value &= BIT(ZRAM_LOCK);
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		unsigned long *p = user_mem;
+		unsigned int pos;
+
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*p); pos++)
+			p[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
-
-	flush_dcache_page(page);
 }
 
-static void handle_uncompressed_page(struct zram *zram,
-				struct page *page, u32 index)
+/*
+ * Fill @page from a slot held in memory. Caller must hold the slot lock
+ * and have dealt with written back slots.
+ */
+static int zram_decompress_page(struct zram *zram, struct page *page,
+			u32 index)
 {
+	int ret = 0;
+	unsigned long handle = zram->table[index].handle;
 	unsigned char *user_mem, *cmem;
 
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		handle_same_page(page, handle);
+		return 0;
+	}
+
+	/* Requested page is not present in compressed area */
+	if (unlikely(!handle)) {
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
+
+	handle = zram_get_handle(zram, index);
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 
-	memcpy(user_mem, cmem, PAGE_SIZE);
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		memcpy(user_mem, cmem, PAGE_SIZE);
+	else
+		ret = zram->backend->decompress(cmem,
+			zram_get_obj_size(zram, index), user_mem);
+
+	zs_unmap_object(zram->mem_pool, handle);
 	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
 
-	flush_dcache_page(page);
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret))
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+
+	return ret;
 }
 
 static void zram_read(struct zram *zram, struct bio *bio)
@@ -216,53 +414,23 @@ static void zram_read(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
+		unsigned long blk;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
+		zram_slot_lock(zram, index);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			blk = zram->table[index].handle;
+			zram_slot_unlock(zram, index);
+			ret = zram_read_from_bdev(zram, blk, page);
+		} else {
+			ret = zram_decompress_page(zram, page, index);
+			zram_slot_unlock(zram, index);
 		}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
-
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
-		}
-
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
-
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
+		if (unlikely(ret)) {
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
 			goto out;
 		}
@@ -290,42 +458,62 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
 		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		u32 checksum = 0;
+		unsigned long handle, element;
+		struct zram_entry *entry;
+		struct page *page;
+		struct zram_strm *strm;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
+		strm = zram_strm_get(zram->strm);
+		src = strm->buffer;
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			zram_strm_put(strm);
+
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			zram_slot_lock(zram, index);
+			zram_free_page(zram, index);
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram->table[index].handle = element;
+			zram_slot_unlock(zram, index);
+
+			zram_stat_inc(&zram->stats.pages_same);
+			if (!element)
+				zram_stat_inc(&zram->stats.pages_zero);
 			index++;
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		if (zram->use_dedup) {
+			checksum = zram_dedup_checksum(user_mem);
+			entry = zram_dedup_find(zram, strm, user_mem, checksum);
+			if (entry) {
+				kunmap_atomic(user_mem, KM_USER0);
+				clen = entry->len;
+				handle = (unsigned long)entry;
+				zram_stat64_add(zram,
+					&zram->stats.dup_data_size, clen);
+				zram_stat_inc(&zram->stats.pages_dedup);
+				goto stored;
+			}
+		}
+
+		ret = zram->backend->compress(user_mem, src, &clen,
+					strm->workmem);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_strm_put(strm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -336,64 +524,62 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		 * since we do not want to return too many disk write
 		 * errors which has side effect of hanging the system.
 		 */
-		if (unlikely(clen > max_zpage_size)) {
+		if (unlikely(clen > max_zpage_size))
 			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		handle = zs_malloc(zram->mem_pool, clen,
+				GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!handle)) {
+			zram_strm_put(strm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		if (unlikely(clen == PAGE_SIZE))
+			src = kmap_atomic(page, KM_USER0);
+
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		if (unlikely(clen == PAGE_SIZE))
+			kunmap_atomic(src, KM_USER0);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+		if (zram->use_dedup) {
+			entry = zram_dedup_insert(zram, handle, clen, checksum);
+			if (unlikely(!entry)) {
+				zs_free(zram->mem_pool, handle);
+				zram_strm_put(strm);
+				pr_info("Error allocating dedup entry for "
+					"page: %u\n", index);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
+			handle = (unsigned long)entry;
 		}
-#endif
 
-		memcpy(cmem, src, clen);
+		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+stored:
+		zram_slot_lock(zram, index);
+		zram_free_page(zram, index);
+		zram->table[index].handle = handle;
+		zram_set_obj_size(zram, index, clen);
+		if (unlikely(clen == PAGE_SIZE))
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_slot_unlock(zram, index);
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		if (unlikely(clen == PAGE_SIZE))
+			zram_stat_inc(&zram->stats.pages_expand);
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		zram_strm_put(strm);
 		index++;
 	}
 
@@ -453,47 +639,210 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
-void zram_reset_device(struct zram *zram)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bd_bitmap);
+
+	zram->bdev = NULL;
+	zram->backing_dev = NULL;
+	zram->bd_bitmap = NULL;
+	zram->nr_bd_pages = 0;
+}
+
+/* Caller holds init_lock on a device that is not initialized yet */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	struct inode *inode;
+	struct block_device *bdev;
+	struct file *backing_dev;
+	unsigned long nr_pages, *bitmap;
+
+	backing_dev = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev))
+		return PTR_ERR(backing_dev);
+
+	inode = backing_dev->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		ret = -ENOTBLK;
+		goto close;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	ret = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (ret < 0)
+		goto close;
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto put;
+	}
+
+	zram_reset_bdev(zram);
+	zram->backing_dev = backing_dev;
+	zram->bdev = bdev;
+	zram->nr_bd_pages = nr_pages;
+	zram->bd_bitmap = bitmap;
+
+	pr_info("Using %s as backing device, %lu pages\n", path, nr_pages);
+	return 0;
+
+put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+close:
+	filp_close(backing_dev, NULL);
+	return ret;
+}
+
+/* Caller holds init_lock on an initialized device */
+void zram_mark_idle(struct zram *zram)
 {
 	size_t index;
 
-	mutex_lock(&zram->init_lock);
-	zram->init_done = 0;
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		zram_slot_lock(zram, index);
+		if (zram->table[index].handle &&
+				!zram_test_flag(zram, index, ZRAM_SAME) &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+	}
+}
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+static int zram_wb_candidate(struct zram *zram, u32 index,
+			enum zram_wb_mode mode)
+{
+	if (!zram->table[index].handle ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return 0;
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	if (mode == ZRAM_WB_IDLE)
+		return zram_test_flag(zram, index, ZRAM_IDLE);
+
+	return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+}
+
+/*
+ * Write pages matching @mode out to the backing device and free their
+ * memory. Caller holds init_lock on an initialized device.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	size_t index;
+	unsigned long blk = 0;
+	struct page *page;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
 
-	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+		if (!blk) {
+			blk = zram_alloc_bd_blk(zram);
+			if (!blk) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		zram_slot_lock(zram, index);
+		if (!zram_wb_candidate(zram, index, mode)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
 
-		if (!page)
+		/* Any free or rewrite of the slot clears this */
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		if (zram_decompress_page(zram, page, index)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
 			continue;
+		}
+		zram_slot_unlock(zram, index);
+
+		if (zram_bd_rw_page(zram, WRITE_SYNC, blk, page)) {
+			zram_slot_lock(zram, index);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+			ret = -EIO;
+			break;
+		}
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		zram_slot_lock(zram, index);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* Slot changed under us; reuse the block */
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram->table[index].handle = blk;
+		zram_slot_unlock(zram, index);
+
+		zram_stat_inc(&zram->stats.bd_count);
+		blk = 0;
 	}
 
+	if (blk)
+		zram_free_bd_blk(zram, blk);
+	__free_page(page);
+
+	return ret;
+}
+#else
+static void zram_reset_bdev(struct zram *zram)
+{
+}
+#endif
+
+/* Caller holds init_lock; the backing device is left configured */
+static void __zram_reset_device(struct zram *zram)
+{
+	size_t index;
+
+	zram->init_done = 0;
+
+	/* Free various per-device buffers */
+	zram_strm_destroy(zram->strm);
+	zram->strm = NULL;
+
+	/* Free all pages that are still in this zram device */
+	for (index = 0; zram->table &&
+			index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
+
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
 	zram->disksize = 0;
+}
+
+void zram_reset_device(struct zram *zram)
+{
+	mutex_lock(&zram->init_lock);
+	__zram_reset_device(zram);
+	zram_reset_bdev(zram);
 	mutex_unlock(&zram->init_lock);
 }
 
@@ -511,16 +860,10 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zram->strm = zram_strm_create(zram->backend);
+	if (!zram->strm) {
+		pr_err("Error allocating %s compression streams\n",
+			zram->backend->name);
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -537,10 +880,12 @@ int zram_init_device(struct zram *zram)
 
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
+	zram->dedup_root = RB_ROOT;
+
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -554,8 +899,8 @@ int zram_init_device(struct zram *zram)
 	return 0;
 
 fail:
+	__zram_reset_device(zram);
 	mutex_unlock(&zram->init_lock);
-	zram_reset_device(zram);
 
 	pr_err("Initialization failed: err=%d\n", ret);
 	return ret;
@@ -566,7 +911,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
+	zram_slot_unlock(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +926,9 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->dedup_lock);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -633,6 +980,7 @@ static int create_device(struct zram *zram, int device_id)
 		goto out;
 	}
 
+	zram->backend = zram_backend_default;
 	zram->init_done = 0;
 
 out:
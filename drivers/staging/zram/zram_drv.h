@@ -18,7 +18,9 @@
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zram_comp.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +28,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +41,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -63,13 +53,34 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_LOGICAL_BLOCK_SIZE	4096
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table[page_no].value hold the
+ * object size, the bits above it the zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT		24
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
+	/* Bit spinlock serializing access to the slot */
+	ZRAM_LOCK = ZRAM_FLAG_SHIFT,
+
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, which is kept in
+	 * table[page_no].handle instead of an allocation
+	 */
+	ZRAM_SAME,
+
+	/* Page was written back; table[page_no].handle is the bdev block */
+	ZRAM_WB,
+
+	/* Page is being written back; cleared if the slot changes */
+	ZRAM_UNDER_WB,
+
+	/* Page was not accessed since it was last marked idle */
+	ZRAM_IDLE,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,11 +89,9 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __attribute__((aligned(4)));
+	unsigned long handle;
+	unsigned long value;	/* object size and zram_pageflags */
+};
 
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
@@ -92,20 +101,26 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 dup_data_size;	/* compressed size of deduplicated pages */
+	u64 bd_reads;		/* no. of pages read back from backing dev */
+	u64 bd_writes;		/* no. of pages written to backing dev */
+	u64 bd_read_time;	/* total backing dev read latency, in ns */
+	u64 bd_write_time;	/* total backing dev write latency, in ns */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same filled pages, zeros included */
+	atomic_t pages_dedup;	/* no. of pages sharing a stored object */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t bd_count;	/* no. of pages currently on backing dev */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	const struct zram_backend *backend;
+	struct zram_strm __percpu *strm;	/* per-CPU streams */
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -117,6 +132,17 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+	/* Content based deduplication, set before init through sysfs */
+	int use_dedup;
+	spinlock_t dedup_lock;	/* protect dedup_root and entry refcounts */
+	struct rb_root dedup_root;
+
+	/* Backing device for written back pages, set before init */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long nr_bd_pages;
+	unsigned long *bd_bitmap;	/* allocated blocks; block 0 unused */
+
 	struct zram_stats stats;
 };
 
@@ -129,4 +155,16 @@ extern struct attribute_group zram_disk_attr_group;
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Modes for zram_writeback() */
+enum zram_wb_mode {
+	ZRAM_WB_IDLE,		/* pages not accessed since marked idle */
+	ZRAM_WB_HUGE,		/* pages stored uncompressed */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
+
 #endif
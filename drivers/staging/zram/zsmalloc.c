@@ -0,0 +1,874 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Objects are served from size classes spaced ZS_ALIGN bytes apart.
+ * Each class carves its objects out of zspages: groups of one to four
+ * pages, sized so the tail left over after the last object is as small
+ * as possible. Objects may straddle a page boundary inside a zspage;
+ * such objects are copied through a per-cpu buffer when mapped.
+ *
+ * Every object starts with a one word header. For an allocated object
+ * it points back at the object's handle (with OBJ_ALLOCATED_TAG set),
+ * for a free object it holds the index of the next free object. The
+ * back-reference lets compaction walk a zspage, move each live object
+ * into a fuller zspage of the same class, and repoint its handle. Once
+ * a zspage is empty its pages go straight back to the system.
+ *
+ * Locking: each class has a spinlock protecting its zspage lists and
+ * the free lists of its zspages. A handle is pinned with a bit lock
+ * while its object is mapped or being freed; compaction only trylocks
+ * pins, and skips a zspage holding a pinned object.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+
+#define ZS_ALIGN		16
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+#define ZS_MAX_CLASS_SIZE	ALIGN(ZS_MAX_ALLOC_SIZE + ZS_HANDLE_SIZE, \
+					ZS_ALIGN)
+#define ZS_SIZE_CLASSES		((ZS_MAX_CLASS_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_ALIGN + 1)
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/* Object header: back-reference to the handle, or the next free index */
+#define OBJ_ALLOCATED_TAG	1UL
+#define OBJ_FREE_SHIFT		1
+#define ZS_NO_OBJ		(~0U >> OBJ_FREE_SHIFT)
+
+/* Bit in zs_handle->flags held while the object can not move */
+#define HANDLE_PIN_BIT		0
+
+/*
+ * A zspage is "almost empty" at or below this fraction of its objects
+ * in use; those are the ones compaction drains.
+ */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+enum fullness_group {
+	ZS_EMPTY,
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	NR_ZS_FULLNESS,
+};
+
+struct zspage {
+	struct list_head list;		/* on class->fullness_list[] */
+	struct size_class *class;
+	unsigned int inuse;		/* no. of allocated objects */
+	unsigned int freelist;		/* first free object, or ZS_NO_OBJ */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct zs_handle {
+	unsigned long flags;
+	struct zspage *zspage;
+	unsigned int idx;
+};
+
+struct size_class {
+	spinlock_t lock;
+	unsigned int size;
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+	struct list_head fullness_list[NR_ZS_FULLNESS];
+
+	/* Stats, protected by lock */
+	unsigned long zspages;
+	unsigned long objs_inuse;
+};
+
+/* Per-cpu state for the object currently mapped on this cpu */
+struct zs_map_area {
+	char *buf;		/* bounce buffer for straddling objects */
+	void *vaddr;		/* kmap_atomic address, or NULL */
+	enum zs_mapmode mm;
+};
+
+struct zs_pool {
+	char name[32];
+	struct size_class classes[ZS_SIZE_CLASSES];
+	struct kmem_cache *handle_cachep;
+	struct zs_map_area __percpu *area;
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	struct shrinker shrinker;
+	struct dentry *stat_dentry;
+};
+
+static struct size_class *size_to_class(struct zs_pool *pool, size_t size)
+{
+	unsigned int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_ALIGN);
+
+	return &pool->classes[idx];
+}
+
+/* Pick the zspage size (in pages) that wastes the least space */
+static unsigned int get_pages_per_zspage(unsigned int size)
+{
+	unsigned int i, best = 1, best_usedpc = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		unsigned int zspage_size = i * PAGE_SIZE;
+		unsigned int waste = zspage_size % size;
+		unsigned int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > best_usedpc) {
+			best_usedpc = usedpc;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	if (!zspage->inuse)
+		return ZS_EMPTY;
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse * ZS_ALMOST_FULL_DEN <=
+			class->objs_per_zspage * ZS_ALMOST_FULL_NUM)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage)
+{
+	zspage->fullness = get_fullness_group(class, zspage);
+	if (zspage->fullness != ZS_EMPTY)
+		list_add(&zspage->list,
+			&class->fullness_list[zspage->fullness]);
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness != ZS_EMPTY)
+		list_del_init(&zspage->list);
+}
+
+/* Move a zspage to the list matching its current fullness */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(class, zspage);
+
+	if (newfg != zspage->fullness) {
+		remove_zspage(class, zspage);
+		insert_zspage(class, zspage);
+	}
+
+	return newfg;
+}
+
+/* Fullest zspage that still has room, or NULL */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int fg;
+
+	for (fg = ZS_ALMOST_FULL; fg >= ZS_ALMOST_EMPTY; fg--) {
+		if (!list_empty(&class->fullness_list[fg]))
+			return list_first_entry(&class->fullness_list[fg],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+static void obj_location(struct size_class *class, unsigned int idx,
+			unsigned int *page_idx, unsigned int *offset)
+{
+	unsigned long off = (unsigned long)idx * class->size;
+
+	*page_idx = off >> PAGE_SHIFT;
+	*offset = off & ~PAGE_MASK;
+}
+
+/* Headers are ZS_ALIGN aligned, so they never straddle a page */
+static unsigned long obj_read_head(struct zspage *zspage, unsigned int idx)
+{
+	unsigned int page_idx, offset;
+	unsigned long head;
+	void *vaddr;
+
+	obj_location(zspage->class, idx, &page_idx, &offset);
+	vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+	head = *(unsigned long *)(vaddr + offset);
+	kunmap_atomic(vaddr, KM_USER0);
+
+	return head;
+}
+
+static void obj_write_head(struct zspage *zspage, unsigned int idx,
+			unsigned long head)
+{
+	unsigned int page_idx, offset;
+	void *vaddr;
+
+	obj_location(zspage->class, idx, &page_idx, &offset);
+	vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+	*(unsigned long *)(vaddr + offset) = head;
+	kunmap_atomic(vaddr, KM_USER0);
+}
+
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int idx = zspage->freelist;
+
+	BUG_ON(idx == ZS_NO_OBJ);
+	zspage->freelist = obj_read_head(zspage, idx) >> OBJ_FREE_SHIFT;
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	obj_write_head(zspage, idx,
+		(unsigned long)zspage->freelist << OBJ_FREE_SHIFT);
+	zspage->freelist = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	unsigned int i, nr_pages = zspage->class->pages_per_zspage;
+
+	for (i = 0; i < nr_pages; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	atomic_long_sub(nr_pages, &pool->pages_allocated);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	unsigned int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	/* Thread all objects onto the free list */
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned int next = i + 1;
+
+		if (next == class->objs_per_zspage)
+			next = ZS_NO_OBJ;
+		obj_write_head(zspage, i,
+			(unsigned long)next << OBJ_FREE_SHIFT);
+	}
+	zspage->freelist = 0;
+
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+/*
+ * Copy a whole object slot, header included, one page-bounded chunk at
+ * a time since either side may straddle a page boundary.
+ */
+static void zs_copy_obj(struct zspage *dst, unsigned int didx,
+			struct zspage *src, unsigned int sidx)
+{
+	unsigned int size = src->class->size;
+	unsigned long doff = (unsigned long)didx * size;
+	unsigned long soff = (unsigned long)sidx * size;
+
+	while (size) {
+		unsigned int s_off = soff & ~PAGE_MASK;
+		unsigned int d_off = doff & ~PAGE_MASK;
+		unsigned int chunk = size;
+		void *s_addr, *d_addr;
+
+		chunk = min_t(unsigned int, chunk, PAGE_SIZE - s_off);
+		chunk = min_t(unsigned int, chunk, PAGE_SIZE - d_off);
+
+		s_addr = kmap_atomic(src->pages[soff >> PAGE_SHIFT], KM_USER0);
+		d_addr = kmap_atomic(dst->pages[doff >> PAGE_SHIFT], KM_USER1);
+		memcpy(d_addr + d_off, s_addr + s_off, chunk);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		soff += chunk;
+		doff += chunk;
+		size -= chunk;
+	}
+}
+
+/* Copy between a straddling object and the per-cpu bounce buffer */
+static void zs_copy_bounce(struct zspage *zspage, unsigned int idx,
+			char *buf, int to_buf)
+{
+	unsigned int size = zspage->class->size;
+	unsigned long off = (unsigned long)idx * size;
+
+	while (size) {
+		unsigned int p_off = off & ~PAGE_MASK;
+		unsigned int chunk = min_t(unsigned int, size,
+						PAGE_SIZE - p_off);
+		void *vaddr;
+
+		vaddr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		if (to_buf)
+			memcpy(buf, vaddr + p_off, chunk);
+		else
+			memcpy(vaddr + p_off, buf, chunk);
+		kunmap_atomic(vaddr, KM_USER1);
+
+		buf += chunk;
+		off += chunk;
+		size -= chunk;
+	}
+}
+
+static inline void pin_handle(struct zs_handle *h)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, &h->flags);
+}
+
+static inline int trypin_handle(struct zs_handle *h)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, &h->flags);
+}
+
+static inline void unpin_handle(struct zs_handle *h)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, &h->flags);
+}
+
+/**
+ * zs_malloc - allocate an object from the pool
+ * @pool: pool to allocate from
+ * @size: object size, at most ZS_MAX_ALLOC_SIZE
+ * @flags: allocation flags; __GFP_HIGHMEM is allowed
+ *
+ * Returns a handle to the object, or 0 on failure. The handle must be
+ * mapped with zs_map_object() to reach the object's memory.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	struct zs_handle *h;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	h = kmem_cache_alloc(pool->handle_cachep, flags & ~__GFP_HIGHMEM);
+	if (!h)
+		return 0;
+	h->flags = 0;
+
+	class = size_to_class(pool, size + ZS_HANDLE_SIZE);
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+
+		zspage = alloc_zspage(class, flags);
+		if (!zspage) {
+			kmem_cache_free(pool->handle_cachep, h);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	h->zspage = zspage;
+	h->idx = obj_alloc(class, zspage);
+	obj_write_head(zspage, h->idx, (unsigned long)h | OBJ_ALLOCATED_TAG);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)h;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+
+	if (unlikely(!handle))
+		return;
+
+	pin_handle(h);
+	zspage = h->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, h->idx);
+	fg = fix_fullness_group(class, zspage);
+	if (fg == ZS_EMPTY)
+		class->zspages--;
+	spin_unlock(&class->lock);
+	unpin_handle(h);
+
+	if (fg == ZS_EMPTY)
+		free_zspage(pool, zspage);
+
+	kmem_cache_free(pool->handle_cachep, h);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area;
+	unsigned int page_idx, offset;
+	struct zspage *zspage;
+	struct size_class *class;
+
+	BUG_ON(!handle);
+
+	/* Also disables preemption, which keeps us on this cpu's area */
+	pin_handle(h);
+	zspage = h->zspage;
+	class = zspage->class;
+	area = this_cpu_ptr(pool->area);
+	area->mm = mm;
+
+	obj_location(class, h->idx, &page_idx, &offset);
+	if (offset + class->size <= PAGE_SIZE) {
+		area->vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER1);
+		return area->vaddr + offset + ZS_HANDLE_SIZE;
+	}
+
+	area->vaddr = NULL;
+	if (mm != ZS_MM_WO)
+		zs_copy_bounce(zspage, h->idx, area->buf, 1);
+	else
+		*(unsigned long *)area->buf = handle | OBJ_ALLOCATED_TAG;
+
+	return area->buf + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area = this_cpu_ptr(pool->area);
+
+	if (area->vaddr)
+		kunmap_atomic(area->vaddr, KM_USER1);
+	else if (area->mm != ZS_MM_RO)
+		zs_copy_bounce(h->zspage, h->idx, area->buf, 0);
+
+	unpin_handle(h);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Move every live object out of @src into other zspages of the class.
+ * Returns 0 if an object was pinned or the class ran out of room, in
+ * which case @src is left partly drained.
+ */
+static int zs_migrate_zspage(struct size_class *class, struct zspage *src)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		unsigned long head = obj_read_head(src, idx);
+		struct zs_handle *h;
+		struct zspage *dst;
+		unsigned int didx;
+
+		if (!(head & OBJ_ALLOCATED_TAG))
+			continue;
+
+		h = (struct zs_handle *)(head & ~OBJ_ALLOCATED_TAG);
+		if (!trypin_handle(h))
+			return 0;
+
+		dst = find_get_zspage(class);
+		if (!dst) {
+			unpin_handle(h);
+			return 0;
+		}
+
+		didx = obj_alloc(class, dst);
+		zs_copy_obj(dst, didx, src, idx);
+		h->zspage = dst;
+		h->idx = didx;
+		fix_fullness_group(class, dst);
+
+		obj_free(class, src, idx);
+		unpin_handle(h);
+	}
+
+	return 1;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class, unsigned long nr_pages)
+{
+	unsigned long freed = 0;
+	struct zspage *src;
+
+	while (freed < nr_pages) {
+		int drained;
+
+		spin_lock(&class->lock);
+
+		/* Stop once the free slots could not empty a whole zspage */
+		if (class->zspages * class->objs_per_zspage - class->objs_inuse
+				< class->objs_per_zspage ||
+		    list_empty(&class->fullness_list[ZS_ALMOST_EMPTY])) {
+			spin_unlock(&class->lock);
+			break;
+		}
+
+		/* Drain the emptiest end; new zspages are added at the head */
+		src = list_entry(class->fullness_list[ZS_ALMOST_EMPTY].prev,
+				struct zspage, list);
+		remove_zspage(class, src);
+
+		drained = zs_migrate_zspage(class, src);
+		if (!src->inuse) {
+			class->zspages--;
+			spin_unlock(&class->lock);
+			free_zspage(pool, src);
+			freed += class->pages_per_zspage;
+			continue;
+		}
+
+		insert_zspage(class, src);
+		spin_unlock(&class->lock);
+
+		if (!drained)
+			break;
+	}
+
+	return freed;
+}
+
+/* Compact until about @nr_pages pages have been freed */
+static unsigned long __zs_compact(struct zs_pool *pool, unsigned long nr_pages)
+{
+	unsigned long freed = 0;
+	int i;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0 && freed < nr_pages; i--)
+		freed += zs_compact_class(pool, &pool->classes[i],
+					nr_pages - freed);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+
+	return freed;
+}
+
+/**
+ * zs_compact - return partly used zspages to the system
+ * @pool: pool to compact
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return __zs_compact(pool, ULONG_MAX);
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/* Pages compaction could give back if every object moved */
+static unsigned long zs_compactable_pages(struct zs_pool *pool)
+{
+	unsigned long pages = 0;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+		unsigned long free_objs;
+
+		spin_lock(&class->lock);
+		free_objs = class->zspages * class->objs_per_zspage -
+				class->objs_inuse;
+		spin_unlock(&class->lock);
+
+		pages += free_objs / class->objs_per_zspage *
+				class->pages_per_zspage;
+	}
+
+	return pages;
+}
+
+static int zs_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+						shrinker);
+
+	if (sc->nr_to_scan)
+		__zs_compact(pool, sc->nr_to_scan);
+
+	return zs_compactable_pages(pool);
+}
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+unsigned long zs_get_pages_compacted(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_pages_compacted);
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zs_stat_root;
+
+static int zs_classes_show(struct seq_file *s, void *v)
+{
+	struct zs_pool *pool = s->private;
+	unsigned long total_allocated = 0, total_used = 0, total_pages = 0;
+	int i;
+
+	seq_printf(s, " %5s %5s %9s %9s %13s %10s %10s %5s\n",
+		"class", "size", "objs/zsp", "pages/zsp", "zspages",
+		"obj_alloc", "obj_used", "frag%");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+		unsigned long zspages, allocated, used;
+
+		spin_lock(&class->lock);
+		zspages = class->zspages;
+		used = class->objs_inuse;
+		spin_unlock(&class->lock);
+
+		if (!zspages)
+			continue;
+
+		allocated = zspages * class->objs_per_zspage;
+		seq_printf(s, " %5d %5u %9u %9u %13lu %10lu %10lu %5lu\n",
+			i, class->size, class->objs_per_zspage,
+			class->pages_per_zspage, zspages, allocated, used,
+			(allocated - used) * 100 / allocated);
+
+		total_allocated += allocated;
+		total_used += used;
+		total_pages += zspages * class->pages_per_zspage;
+	}
+
+	seq_printf(s, "\n Total %34s %13lu %10lu %10lu\n", "pages:",
+		total_pages, total_allocated, total_used);
+
+	return 0;
+}
+
+static int zs_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_classes_show, inode->i_private);
+}
+
+static const struct file_operations zs_classes_fops = {
+	.open		= zs_classes_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (!zs_stat_root)
+		return;
+
+	pool->stat_dentry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (pool->stat_dentry)
+		debugfs_create_file("classes", S_IRUGO, pool->stat_dentry,
+				pool, &zs_classes_fops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+#else
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+#endif
+
+static void zs_free_map_areas(struct zs_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(pool->area, cpu)->buf);
+	free_percpu(pool->area);
+}
+
+/**
+ * zs_create_pool - create an allocation pool
+ * @name: pool name, used for the handle cache and stats
+ *
+ * Returns the new pool, or NULL on failure.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	struct zs_pool *pool;
+	int i, cpu;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	snprintf(pool->name, sizeof(pool->name), "%s", name);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+		int fg;
+
+		spin_lock_init(&class->lock);
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_ALIGN;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+						class->size;
+		for (fg = 0; fg < NR_ZS_FULLNESS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->handle_cachep = kmem_cache_create(pool->name,
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!pool->handle_cachep)
+		goto free_pool;
+
+	pool->area = alloc_percpu(struct zs_map_area);
+	if (!pool->area)
+		goto free_cache;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_map_area *area = per_cpu_ptr(pool->area, cpu);
+
+		area->buf = kmalloc(ZS_MAX_CLASS_SIZE, GFP_KERNEL);
+		if (!area->buf)
+			goto free_areas;
+	}
+
+	pool->shrinker.shrink = zs_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
+
+	return pool;
+
+free_areas:
+	zs_free_map_areas(pool);
+free_cache:
+	kmem_cache_destroy(pool->handle_cachep);
+free_pool:
+	kfree(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+/* All objects must have been freed before the pool is destroyed */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	zs_pool_stat_destroy(pool);
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		if (class->zspages)
+			pr_warning("zsmalloc: %s: class %u has %lu zspages "
+				"still in use\n", pool->name, class->size,
+				class->zspages);
+	}
+
+	zs_free_map_areas(pool);
+	kmem_cache_destroy(pool->handle_cachep);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+static int __init zs_init(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+#endif
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove_recursive(zs_stat_root);
+#endif
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Size-class allocator for compressed objects");
@@ -0,0 +1,51 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Size-class allocator for compressed objects. Objects are grouped by
+ * size into "zspages" of one to four (possibly highmem) pages, and are
+ * reached through handles so they can be moved by compaction.
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/* Largest object zs_malloc() accepts */
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+enum zs_mapmode {
+	ZS_MM_RW,	/* read and write back */
+	ZS_MM_RO,	/* read only, changes are discarded */
+	ZS_MM_WO,	/* write only, old contents are not read */
+};
+
+struct zs_pool;
+
+struct zs_pool *zs_create_pool(const char *name);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+/*
+ * Objects must be mapped to be accessed. The mapping is atomic: the
+ * caller must not sleep before zs_unmap_object(), and must unmap in the
+ * reverse order of any kmap_atomic() it holds across the mapping.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+unsigned long zs_compact(struct zs_pool *pool);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+unsigned long zs_get_pages_compacted(struct zs_pool *pool);
+
+#endif
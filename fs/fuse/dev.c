@@ -35,34 +35,57 @@ static struct fuse_conn *fuse_get_conn(struct file *file)
 	return file->private_data;
 }
 
-static void fuse_request_init(struct fuse_req *req)
+static void fuse_request_init(struct fuse_req *req, struct page **pages,
+			      unsigned npages)
 {
 	memset(req, 0, sizeof(*req));
 	INIT_LIST_HEAD(&req->list);
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = pages;
+	req->max_pages = npages;
 }
 
-struct fuse_req *fuse_request_alloc(void)
+static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_KERNEL);
-	if (req)
-		fuse_request_init(req);
+	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
+	if (req) {
+		struct page **pages = req->inline_pages;
+
+		/* Requests of up to FUSE_MAX_PAGES_PER_REQ use the inline vector */
+		if (npages > FUSE_MAX_PAGES_PER_REQ) {
+			pages = kmalloc(sizeof(struct page *) * npages, flags);
+			if (!pages) {
+				kmem_cache_free(fuse_req_cachep, req);
+				return NULL;
+			}
+		} else {
+			npages = FUSE_MAX_PAGES_PER_REQ;
+		}
+		fuse_request_init(req, pages, npages);
+	}
 	return req;
 }
+
+struct fuse_req *fuse_request_alloc(void)
+{
+	return __fuse_request_alloc(FUSE_MAX_PAGES_PER_REQ, GFP_KERNEL);
+}
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
-struct fuse_req *fuse_request_alloc_nofs(void)
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
-	if (req)
-		fuse_request_init(req);
-	return req;
+	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
 void fuse_request_free(struct fuse_req *req)
 {
+	/* Left over if the opener was gone before it could take it */
+	if (req->passthrough_filp)
+		fput(req->passthrough_filp);
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -98,7 +121,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -117,7 +140,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = __fuse_request_alloc(npages, GFP_KERNEL);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -130,6 +153,12 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	atomic_dec(&fc->num_waiting);
 	return ERR_PTR(err);
 }
+EXPORT_SYMBOL_GPL(fuse_get_req_pages);
+
+struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+{
+	return fuse_get_req_pages(fc, FUSE_MAX_PAGES_PER_REQ);
+}
 EXPORT_SYMBOL_GPL(fuse_get_req);
 
 /*
@@ -167,7 +196,7 @@ static void put_reserved_req(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_file *ff = file->private_data;
 
 	spin_lock(&fc->lock);
-	fuse_request_init(req);
+	fuse_request_init(req, req->inline_pages, FUSE_MAX_PAGES_PER_REQ);
 	BUG_ON(ff->reserved_req);
 	ff->reserved_req = req;
 	wake_up_all(&fc->reserved_req_waitq);
@@ -1095,13 +1124,75 @@ __releases(fc->lock)
 }
 
 /*
- * Read a single request into the userspace filesystem's buffer.  This
- * function waits until a request is available, then removes it from
- * the pending list and copies request data to userspace buffer.  If
- * no reply is needed (FORGET) or request has been aborted or there
- * was an error during the copying then it's finished by calling
- * request_end().  Otherwise add it to the processing list, and set
- * the 'sent' flag.
+ * Drop the unused rest of the current buffer page after a request has
+ * been copied, so that the next request of a batch starts right after
+ * it.  Pipe buffers are closed off by fuse_copy_finish(), the next
+ * request gets a fresh page.
+ */
+static void fuse_copy_next(struct fuse_copy_state *cs)
+{
+	if (!cs->pipebufs) {
+		cs->addr -= cs->len;
+		cs->seglen += cs->len;
+	}
+	cs->len = 0;
+}
+
+/*
+ * Release the pipe buffers filled since the buffer count was nr_segs.
+ * Used to drop the partial copy of a batched request that failed, so
+ * that only complete requests reach the pipe.
+ */
+static void fuse_copy_drop(struct fuse_copy_state *cs, unsigned long nr_segs)
+{
+	while (cs->pipebufs && cs->nr_segs > nr_segs) {
+		cs->pipebufs--;
+		cs->nr_segs--;
+		page_cache_release(cs->pipebufs->page);
+	}
+}
+
+/*
+ * Check whether another request can be added to the batch being read.
+ * Interrupts and forgets are left for the next read.  Called with
+ * fc->lock held.
+ */
+static int fuse_batch_next(struct fuse_conn *fc, struct fuse_copy_state *cs,
+			   size_t nbytes)
+{
+	struct fuse_req *req;
+	unsigned nbufs;
+
+	if (!fc->connected || !list_empty(&fc->interrupts) ||
+	    list_empty(&fc->pending))
+		return 0;
+
+	req = list_entry(fc->pending.next, struct fuse_req, list);
+	if (req->in.h.len > nbytes)
+		return 0;
+
+	if (cs->pipebufs) {
+		/* Upper bound of the pipe buffers the request takes */
+		nbufs = DIV_ROUND_UP(req->in.h.len, PAGE_SIZE);
+		if (req->in.argpages)
+			nbufs += req->num_pages;
+		if (cs->nr_segs + nbufs > cs->pipe->buffers - cs->pipe->nrbufs)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Read requests into the userspace filesystem's buffer.  This function
+ * waits until a request is available, then removes it from the pending
+ * list and copies request data to userspace buffer.  If no reply is
+ * needed (FORGET) or request has been aborted or there was an error
+ * during the copying then it's finished by calling request_end().
+ * Otherwise add it to the processing list, and set the 'sent' flag.
+ *
+ * If the filesystem asked for FUSE_BATCH_READ, further pending requests
+ * are copied behind the first one for as long as they fit, without
+ * waiting for more.  Each starts with its own fuse_in_header.
  */
 static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
@@ -1110,6 +1201,8 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
+	unsigned long nr_segs;
+	ssize_t total = 0;
 
  restart:
 	spin_lock(&fc->lock);
@@ -1140,6 +1233,7 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 			fc->forget_batch = 16;
 	}
 
+ next:
 	req = list_entry(fc->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
@@ -1157,6 +1251,7 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 	spin_unlock(&fc->lock);
 	cs->req = req;
+	nr_segs = cs->nr_segs;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
@@ -1166,12 +1261,13 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
-		return -ENODEV;
+		err = -ENODEV;
+		goto out_batch;
 	}
 	if (err) {
 		req->out.h.error = -EIO;
 		request_end(fc, req);
-		return err;
+		goto out_batch;
 	}
 	if (!req->isreply)
 		request_end(fc, req);
@@ -1182,7 +1278,25 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 			queue_interrupt(fc, req);
 		spin_unlock(&fc->lock);
 	}
-	return reqsize;
+	total += reqsize;
+	nbytes -= reqsize;
+
+	if (fc->batch_read) {
+		spin_lock(&fc->lock);
+		if (fuse_batch_next(fc, cs, nbytes)) {
+			fuse_copy_next(cs);
+			goto next;
+		}
+		spin_unlock(&fc->lock);
+	}
+	return total;
+
+ out_batch:
+	if (!total)
+		return err;
+	/* Don't lose the requests already in the buffer */
+	fuse_copy_drop(cs, nr_segs);
+	return total;
 
  err_unlock:
 	spin_unlock(&fc->lock);
@@ -1724,6 +1838,8 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 
 	spin_lock(&fc->lock);
 	req->locked = 0;
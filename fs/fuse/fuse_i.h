@@ -23,15 +23,21 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
+/** Default max number of pages that can be used in a single request */
 #define FUSE_MAX_PAGES_PER_REQ 32
 
+/** Upper limit for the max_pages value negotiated in INIT */
+#define FUSE_MAX_MAX_PAGES 256
+
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
 
 /** It could be as large as PATH_MAX, but would that have any uses? */
 #define FUSE_NAME_MAX 1024
 
+/** Magic number of fuse superblocks */
+#define FUSE_SUPER_MAGIC 0x65735546
+
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
@@ -135,6 +141,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Lower file serving read, write and mmap (FOPEN_PASSTHROUGH) */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -285,7 +294,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the page vector */
+	unsigned max_pages;
+
+	/** inline page vector, used unless more pages were asked for */
+	struct page *inline_pages[FUSE_MAX_PAGES_PER_REQ];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -307,6 +322,9 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Lower file taken from an OPEN or CREATE reply */
+	struct file *passthrough_filp;
 };
 
 /**
@@ -341,6 +359,9 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages in a cached read or write request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
@@ -419,6 +440,18 @@ struct fuse_conn {
 	/** Filesystem supports NFS exporting.  Only set in INIT */
 	unsigned export_support:1;
 
+	/** Write through the page cache and send dirty pages to the
+	    filesystem in batches.  Only set in INIT */
+	unsigned writeback_cache:1;
+
+	/** Filesystem may hand over a lower file on open.  Only set
+	    in INIT */
+	unsigned passthrough:1;
+
+	/** Read of the device returns as many requests as fit into the
+	    buffer.  Only set in INIT */
+	unsigned batch_read:1;
+
 	/** Set if bdi is valid */
 	unsigned bdi_initialized:1;
 
@@ -471,7 +504,6 @@ struct fuse_conn {
 
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
-
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -644,7 +676,7 @@ void fuse_ctl_cleanup(void);
  */
 struct fuse_req *fuse_request_alloc(void);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -656,6 +688,11 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for @npages pages, may fail with -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
@@ -763,4 +800,16 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,216 @@
+/*
+  FUSE: Filesystem in Userspace
+  Passthrough of read, write and mmap to a lower file
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/fsnotify.h>
+#include <linux/mm.h>
+
+/*
+ * Passthrough: the filesystem answers OPEN or CREATE with
+ * FOPEN_PASSTHROUGH and the number of a file descriptor it has open in
+ * passthrough_fd.  Reads, writes and mmaps of the fuse file are then
+ * done directly on that lower file by the calling task, without a
+ * round trip through the filesystem daemon.  Everything else,
+ * including fsync, setattr and release, still goes to the daemon.
+ */
+
+/*
+ * Called from the daemon's write on the device, so that
+ * passthrough_fd is looked up in the daemon's file table.  If the file
+ * can't be used the FOPEN_PASSTHROUGH flag is dropped and the file is
+ * opened as usual.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *open_out;
+	struct file *passthrough_filp;
+	struct inode *passthrough_inode;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+
+	if (req->in.h.opcode == FUSE_OPEN)
+		open_out = req->out.args[0].value;
+	else if (req->in.h.opcode == FUSE_CREATE)
+		open_out = req->out.args[1].value;
+	else
+		return;
+
+	if (!(open_out->open_flags & FOPEN_PASSTHROUGH))
+		return;
+	open_out->open_flags &= ~FOPEN_PASSTHROUGH;
+
+	passthrough_filp = fget(open_out->passthrough_fd);
+	if (!passthrough_filp) {
+		printk(KERN_WARNING "fuse: bad passthrough fd %u\n",
+		       open_out->passthrough_fd);
+		return;
+	}
+
+	/* Only regular files, and no stacking of fuse on fuse */
+	passthrough_inode = passthrough_filp->f_path.dentry->d_inode;
+	if (!S_ISREG(passthrough_inode->i_mode) ||
+	    passthrough_inode->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !passthrough_filp->f_op ||
+	    !passthrough_filp->f_op->aio_read ||
+	    !passthrough_filp->f_op->aio_write) {
+		printk(KERN_WARNING "fuse: passthrough fd %u not supported\n",
+		       open_out->passthrough_fd);
+		fput(passthrough_filp);
+		return;
+	}
+
+	req->passthrough_filp = passthrough_filp;
+	open_out->open_flags |= FOPEN_PASSTHROUGH;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+/*
+ * Do what vfs_read()/vfs_write() would on the lower file, with the
+ * credentials of the task that opened the fuse file.  The fuse file has
+ * already been through rw_verify_area(), so count fits.
+ */
+static ssize_t fuse_passthrough_rw(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos,
+				   int write)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	struct inode *inode = file->f_path.dentry->d_inode;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	size_t count = iov_length(iov, nr_segs);
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (is_bad_inode(inode))
+		return -EIO;
+	if (!(passthrough_filp->f_mode & (write ? FMODE_WRITE : FMODE_READ)))
+		return -EBADF;
+
+	old_cred = override_creds(file->f_cred);
+
+	ret = rw_verify_area(write ? WRITE : READ, passthrough_filp, &pos,
+			     count);
+	if (ret < 0)
+		goto out;
+
+	/* Dirty pages cached by other opens must reach the lower file first */
+	if (fc->writeback_cache) {
+		ret = filemap_write_and_wait(file->f_mapping);
+		if (ret)
+			goto out;
+	}
+
+	/*
+	 * The lower file's f_pos is not used: the position travels in
+	 * the kiocb and is written back to the fuse file by the caller.
+	 */
+	iocb->ki_filp = passthrough_filp;
+	if (write)
+		ret = passthrough_filp->f_op->aio_write(iocb, iov, nr_segs, pos);
+	else
+		ret = passthrough_filp->f_op->aio_read(iocb, iov, nr_segs, pos);
+	iocb->ki_filp = file;
+
+	if (ret > 0) {
+		if (write)
+			fsnotify_modify(passthrough_filp);
+		else
+			fsnotify_access(passthrough_filp);
+	}
+
+	/* ki_pos is where the write ended, also for O_APPEND */
+	if (write && ret > 0) {
+		fuse_write_update_size(inode, iocb->ki_pos);
+		/* Don't leave stale pages for opens that use the cache */
+		if ((ff->open_flags & FOPEN_KEEP_CACHE) || fc->writeback_cache)
+			invalidate_inode_pages2_range(file->f_mapping,
+				(iocb->ki_pos - ret) >> PAGE_CACHE_SHIFT,
+				(iocb->ki_pos - 1) >> PAGE_CACHE_SHIFT);
+	}
+	fuse_invalidate_attr(inode);
+ out:
+	revert_creds(old_cred);
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, 0);
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, 1);
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!passthrough_filp->f_op->splice_read)
+		return -EINVAL;
+
+	old_cred = override_creds(in->f_cred);
+	ret = rw_verify_area(READ, passthrough_filp, ppos, len);
+	if (ret >= 0)
+		ret = passthrough_filp->f_op->splice_read(passthrough_filp,
+						ppos, pipe, ret, flags);
+	if (ret > 0)
+		fsnotify_access(passthrough_filp);
+	revert_creds(old_cred);
+
+	return ret;
+}
+
+/*
+ * Map the lower file instead of the fuse file, so that the pages are
+ * shared with the lower file's page cache.  mmap_region() holds a
+ * reference to @file for the vma, which is traded for one on the lower
+ * file.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough_filp;
+	int ret;
+
+	if (!passthrough_filp->f_op->mmap)
+		return -ENODEV;
+
+	get_file(passthrough_filp);
+	vma->vm_file = passthrough_filp;
+	ret = passthrough_filp->f_op->mmap(passthrough_filp, vma);
+	if (ret) {
+		vma->vm_file = file;
+		fput(passthrough_filp);
+	} else {
+		fput(file);
+	}
+
+	return ret;
+}
@@ -123,7 +123,7 @@ struct request {
 	struct gendisk *rq_disk;
 	struct hd_struct *part;
 	unsigned long start_time;
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_LATENCY_HIST)
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
 #endif
@@ -260,6 +260,33 @@ struct queue_limits {
 	unsigned char		discard_zeroes_data;
 };
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+enum blk_latency_type {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,		/* async writes */
+	BLK_LAT_SYNC_WRITE,
+	BLK_LAT_FLUSH,
+	BLK_LAT_NR_TYPES,
+};
+
+/*
+ * Bucket 0 counts latencies below 1us, bucket n (n > 0) those in
+ * [2^(n-1), 2^n) us.  The last bucket also takes everything above it.
+ */
+#define BLK_LAT_NR_BUCKETS	24
+
+struct blk_latency_stat {
+	unsigned long		buckets[BLK_LAT_NR_BUCKETS];
+	unsigned long		nr;
+	unsigned long		max_us;
+	u64			total_us;
+};
+
+struct blk_latency_hist {
+	struct blk_latency_stat	stat[BLK_LAT_NR_TYPES];
+};
+#endif
+
 struct request_queue
 {
 	/*
@@ -383,6 +410,12 @@ struct request_queue
 	/* Throttle data */
 	struct throtl_data *td;
 #endif
+
+#ifdef CONFIG_BLK_LATENCY_HIST
+	/* protected by queue_lock */
+	struct blk_latency_hist	q2d_hist;	/* queued to dispatched */
+	struct blk_latency_hist	d2c_hist;	/* dispatched to completed */
+#endif
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -1134,7 +1167,7 @@ static inline void put_dev_sector(Sector p)
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
 
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_LATENCY_HIST)
 /*
  * This should not be using sched_clock(). A real patch is in progress
  * to fix this up, until that is in place we need to disable preemption
@@ -47,6 +47,19 @@
  *  - FUSE_IOCTL_UNRESTRICTED shall now return with array of 'struct
  *    fuse_ioctl_iovec' instead of ambiguous 'struct iovec'
  *  - add FUSE_IOCTL_32BIT flag
+ *
+ * 7.23
+ *  - add FUSE_WRITEBACK_CACHE
+ *  - add time_gran to fuse_init_out
+ *  - add FUSE_MAX_PAGES and max_pages to fuse_init_out; these are from
+ *    upstream 7.28 and keep its flag bit and field offset so that
+ *    existing servers negotiate them.  No other INIT flag of upstream
+ *    7.17 - 7.28 is offered
+ *  - add FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH and
+ *    fuse_open_out.passthrough_fd
+ *  - add FUSE_BATCH_READ
+ *  - add local_flags to fuse_init_in and fuse_init_out for the two INIT
+ *    flags above, which upstream does not have
  */
 
 #ifndef _LINUX_FUSE_H
@@ -78,7 +91,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 16
+#define FUSE_KERNEL_MINOR_VERSION 23
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -145,16 +158,20 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: serve read, write and mmap from passthrough_fd
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 7)
 
 /**
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_WRITEBACK_CACHE: use writeback cache for buffered writes
+ * FUSE_MAX_PAGES: init_out.max_pages contains the max number of req pages
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +180,21 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_MAX_PAGES		(1 << 22)
+
+/**
+ * INIT request/reply local_flags
+ *
+ * These are not part of the upstream protocol.  They live in the last
+ * word of fuse_init_in/out, which upstream leaves unused and stock
+ * servers zero, so that a server can't accept them by accident.
+ *
+ * FUSE_BATCH_READ: a read of the device may return several requests
+ * FUSE_PASSTHROUGH: filesystem may answer open with FOPEN_PASSTHROUGH
+ */
+#define FUSE_BATCH_READ		(1 << 0)
+#define FUSE_PASSTHROUGH	(1 << 1)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +412,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__u32	passthrough_fd;
 };
 
 struct fuse_release_in {
@@ -473,6 +505,8 @@ struct fuse_init_in {
 	__u32	minor;
 	__u32	max_readahead;
 	__u32	flags;
+	__u32	unused[11];
+	__u32	local_flags;
 };
 
 struct fuse_init_out {
@@ -483,6 +517,11 @@ struct fuse_init_out {
 	__u16   max_background;
 	__u16   congestion_threshold;
 	__u32	max_write;
+	__u32	time_gran;
+	__u16	max_pages;
+	__u16	padding;
+	__u32	unused[7];
+	__u32	local_flags;
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -0,0 +1,41 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Public Kernel Interface
+ *
+ *  A small, fast LZ77-class block codec. The on-disk format is the LZ4
+ *  block format: a sequence of (token, literals, offset, match length)
+ *  records, with the last record carrying literals only.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(u32))
+
+#define lz4_compressbound(x)	((x) + ((x) / 255) + 16)
+
+/*
+ * This requires 'wrkmem' of size LZ4_MEM_COMPRESS and a 'dst' buffer of
+ * at least lz4_compressbound(src_len) bytes.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Safe decompression with overrun testing. On entry *dst_len is the size
+ * of the 'dst' buffer, on return it is the number of bytes decompressed.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+
+/*
+ * Return values (< 0 = Error)
+ */
+#define LZ4_E_OK			0
+#define LZ4_E_INPUT_OVERRUN		(-1)
+#define LZ4_E_OUTPUT_OVERRUN		(-2)
+#define LZ4_E_LOOKBEHIND_OVERRUN	(-3)
+
+#endif
@@ -12,6 +12,7 @@
 
 #include <linux/mmc/core.h>
 #include <linux/mod_devicetable.h>
+#include <linux/workqueue.h>
 
 struct mmc_cid {
 	unsigned int		manfid;
@@ -77,6 +78,61 @@ struct mmc_ext_csd {
 	u8			raw_sec_feature_support;/* 231 */
 	u8			raw_trim_mult;		/* 232 */
 	u8			raw_sectors[4];		/* 212 - 4 bytes */
+	u8			raw_bkops_status;	/* 246 */
+	unsigned int		generic_cmd6_time;	/* Units: ms */
+	unsigned int		out_of_int_time;	/* Units: ms */
+	unsigned int		cache_size;		/* Units: KB */
+	bool			cache_ctrl;		/* cache is on */
+	bool			hpi;			/* HPI support bit */
+	bool			hpi_en;			/* HPI enable bit */
+	unsigned int		hpi_cmd;		/* cmd used as HPI */
+	bool			bkops;			/* BKOPS support bit */
+	bool			bkops_en;		/* BKOPS enable bit */
+	u8			max_packed_writes;	/* 500 */
+	u8			max_packed_reads;	/* 501 */
+	bool			packed_event_en;	/* packed failure events */
+};
+
+/*
+ * Idle time background operations.  The mmc queue arms @dw when it runs
+ * out of requests; if the card is still idle when it fires, BKOPS is
+ * started and later stopped with HPI once the next request comes in.
+ */
+struct mmc_bkops_info {
+	struct delayed_work	dw;
+	unsigned int		delay_ms;	/* idle time before BKOPS */
+#define MMC_IDLE_BKOPS_TIME_MS	2000
+	unsigned int		nr_started;	/* BKOPS started */
+	unsigned int		nr_stopped;	/* BKOPS stopped for a request */
+	unsigned int		nr_hpi;		/* stops that needed HPI */
+	unsigned int		level[4];	/* BKOPS_STATUS seen at idle */
+};
+
+/*
+ * A packed command header is one 512 byte block of 8 byte entries, the
+ * first of which describes the header itself.
+ */
+#define MMC_PACKED_MAX_ENTRIES	63
+
+enum mmc_packed_stop_reasons {
+	EXCEEDS_SEGMENTS = 0,	/* too many sg segments for the host */
+	EXCEEDS_SECTORS,	/* too many sectors for one transfer */
+	WRONG_DATA_DIR,		/* next request is a read */
+	FLUSH_OR_DISCARD,	/* next request is a flush or discard */
+	EMPTY_QUEUE,		/* nothing more to pack */
+	REL_WRITE,		/* reliable write cannot be packed */
+	THRESHOLD,		/* MAX_PACKED_WRITES reached */
+	MAX_REASONS,
+};
+
+/*
+ * Packed write statistics: packing_events[n] counts the packed commands
+ * that carried n requests.
+ */
+struct mmc_wr_pack_stats {
+	u32			packing_events[MMC_PACKED_MAX_ENTRIES + 1];
+	u32			pack_stop_reason[MAX_REASONS];
+	spinlock_t		lock;
 };
 
 struct sd_scr {
@@ -178,6 +234,7 @@ struct mmc_card {
 #define MMC_STATE_ULTRAHIGHSPEED (1<<5)		/* card is in ultra high speed mode */
 #define MMC_CARD_SDXC		(1<<6)		/* card is SDXC */
 #define MMC_CARD_REMOVED	(1<<7)		/* card has been removed */
+#define MMC_STATE_DOING_BKOPS	(1<<8)		/* card is doing BKOPS */
 	unsigned int		quirks; 	/* card quirks */
 #define MMC_QUIRK_LENIENT_FN0	(1<<0)		/* allow SDIO FN0 writes outside of the VS CCCR range */
 #define MMC_QUIRK_BLKSZ_FOR_BYTE_MODE (1<<1)	/* use func->cur_blksize */
@@ -215,6 +272,9 @@ struct mmc_card {
 
 	unsigned int		sd_bus_speed;	/* Bus Speed Mode set for the card */
 
+	struct mmc_bkops_info	bkops_info;
+	struct mmc_wr_pack_stats wr_pack_stats;	/* packed write statistics */
+
 	struct dentry		*debugfs_root;
 };
 
@@ -315,6 +375,7 @@ static inline void __maybe_unused remove_quirk(struct mmc_card *card, int data)
 #define mmc_sd_card_uhs(c) ((c)->state & MMC_STATE_ULTRAHIGHSPEED)
 #define mmc_card_ext_capacity(c) ((c)->state & MMC_CARD_SDXC)
 #define mmc_card_removed(c)	((c) && ((c)->state & MMC_CARD_REMOVED))
+#define mmc_card_doing_bkops(c)	((c)->state & MMC_STATE_DOING_BKOPS)
 
 #define mmc_card_set_present(c)	((c)->state |= MMC_STATE_PRESENT)
 #define mmc_card_set_readonly(c) ((c)->state |= MMC_STATE_READONLY)
@@ -324,6 +385,8 @@ static inline void __maybe_unused remove_quirk(struct mmc_card *card, int data)
 #define mmc_sd_card_set_uhs(c) ((c)->state |= MMC_STATE_ULTRAHIGHSPEED)
 #define mmc_card_set_ext_capacity(c) ((c)->state |= MMC_CARD_SDXC)
 #define mmc_card_set_removed(c) ((c)->state |= MMC_CARD_REMOVED)
+#define mmc_card_set_doing_bkops(c)	((c)->state |= MMC_STATE_DOING_BKOPS)
+#define mmc_card_clr_doing_bkops(c)	((c)->state &= ~MMC_STATE_DOING_BKOPS)
 
 /*
  * Quirk add/remove for MMC products.
@@ -2,7 +2,7 @@
 #define _MSM_KGSL_H
 
 #define KGSL_VERSION_MAJOR        3
-#define KGSL_VERSION_MINOR        8
+#define KGSL_VERSION_MINOR        9
 
 /*context flags */
 #define KGSL_CONTEXT_SAVE_GMEM	1
@@ -459,6 +459,59 @@ struct kgsl_timestamp_event_genlock {
 	int handle; /* Handle of the genlock lock to release */
 };
 
+/*
+ * Allocate GPU memory and return both its gpuaddr and a per-process id
+ * for it.  The id can be used to free the memory or look it up with
+ * IOCTL_KGSL_GPUMEM_GET_INFO.  The memory is mapped into userspace with
+ * mmap() at offset id << PAGE_SHIFT, or at offset gpuaddr as for
+ * IOCTL_KGSL_GPUMEM_ALLOC, with a length of mmapsize.
+ *
+ * The ioctl numbers and layouts of this and the next two ioctls are the
+ * same as upstream's.
+ */
+
+struct kgsl_gpumem_alloc_id {
+	unsigned int id;
+	unsigned int flags;
+	unsigned int size;
+	unsigned int mmapsize;
+	unsigned long gpuaddr;
+	unsigned int __pad[2]; /* For future binary compatibility */
+};
+
+#define IOCTL_KGSL_GPUMEM_ALLOC_ID \
+	_IOWR(KGSL_IOC_TYPE, 0x34, struct kgsl_gpumem_alloc_id)
+
+struct kgsl_gpumem_free_id {
+	unsigned int id;
+	unsigned int __pad; /* For future binary compatibility */
+};
+
+#define IOCTL_KGSL_GPUMEM_FREE_ID \
+	_IOWR(KGSL_IOC_TYPE, 0x35, struct kgsl_gpumem_free_id)
+
+/*
+ * Look up GPU memory owned by the calling process, by id if id is
+ * non-zero and otherwise by gpuaddr, which may point anywhere inside
+ * the allocation.  gpuaddr and size are returned for the whole
+ * allocation.  Works for memory from any of the allocation and import
+ * ioctls.  flags are the allocation flags, 0 for imported memory.
+ * useraddr is not tracked and always returned as 0.
+ */
+
+struct kgsl_gpumem_get_info {
+	unsigned long gpuaddr;
+	unsigned int id;
+	unsigned int flags;
+	unsigned int size;
+	unsigned int mmapsize;
+	unsigned long useraddr;
+	unsigned int __pad[4]; /* For future binary compatibility */
+};
+
+#define IOCTL_KGSL_GPUMEM_GET_INFO \
+	_IOWR(KGSL_IOC_TYPE, 0x36, struct kgsl_gpumem_get_info)
+
 #ifdef __KERNEL__
 #ifdef CONFIG_MSM_KGSL_DRM
 int kgsl_gem_obj_addr(int drm_fd, int handle, unsigned long *start,
@@ -42,6 +42,37 @@ enum oom_constraint {
 
 extern int test_set_oom_score_adj(int new_val);
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+/*
+ * Thread group leaders are kept on oom_adj_buckets[oom_adj - OOM_DISABLE],
+ * protected by oom_adj_bucket_lock.
+ */
+#define OOM_ADJ_BUCKETS		(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+extern spinlock_t oom_adj_bucket_lock;
+extern struct hlist_head oom_adj_buckets[OOM_ADJ_BUCKETS];
+
+extern void oom_adj_bucket_add(struct task_struct *p);
+extern void oom_adj_bucket_del(struct task_struct *p);
+extern void oom_adj_bucket_update(struct task_struct *p);
+extern void oom_adj_bucket_replace(struct task_struct *old,
+				   struct task_struct *new);
+#else
+static inline void oom_adj_bucket_add(struct task_struct *p)
+{
+}
+static inline void oom_adj_bucket_del(struct task_struct *p)
+{
+}
+static inline void oom_adj_bucket_update(struct task_struct *p)
+{
+}
+static inline void oom_adj_bucket_replace(struct task_struct *old,
+					  struct task_struct *new)
+{
+}
+#endif
+
 extern unsigned int oom_badness(struct task_struct *p, struct mem_cgroup *mem,
 			const nodemask_t *nodemask, unsigned long totalpages);
 extern int try_set_zonelist_oom(struct zonelist *zonelist, gfp_t gfp_flags);
@@ -0,0 +1,49 @@
+/*
+ * include/linux/vmpressure.h
+ *
+ * Memory pressure notification through /dev/vmpressure
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#ifndef _LINUX_VMPRESSURE_H
+#define _LINUX_VMPRESSURE_H
+
+#include <linux/types.h>
+
+/* Pressure levels, in increasing order of urgency */
+#define VMPRESSURE_LOW		0	/* reclaiming, but keeping up */
+#define VMPRESSURE_MEDIUM	1	/* time to trim caches */
+#define VMPRESSURE_CRITICAL	2	/* about to start killing */
+
+/*
+ * struct vmpressure_event - what read() on /dev/vmpressure returns
+ *
+ * 'seq' is incremented for every event, so a reader can tell whether it
+ * missed any. 'free' and 'file' are page counts sampled with the event.
+ */
+struct vmpressure_event {
+	__u32	seq;
+	__u32	level;		/* VMPRESSURE_* */
+	__u32	pressure;	/* percent of scanned pages not reclaimed */
+	__u32	free;		/* free pages */
+	__u32	file;		/* file pages, minus shmem */
+};
+
+#ifdef __KERNEL__
+
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+#else
+static inline void vmpressure(gfp_t gfp, unsigned long scanned,
+			      unsigned long reclaimed)
+{
+}
+#endif
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_VMPRESSURE_H */
@@ -0,0 +1,129 @@
+/*
+ *  LZ4 block compressor
+ *
+ *  Single pass, greedy matcher over a 4096 entry hash table of input
+ *  positions. Output is the standard LZ4 block format, so anything that
+ *  understands LZ4 blocks can decode it.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+
+	return op;
+}
+
+static unsigned char *lz4_put_literals(unsigned char *op,
+		const unsigned char *anchor, size_t lit_len)
+{
+	unsigned char *token = op++;
+
+	if (lit_len >= LZ4_RUN_MASK) {
+		*token = LZ4_RUN_MASK << LZ4_ML_BITS;
+		op = lz4_put_length(op, lit_len - LZ4_RUN_MASK);
+	} else {
+		*token = lit_len << LZ4_ML_BITS;
+	}
+
+	memcpy(op, anchor, lit_len);
+
+	return op + lit_len;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char *const ip_end = src + src_len;
+	const unsigned char *const mf_limit = ip_end - LZ4_MFLIMIT;
+	const unsigned char *const match_limit = ip_end - LZ4_LASTLITERALS;
+	unsigned char *op = dst;
+	u32 *table = wrkmem;
+
+	if (src_len < LZ4_MFLIMIT + 1)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+
+	while (ip <= mf_limit) {
+		const unsigned char *ref;
+		unsigned char *token;
+		size_t lit_len, match_len;
+		u32 seq, h;
+
+		seq = get_unaligned((const u32 *)ip);
+		h = lz4_hash(seq);
+		ref = src + table[h];
+		table[h] = ip - src;
+
+		if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE ||
+				get_unaligned((const u32 *)ref) != seq) {
+			ip += 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER);
+			continue;
+		}
+
+		/* Extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		token = op;
+		lit_len = ip - anchor;
+		op = lz4_put_literals(op, anchor, lit_len);
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		ip += LZ4_MINMATCH;
+		ref += LZ4_MINMATCH;
+		while (ip < match_limit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		match_len = ip - anchor - lit_len - LZ4_MINMATCH;
+		if (match_len >= LZ4_ML_MASK) {
+			*token |= LZ4_ML_MASK;
+			op = lz4_put_length(op, match_len - LZ4_ML_MASK);
+		} else {
+			*token |= match_len;
+		}
+
+		anchor = ip;
+		if (ip <= mf_limit)
+			table[lz4_hash(get_unaligned((const u32 *)(ip - 2)))] =
+				ip - 2 - src;
+	}
+
+last_literals:
+	op = lz4_put_literals(op, anchor, ip_end - anchor);
+	*dst_len = op - dst;
+
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
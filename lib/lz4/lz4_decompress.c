@@ -0,0 +1,117 @@
+/*
+ *  LZ4 block decompressor
+ *
+ *  Every length, offset and copy is checked against both the input and
+ *  the output buffer, so corrupted input can not overrun either.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read the extra length bytes that follow a saturated token nibble.
+ * Returns NULL if the input ends before the length does.
+ */
+static inline const unsigned char *lz4_get_length(const unsigned char *ip,
+		const unsigned char *ip_end, size_t *len)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= ip_end))
+			return NULL;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	return ip;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char *const ip_end = src + src_len;
+	unsigned char *op = dst;
+	unsigned char *const op_end = dst + *dst_len;
+
+	while (ip < ip_end) {
+		const unsigned char *ref;
+		unsigned int token;
+		size_t len, offset;
+
+		token = *ip++;
+
+		len = token >> LZ4_ML_BITS;
+		if (len == LZ4_RUN_MASK) {
+			ip = lz4_get_length(ip, ip_end, &len);
+			if (unlikely(!ip))
+				goto input_overrun;
+		}
+		if (unlikely(len > (size_t)(ip_end - ip)))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence carries literals only */
+		if (ip == ip_end)
+			break;
+
+		if (unlikely(ip_end - ip < 2))
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			goto lookbehind_overrun;
+
+		len = token & LZ4_ML_MASK;
+		if (len == LZ4_ML_MASK) {
+			ip = lz4_get_length(ip, ip_end, &len);
+			if (unlikely(!ip))
+				goto input_overrun;
+		}
+		len += LZ4_MINMATCH;
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+
+		ref = op - offset;
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* Overlapping copy replicates the last 'offset' bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+input_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
@@ -0,0 +1,22 @@
+/*
+ *  lz4defs.h -- architecture independent LZ4 definitions
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_MINMATCH		4
+#define LZ4_LASTLITERALS	5	/* last bytes are always literals */
+#define LZ4_MFLIMIT		12	/* last match starts before this */
+#define LZ4_MAX_DISTANCE	65535
+
+#define LZ4_ML_BITS		4
+#define LZ4_ML_MASK		((1U << LZ4_ML_BITS) - 1)
+#define LZ4_RUN_MASK		((1U << (8 - LZ4_ML_BITS)) - 1)
+
+#define LZ4_HASH_LOG		12
+#define LZ4_HASH_SIZE		(1U << LZ4_HASH_LOG)
+
+/* Skip ahead faster through data that does not compress */
+#define LZ4_SKIP_TRIGGER	6
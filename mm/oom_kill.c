@@ -38,6 +38,80 @@ int sysctl_oom_kill_allocating_task;
 int sysctl_oom_dump_tasks = 1;
 static DEFINE_SPINLOCK(zone_scan_lock);
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+DEFINE_SPINLOCK(oom_adj_bucket_lock);
+EXPORT_SYMBOL(oom_adj_bucket_lock);
+struct hlist_head oom_adj_buckets[OOM_ADJ_BUCKETS];
+EXPORT_SYMBOL(oom_adj_buckets);
+
+static inline struct hlist_head *oom_adj_bucket(struct task_struct *p)
+{
+	int adj = clamp(p->signal->oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+
+	return &oom_adj_buckets[adj - OOM_DISABLE];
+}
+
+/*
+ * oom_adj_bucket_add - index a new thread group leader by its oom_adj.
+ * Called from copy_process() with tasklist_lock write-held.
+ */
+void oom_adj_bucket_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	hlist_add_head(&p->oom_adj_node, oom_adj_bucket(p));
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+/*
+ * oom_adj_bucket_del - drop an exiting thread group leader from its bucket.
+ * Called from __unhash_process() with tasklist_lock write-held.
+ */
+void oom_adj_bucket_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	if (!hlist_unhashed(&p->oom_adj_node))
+		hlist_del_init(&p->oom_adj_node);
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+/*
+ * oom_adj_bucket_update - move p's thread group to the bucket for its new
+ * oom_adj. Called with p's sighand lock held after signal->oom_adj changed.
+ */
+void oom_adj_bucket_update(struct task_struct *p)
+{
+	struct task_struct *leader = p->group_leader;
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	if (!hlist_unhashed(&leader->oom_adj_node)) {
+		hlist_del(&leader->oom_adj_node);
+		hlist_add_head(&leader->oom_adj_node, oom_adj_bucket(leader));
+	}
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+/*
+ * oom_adj_bucket_replace - hand the bucket entry of an old thread group
+ * leader over to the thread that replaced it in de_thread().
+ */
+void oom_adj_bucket_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	if (!hlist_unhashed(&old->oom_adj_node)) {
+		hlist_del_init(&old->oom_adj_node);
+		hlist_add_head(&new->oom_adj_node, oom_adj_bucket(new));
+	}
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+#endif
+
 /**
  * test_set_oom_score_adj() - set current's oom_score_adj and return old value
  * @new_val: new oom_score_adj value
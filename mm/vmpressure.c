@@ -0,0 +1,245 @@
+/* mm/vmpressure.c
+ *
+ * Memory pressure notification
+ *
+ * Reclaim reports how many pages it scanned and how many of those it
+ * managed to reclaim. Once a window's worth of pages has been scanned,
+ * the ratio is combined with the free and file page counts the low memory
+ * killer looks at into a pressure level. Level changes are queued as
+ * events for readers of /dev/vmpressure, so userspace can trim its caches
+ * before direct reclaim and the low memory killer have to step in.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/uaccess.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+#include <linux/vmpressure.h>
+
+/* Pages to scan before the scanned/reclaimed ratio is evaluated */
+static unsigned long window = SWAP_CLUSTER_MAX * 16;
+module_param(window, ulong, S_IRUGO | S_IWUSR);
+
+/* Percent of scanned pages not reclaimed that make up each level */
+static unsigned int medium = 60;
+module_param(medium, uint, S_IRUGO | S_IWUSR);
+static unsigned int critical = 95;
+module_param(critical, uint, S_IRUGO | S_IWUSR);
+
+/*
+ * Free and file page counts below which a level is reported regardless of
+ * the reclaim ratio, in the style of the low memory killer's minfree.
+ */
+static unsigned int medium_minfree = 16 * 1024;
+module_param(medium_minfree, uint, S_IRUGO | S_IWUSR);
+static unsigned int critical_minfree = 4 * 1024;
+module_param(critical_minfree, uint, S_IRUGO | S_IWUSR);
+
+/* Reclaim accounting for the current window, protected by vmpr_lock */
+static DEFINE_SPINLOCK(vmpr_lock);
+static unsigned long vmpr_scanned;
+static unsigned long vmpr_reclaimed;
+
+/* Last published event, protected by vmpr_event_lock */
+static DEFINE_SPINLOCK(vmpr_event_lock);
+static struct vmpressure_event vmpr_event;
+static DECLARE_WAIT_QUEUE_HEAD(vmpr_wait);
+
+/*
+ * struct vmpressure_reader - an open /dev/vmpressure
+ *
+ * 'seq' is the sequence number of the last event this reader consumed.
+ */
+struct vmpressure_reader {
+	u32 seq;
+};
+
+static unsigned int vmpressure_calc_level(unsigned int pressure,
+					  unsigned long free,
+					  unsigned long file)
+{
+	if (pressure >= critical ||
+	    (free < critical_minfree && file < critical_minfree))
+		return VMPRESSURE_CRITICAL;
+	if (pressure >= medium ||
+	    (free < medium_minfree && file < medium_minfree))
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	unsigned long scanned, reclaimed;
+	unsigned long free, file;
+	unsigned int pressure, level;
+
+	spin_lock(&vmpr_lock);
+	scanned = vmpr_scanned;
+	reclaimed = vmpr_reclaimed;
+	vmpr_scanned = 0;
+	vmpr_reclaimed = 0;
+	spin_unlock(&vmpr_lock);
+
+	if (!scanned)
+		return;
+
+	/* reclaim can free more than it scanned, e.g. through slab */
+	reclaimed = min(reclaimed, scanned);
+	pressure = 100 - (reclaimed * 100 / scanned);
+
+	free = global_page_state(NR_FREE_PAGES);
+	file = global_page_state(NR_FILE_PAGES) - global_page_state(NR_SHMEM);
+	level = vmpressure_calc_level(pressure, free, file);
+
+	spin_lock(&vmpr_event_lock);
+	if (level == vmpr_event.level && vmpr_event.seq) {
+		spin_unlock(&vmpr_event_lock);
+		return;
+	}
+	vmpr_event.seq++;
+	vmpr_event.level = level;
+	vmpr_event.pressure = pressure;
+	vmpr_event.free = free;
+	vmpr_event.file = file;
+	spin_unlock(&vmpr_event_lock);
+
+	wake_up_interruptible(&vmpr_wait);
+}
+static DECLARE_WORK(vmpressure_work, vmpressure_work_fn);
+
+/*
+ * vmpressure - account a round of reclaim. Called from shrink_zone() for
+ * global reclaim, both from kswapd and from direct reclaim.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	/* only reclaim that can do I/O tells us anything useful */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpr_lock);
+	vmpr_scanned += scanned;
+	vmpr_reclaimed += reclaimed;
+	scanned = vmpr_scanned;
+	spin_unlock(&vmpr_lock);
+
+	if (scanned >= window)
+		schedule_work(&vmpressure_work);
+}
+
+static int vmpressure_open(struct inode *inode, struct file *file)
+{
+	struct vmpressure_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	/* only events after open are reported */
+	spin_lock(&vmpr_event_lock);
+	reader->seq = vmpr_event.seq;
+	spin_unlock(&vmpr_event_lock);
+
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+}
+
+static int vmpressure_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static int vmpressure_pending(struct vmpressure_reader *reader)
+{
+	return ACCESS_ONCE(vmpr_event.seq) != reader->seq;
+}
+
+/*
+ * vmpressure_read - returns the latest event as a struct vmpressure_event.
+ * Blocks until there is an event the reader has not seen yet, unless
+ * O_NONBLOCK is set. Events that were superseded before the reader got to
+ * them are skipped; the gap in 'seq' tells the reader so.
+ */
+static ssize_t vmpressure_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *pos)
+{
+	struct vmpressure_reader *reader = file->private_data;
+	struct vmpressure_event event;
+	int ret;
+
+	if (count < sizeof(event))
+		return -EINVAL;
+
+	if (!vmpressure_pending(reader)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(vmpr_wait,
+					       vmpressure_pending(reader));
+		if (ret)
+			return ret;
+	}
+
+	spin_lock(&vmpr_event_lock);
+	event = vmpr_event;
+	spin_unlock(&vmpr_event_lock);
+	reader->seq = event.seq;
+
+	if (copy_to_user(buf, &event, sizeof(event)))
+		return -EFAULT;
+	return sizeof(event);
+}
+
+static unsigned int vmpressure_poll(struct file *file, poll_table *wait)
+{
+	struct vmpressure_reader *reader = file->private_data;
+
+	poll_wait(file, &vmpr_wait, wait);
+	if (vmpressure_pending(reader))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations vmpressure_fops = {
+	.owner = THIS_MODULE,
+	.open = vmpressure_open,
+	.release = vmpressure_release,
+	.read = vmpressure_read,
+	.poll = vmpressure_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice vmpressure_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "vmpressure",
+	.fops = &vmpressure_fops,
+};
+
+static int __init vmpressure_init(void)
+{
+	int ret;
+
+	ret = misc_register(&vmpressure_misc);
+	if (unlikely(ret))
+		printk(KERN_ERR "vmpressure: failed to register misc device!\n");
+	return ret;
+}
+module_init(vmpressure_init);
@@ -43,6 +43,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/vmpressure.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -1970,6 +1971,10 @@ restart:
 	}
 	sc->nr_reclaimed += nr_reclaimed;
 
+	if (scanning_global_lru(sc))
+		vmpressure(sc->gfp_mask, sc->nr_scanned - nr_scanned,
+			   nr_reclaimed);
+
 	/*
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
@@ -15,6 +15,7 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
@@ -178,15 +179,16 @@ static struct proc_dir_entry *iface_stat_all_procfile;
  * qtaguid_mt()
  *   account_for_uid()
  *     if_tag_stat_update()
+ *       get_iface_entry_by_dev()
+ *         (iface_stat_ifindex_hash, RCU)
+ *         iface_stat_list_lock, only on a hash miss
  *       get_sock_stat()
- *         sock_tag_list_lock
+ *         (sock_tag_hash, RCU)
  *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *         (struct iface_stat->tag_stat_tree)
+ *       tag_stat_update(), RCU
+ *         get_active_counter_set()
+ *           tag_counter_set_list_lock
  *
  *
  * qtaguid_ctrl_parse()
@@ -214,9 +216,23 @@ static struct proc_dir_entry *iface_stat_all_procfile;
 static LIST_HEAD(iface_stat_list);
 static DEFINE_SPINLOCK(iface_stat_list_lock);
 
+/*
+ * Per packet lookup of iface_stats by ifindex. Updated under
+ * iface_stat_list_lock, walked under RCU. iface_stats are never freed.
+ */
+#define IFACE_STAT_HASH_BITS 4
+static struct hlist_head iface_stat_ifindex_hash[1 << IFACE_STAT_HASH_BITS];
+
 static struct rb_root sock_tag_tree = RB_ROOT;
 static DEFINE_SPINLOCK(sock_tag_list_lock);
 
+/*
+ * Per packet lookup of sock_tags by sk. Updated along with sock_tag_tree
+ * under sock_tag_list_lock, walked under RCU.
+ */
+#define SOCK_TAG_HASH_BITS 8
+static struct hlist_head sock_tag_hash[1 << SOCK_TAG_HASH_BITS];
+
 static struct rb_root tag_counter_set_tree = RB_ROOT;
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
 
@@ -408,6 +424,26 @@ static void sock_tag_tree_insert(struct sock_tag *data, struct rb_root *root)
 	rb_insert_color(&data->sock_node, root);
 }
 
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_add(struct sock_tag *st_entry)
+{
+	sock_tag_tree_insert(st_entry, &sock_tag_tree);
+	hlist_add_head_rcu(&st_entry->hash_node,
+			   &sock_tag_hash[hash_ptr(st_entry->sk,
+						   SOCK_TAG_HASH_BITS)]);
+}
+
+/*
+ * The entry must still be freed with kfree_rcu(), as the per packet path
+ * might be looking at it.
+ * Caller must hold sock_tag_list_lock
+ */
+static void sock_tag_del(struct sock_tag *st_entry)
+{
+	rb_erase(&st_entry->sock_node, &sock_tag_tree);
+	hlist_del_rcu(&st_entry->hash_node);
+}
+
 static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 {
 	struct rb_node *node;
@@ -424,7 +460,7 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
@@ -777,6 +813,54 @@ done:
 	return iface_entry;
 }
 
+/*
+ * Find the entry for tracking @dev from the per packet path.
+ * The ifindex hash only ever misses for an entry being rehashed, or one
+ * for a device renamed since; fall back to the name lookup then.
+ */
+static struct iface_stat *get_iface_entry_by_dev(const struct net_device *dev)
+{
+	struct iface_stat *iface_entry;
+	struct hlist_head *head;
+	struct hlist_node *pos;
+
+	head = &iface_stat_ifindex_hash[hash_32(dev->ifindex,
+						IFACE_STAT_HASH_BITS)];
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(iface_entry, pos, head, ifindex_node) {
+		if (iface_entry->ifindex == dev->ifindex &&
+		    !strcmp(iface_entry->ifname, dev->name)) {
+			rcu_read_unlock();
+			return iface_entry;
+		}
+	}
+	rcu_read_unlock();
+
+	spin_lock_bh(&iface_stat_list_lock);
+	iface_entry = get_iface_entry(dev->name);
+	spin_unlock_bh(&iface_stat_list_lock);
+	return iface_entry;
+}
+
+/*
+ * (Re)index the entry by the ifindex of the net_dev now behind its name.
+ * Caller must hold iface_stat_list_lock
+ */
+static void iface_stat_set_ifindex(struct iface_stat *entry,
+				   struct net_device *net_dev)
+{
+	if (entry->ifindex == net_dev->ifindex &&
+	    !hlist_unhashed(&entry->ifindex_node))
+		return;
+
+	if (!hlist_unhashed(&entry->ifindex_node))
+		hlist_del_rcu(&entry->ifindex_node);
+	entry->ifindex = net_dev->ifindex;
+	hlist_add_head_rcu(&entry->ifindex_node,
+			   &iface_stat_ifindex_hash[hash_32(entry->ifindex,
+							IFACE_STAT_HASH_BITS)]);
+}
+
 static int iface_stat_all_proc_read(char *page, char **num_items_returned,
 				    off_t items_to_skip, int char_count,
 				    int *eof, void *data)
@@ -942,6 +1026,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
 	list_add(&new_iface->list, &iface_stat_list);
+	iface_stat_set_ifindex(new_iface, net_dev);
 	return new_iface;
 }
 
@@ -1042,6 +1127,7 @@ static void iface_stat_create(struct net_device *net_dev,
 			 ifname, entry);
 		iface_check_stats_reset_and_adjust(net_dev, entry);
 		_iface_stat_set_active(entry, net_dev, activate);
+		iface_stat_set_ifindex(entry, net_dev);
 		IF_DEBUG("qtaguid: %s(%s): "
 			 "tracking now %d on ip=%pI4\n", __func__,
 			 entry->ifname, activate, &ipaddr);
@@ -1104,6 +1190,7 @@ static void iface_stat_create_ipv6(struct net_device *net_dev,
 			 ifname, entry);
 		iface_check_stats_reset_and_adjust(net_dev, entry);
 		_iface_stat_set_active(entry, net_dev, activate);
+		iface_stat_set_ifindex(entry, net_dev);
 		IF_DEBUG("qtaguid: %s(%s): "
 			 "tracking now %d on ip=%pI6c\n", __func__,
 			 entry->ifname, activate, &ifa->addr);
@@ -1131,22 +1218,36 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
+/*
+ * Lockless variant for the per packet path.
+ * Caller must be in an RCU read side section for as long as it uses the
+ * returned entry.
+ */
 static struct sock_tag *get_sock_stat(const struct sock *sk)
 {
 	struct sock_tag *sock_tag_entry;
+	struct hlist_node *pos;
 	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
 	if (!sk)
 		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+	hlist_for_each_entry_rcu(sock_tag_entry, pos,
+				 &sock_tag_hash[hash_ptr(sk,
+							 SOCK_TAG_HASH_BITS)],
+				 hash_node) {
+		if (sock_tag_entry->sk == sk)
+			return sock_tag_entry;
+	}
+	return NULL;
 }
 
+/* Caller must have BHs disabled, and dcc be this CPU's counters */
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct data_counters_cpu *dcc, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
+	struct data_counters *dc = &dcc->dc;
+
+	u64_stats_update_begin(&dcc->syncp);
 	switch (proto) {
 	case IPPROTO_TCP:
 		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
@@ -1160,6 +1261,7 @@ data_counters_update(struct data_counters *dc, int set,
 				    1);
 		break;
 	}
+	u64_stats_update_end(&dcc->syncp);
 }
 
 /*
@@ -1216,20 +1318,37 @@ static void iface_stat_update(struct net_device *net_dev, bool stash_only)
 	spin_unlock_bh(&iface_stat_list_lock);
 }
 
+/*
+ * Caller must be in an RCU read side section from the tag_entry lookup,
+ * ctrl_cmd_delete() only frees tag_stats after a grace period.
+ */
 static void tag_stat_update(struct tag_stat *tag_entry,
 			enum ifs_tx_rx direction, int proto, int bytes)
 {
 	int active_set;
+	int cpu;
 	active_set = get_active_counter_set(tag_entry->tn.tag);
 	MT_DEBUG("qtaguid: tag_stat_update(tag=0x%llx (uid=%u) set=%d "
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	/* Keeps the local softirq off this CPU's counters too */
+	local_bh_disable();
+	cpu = smp_processor_id();
+	data_counters_update(&tag_entry->counters[cpu], active_set, direction,
 			     proto, bytes);
 	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
-				     direction, proto, bytes);
+		data_counters_update(&tag_entry->parent_counters[cpu],
+				     active_set, direction, proto, bytes);
+	local_bh_enable();
+}
+
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kfree(ts_entry->counters);
+	kfree(ts_entry);
 }
 
 /*
@@ -1249,29 +1368,39 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = kzalloc(
+		nr_cpu_ids * sizeof(*new_tag_stat_entry->counters), GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters "
+		       "alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
 done:
 	return new_tag_stat_entry;
 }
 
-static void if_tag_stat_update(const char *ifname, uid_t uid,
+static void if_tag_stat_update(const struct net_device *dev, uid_t uid,
 			       const struct sock *sk, enum ifs_tx_rx direction,
 			       int proto, int bytes)
 {
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
+	struct data_counters_cpu *uid_tag_counters;
 	struct sock_tag *sock_tag_entry;
 	struct iface_stat *iface_entry;
-	struct tag_stat *new_tag_stat;
+	struct tag_stat *new_tag_stat = NULL;
+	const char *ifname = dev->name;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
 
-	iface_entry = get_iface_entry(ifname);
+	iface_entry = get_iface_entry_by_dev(dev);
 	if (!iface_entry) {
 		pr_err("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
@@ -1285,7 +1414,9 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	/*
 	 * Look for a tagged sock.
 	 * It will have an acct_uid.
+	 * The RCU section also covers the tag_stat updates below.
 	 */
+	rcu_read_lock();
 	sock_tag_entry = get_sock_stat(sk);
 	if (sock_tag_entry) {
 		tag = sock_tag_entry->tag;
@@ -1299,18 +1430,23 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
+	/*
+	 * Loop over tag list under this interface for {acct_tag,uid_tag}.
+	 * The counters are per-CPU, so they are updated after dropping
+	 * the lock; RCU keeps the entry around until then.
+	 */
 	spin_lock_bh(&iface_entry->tag_stat_list_lock);
 
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      tag);
 	if (tag_stat_entry) {
+		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
 		/*
 		 * Updating the {acct_tag, uid_tag} entry handles both stats:
 		 * {0, uid_tag} will also get updated.
 		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
@@ -1324,17 +1460,24 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
 		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
+		if (!new_tag_stat)
+			goto unlock;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
 		new_tag_stat = create_if_tag_stat(iface_entry, tag);
+		if (!new_tag_stat)
+			goto unlock;
 		new_tag_stat->parent_counters = uid_tag_counters;
 	}
-	tag_stat_update(new_tag_stat, direction, proto, bytes);
+unlock:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	if (new_tag_stat)
+		tag_stat_update(new_tag_stat, direction, proto, bytes);
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -1566,7 +1709,7 @@ static void account_for_uid(const struct sk_buff *skb,
 			 el_dev->name,
 			 el_dev->type);
 
-		if_tag_stat_update(el_dev->name, uid,
+		if_tag_stat_update(el_dev, uid,
 				skb->sk ? skb->sk : alternate_sk,
 				par->in ? IFS_RX : IFS_TX,
 				ip_hdr(skb)->protocol, skb->len);
@@ -1913,7 +2056,7 @@ static int ctrl_cmd_delete(const char *input)
 			 input, st_entry->tag, entry_uid);
 
 		if (!acct_tag || st_entry->tag == tag) {
-			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_del(st_entry);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -1977,7 +2120,7 @@ static int ctrl_cmd_delete(const char *input)
 					 entry_uid);
 				rb_erase(&ts_entry->tn.node,
 					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2082,7 +2225,7 @@ static int ctrl_cmd_tag(const char *input)
 	tag_t full_tag;
 	struct socket *el_socket;
 	int res, argc;
-	struct sock_tag *sock_tag_entry;
+	struct sock_tag *sock_tag_entry, *new_sock_tag_entry;
 	struct tag_ref *tag_ref_entry;
 	struct uid_tag_data *uid_tag_data_entry;
 	struct proc_qtu_data *pqd_entry;
@@ -2130,12 +2273,26 @@ static int ctrl_cmd_tag(const char *input)
 	}
 	full_tag = combine_atag_with_uid(acct_tag, uid);
 
+	/*
+	 * Hashed sock_tags are not modified in place, so a retag needs a
+	 * new entry just as a first tagging does.
+	 */
+	new_sock_tag_entry = kzalloc(sizeof(*new_sock_tag_entry), GFP_KERNEL);
+	if (!new_sock_tag_entry) {
+		pr_err("qtaguid: ctrl_tag(%s): "
+		       "socket tag alloc failed\n",
+		       input);
+		res = -ENOMEM;
+		goto err_put;
+	}
+
 	spin_lock_bh(&sock_tag_list_lock);
 	sock_tag_entry = get_sock_stat_nl(el_socket->sk);
 	tag_ref_entry = get_tag_ref(full_tag, &uid_tag_data_entry);
 	if (IS_ERR(tag_ref_entry)) {
 		res = PTR_ERR(tag_ref_entry);
 		spin_unlock_bh(&sock_tag_list_lock);
+		kfree(new_sock_tag_entry);
 		goto err_put;
 	}
 	tag_ref_entry->num_sock_tags++;
@@ -2158,20 +2315,27 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
-		sock_tag_entry->tag = full_tag;
+
+		*new_sock_tag_entry = *sock_tag_entry;
+		new_sock_tag_entry->tag = full_tag;
+		rb_replace_node(&sock_tag_entry->sock_node,
+				&new_sock_tag_entry->sock_node,
+				&sock_tag_tree);
+		hlist_replace_rcu(&sock_tag_entry->hash_node,
+				  &new_sock_tag_entry->hash_node);
+		/* See the list hack in ctrl_cmd_delete() */
+		if (sock_tag_entry->list.next && sock_tag_entry->list.prev) {
+			spin_lock_bh(&uid_tag_data_tree_lock);
+			list_replace(&sock_tag_entry->list,
+				     &new_sock_tag_entry->list);
+			spin_unlock_bh(&uid_tag_data_tree_lock);
+		}
+		kfree_rcu(sock_tag_entry, rcu);
+		sock_tag_entry = new_sock_tag_entry;
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
-		sock_tag_entry = kzalloc(sizeof(*sock_tag_entry),
-					 GFP_ATOMIC);
-		if (!sock_tag_entry) {
-			pr_err("qtaguid: ctrl_tag(%s): "
-			       "socket tag alloc failed\n",
-			       input);
-			spin_unlock_bh(&sock_tag_list_lock);
-			res = -ENOMEM;
-			goto err_tag_unref_put;
-		}
+		sock_tag_entry = new_sock_tag_entry;
 		sock_tag_entry->sk = el_socket->sk;
 		sock_tag_entry->socket = el_socket;
 		sock_tag_entry->pid = current->tgid;
@@ -2197,7 +2361,7 @@ static int ctrl_cmd_tag(const char *input)
 				 &pqd_entry->sock_tag_list);
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
-		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_add(sock_tag_entry);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2207,10 +2371,6 @@ static int ctrl_cmd_tag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count));
 	return 0;
 
-err_tag_unref_put:
-	BUG_ON(tag_ref_entry->num_sock_tags <= 0);
-	tag_ref_entry->num_sock_tags--;
-	free_tag_ref_from_utd_entry(tag_ref_entry, uid_tag_data_entry);
 err_put:
 	CT_DEBUG("qtaguid: ctrl_tag(%s): done. ...->f_count=%ld\n",
 		 input, atomic_long_read(&el_socket->file->f_count) - 1);
@@ -2261,7 +2421,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * The socket already belongs to the current process
 	 * so it can do whatever it wants to it.
 	 */
-	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_del(sock_tag_entry);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2298,7 +2458,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2374,6 +2534,8 @@ struct proc_print_info {
 	char **num_items_returned;
 	struct iface_stat *iface_entry;
 	struct tag_stat *ts_entry;
+	/* ts_entry's per-CPU counters, folded */
+	struct data_counters counters;
 	int item_index;
 	int items_to_skip;
 	int char_count;
@@ -2412,7 +2574,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		cnts = &ppi->counters;
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2453,6 +2615,8 @@ static bool pp_sets(struct proc_print_info *ppi)
 {
 	int len;
 	int counter_set;
+
+	data_counters_fold(&ppi->counters, ppi->ts_entry->counters);
 	for (counter_set = 0; counter_set < IFS_MAX_COUNTER_SETS;
 	     counter_set++) {
 		len = pp_stats_line(ppi, counter_set);
@@ -2656,7 +2820,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		tr->num_sock_tags--;
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
-		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_del(st_entry);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
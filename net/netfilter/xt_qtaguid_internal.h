@@ -11,8 +11,13 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/cpumask.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
 #include <linux/spinlock_types.h>
+#include <linux/string.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -179,6 +184,44 @@ struct data_counters {
 	struct byte_packet_counters bpc[IFS_MAX_COUNTER_SETS][IFS_MAX_DIRECTIONS][IFS_MAX_PROTOS];
 };
 
+/*
+ * One CPU's share of a tag_stat's counters, in an array indexed by CPU.
+ * Only that CPU updates it, with BHs disabled, so the per packet path
+ * needs no lock; readers fold all the CPUs with data_counters_fold().
+ */
+struct data_counters_cpu {
+	struct data_counters dc;
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+static inline void data_counters_fold(struct data_counters *res,
+				      const struct data_counters_cpu *counters)
+{
+	int cpu, set, dir, proto;
+	unsigned int start;
+	struct data_counters snap;
+
+	memset(res, 0, sizeof(*res));
+	for_each_possible_cpu(cpu) {
+		const struct data_counters_cpu *dcc = &counters[cpu];
+
+		do {
+			start = u64_stats_fetch_begin_bh(&dcc->syncp);
+			snap = dcc->dc;
+		} while (u64_stats_fetch_retry_bh(&dcc->syncp, start));
+
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS;
+				     proto++) {
+					res->bpc[set][dir][proto].bytes +=
+					  snap.bpc[set][dir][proto].bytes;
+					res->bpc[set][dir][proto].packets +=
+					  snap.bpc[set][dir][proto].packets;
+				}
+	}
+}
+
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
 	struct rb_node node;
@@ -187,16 +230,25 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	/* nr_cpu_ids entries, see struct data_counters_cpu */
+	struct data_counters_cpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct data_counters_cpu *parent_counters;
+	/* The per packet path uses tag_stats after dropping the lock */
+	struct rcu_head rcu;
 };
 
 struct iface_stat {
 	struct list_head list;  /* in iface_stat_list */
+	/*
+	 * In iface_stat_ifindex_hash, by the ifindex of the net_dev last
+	 * seen active under ifname.
+	 */
+	struct hlist_node ifindex_node;
+	int ifindex;
 	char *ifname;
 	bool active;
 	/* net_dev is only valid for active iface_stat */
@@ -235,6 +287,12 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	/*
+	 * In sock_tag_hash, for the per packet lookup under RCU. Hashed
+	 * entries are never modified: a retag replaces the entry.
+	 */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
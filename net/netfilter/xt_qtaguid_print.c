@@ -155,6 +155,7 @@ char *pp_tag_stat(struct tag_stat *ts)
 	char *counters_str;
 	char *parent_counters_str;
 	char *res;
+	struct data_counters dc;
 
 	if (!ts) {
 		res = kasprintf(GFP_ATOMIC, "tag_stat@null{}");
@@ -162,8 +163,14 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	data_counters_fold(&dc, ts->counters);
+	counters_str = pp_data_counters(&dc, true);
+	if (ts->parent_counters) {
+		data_counters_fold(&dc, ts->parent_counters);
+		parent_counters_str = pp_data_counters(&dc, false);
+	} else {
+		parent_counters_str = pp_data_counters(NULL, false);
+	}
 	res = kasprintf(GFP_ATOMIC,
 			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
 			ts, tn_str, counters_str, parent_counters_str);
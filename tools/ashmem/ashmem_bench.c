@@ -0,0 +1,253 @@
+/*
+ * ashmem_bench - ashmem pin/unpin scalability under shrinker load
+ *
+ * Starts N threads, each owning a mapped ashmem region, that unpin and
+ * pin back random page ranges as fast as they can.  With -p another
+ * thread keeps calling ASHMEM_PURGE_ALL_CACHES, which runs the ashmem
+ * shrinker over every unpinned range, the way memory pressure would.
+ * Prints pin/unpin pairs per second, the p50/p99 latency of a pair and
+ * how many pins found their range purged.
+ *
+ * -p needs CAP_SYS_ADMIN.  Build with CROSS_COMPILE set to the target
+ * toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* From include/linux/ashmem.h */
+#define ASHMEM_NAME_LEN		256
+#define ASHMEM_WAS_PURGED	1
+
+struct ashmem_pin {
+	__u32 offset;
+	__u32 len;
+};
+
+#define __ASHMEMIOC		0x77
+#define ASHMEM_SET_NAME		_IOW(__ASHMEMIOC, 1, char[ASHMEM_NAME_LEN])
+#define ASHMEM_SET_SIZE		_IOW(__ASHMEMIOC, 3, size_t)
+#define ASHMEM_PIN		_IOW(__ASHMEMIOC, 7, struct ashmem_pin)
+#define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
+#define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+
+#define ASHMEM_DEV	"/dev/ashmem"
+#define MAX_RUN		16
+
+static int nr_threads = 4;
+static int region_pages = 256;
+static int duration = 10;
+static int purge;
+static long page_size;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	uint64_t *lat;
+	size_t nr_lat, max_lat;
+	unsigned long ops, purged;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int ashmem_create(int id, size_t size)
+{
+	char name[ASHMEM_NAME_LEN];
+	int fd;
+
+	fd = open(ASHMEM_DEV, O_RDWR);
+	if (fd < 0)
+		die(ASHMEM_DEV);
+	snprintf(name, sizeof(name), "ashmem_bench-%d", id);
+	if (ioctl(fd, ASHMEM_SET_NAME, name) < 0)
+		die("ASHMEM_SET_NAME");
+	if (ioctl(fd, ASHMEM_SET_SIZE, size) < 0)
+		die("ASHMEM_SET_SIZE");
+	return fd;
+}
+
+static void *pin_worker(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = (size_t)region_pages * page_size;
+	unsigned int seed = w->id;
+	struct ashmem_pin pin;
+	char *map;
+	int fd;
+
+	fd = ashmem_create(w->id, size);
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		die("mmap");
+	memset(map, 0xa5, size);
+
+	while (!stop) {
+		int first = rand_r(&seed) % region_pages;
+		int run = 1 + rand_r(&seed) % MAX_RUN;
+		uint64_t t0;
+		int ret;
+
+		if (first + run > region_pages)
+			run = region_pages - first;
+		pin.offset = first * page_size;
+		pin.len = run * page_size;
+
+		t0 = now_ns();
+		if (ioctl(fd, ASHMEM_UNPIN, &pin) < 0)
+			die("ASHMEM_UNPIN");
+		ret = ioctl(fd, ASHMEM_PIN, &pin);
+		if (ret < 0)
+			die("ASHMEM_PIN");
+		if (w->nr_lat < w->max_lat)
+			w->lat[w->nr_lat++] = now_ns() - t0;
+		w->ops++;
+		if (ret == ASHMEM_WAS_PURGED) {
+			w->purged++;
+			memset(map + pin.offset, 0xa5, pin.len);
+		}
+	}
+
+	munmap(map, size);
+	close(fd);
+	return NULL;
+}
+
+static void *purge_loop(void *arg)
+{
+	unsigned long *passes = arg;
+	int fd;
+
+	fd = ashmem_create(-1, page_size);
+	while (!stop) {
+		if (ioctl(fd, ASHMEM_PURGE_ALL_CACHES) < 0)
+			die("ASHMEM_PURGE_ALL_CACHES");
+		(*passes)++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-n region pages] "
+		"[-d seconds] [-p]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	pthread_t purger;
+	unsigned long passes = 0, purged = 0, ops = 0;
+	uint64_t *lat;
+	size_t total = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:n:d:p")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			region_pages = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'p':
+			purge = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || region_pages < 1 || duration < 1)
+		usage(argv[0]);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].max_lat = 1 << 20;
+		workers[i].lat = malloc(workers[i].max_lat * sizeof(uint64_t));
+		if (!workers[i].lat)
+			die("malloc");
+		if (pthread_create(&workers[i].thread, NULL, pin_worker,
+				   &workers[i]))
+			die("pthread_create");
+	}
+	if (purge && pthread_create(&purger, NULL, purge_loop, &passes))
+		die("pthread_create");
+
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].nr_lat;
+		ops += workers[i].ops;
+		purged += workers[i].purged;
+	}
+	if (purge)
+		pthread_join(purger, NULL);
+	if (!total) {
+		fprintf(stderr, "no pin/unpin completed\n");
+		return 1;
+	}
+
+	lat = malloc(total * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+	for (total = 0, i = 0; i < nr_threads; i++) {
+		memcpy(lat + total, workers[i].lat,
+		       workers[i].nr_lat * sizeof(*lat));
+		total += workers[i].nr_lat;
+	}
+	qsort(lat, total, sizeof(*lat), cmp_u64);
+
+	printf("threads %d, region %d pages, %d s, purge %s\n",
+	       nr_threads, region_pages, duration, purge ? "on" : "off");
+	printf("%.0f unpin/pin pairs/sec, p50 %.1f us, p99 %.1f us, "
+	       "max %.1f us\n", (double)ops / duration,
+	       lat[total / 2] / 1e3, lat[total * 99 / 100] / 1e3,
+	       lat[total - 1] / 1e3);
+	if (purge)
+		printf("%lu purge passes, %lu pins found their range purged\n",
+		       passes, purged);
+	return 0;
+}
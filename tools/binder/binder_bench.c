@@ -0,0 +1,351 @@
+/*
+ * binder_bench - binder transaction throughput and latency
+ *
+ * Forks one server process that becomes the context manager and runs
+ * one looper thread per client, then N client processes that each send
+ * synchronous transactions to handle 0 and time every round trip.  The
+ * server echoes the payload back in its reply.  When all clients are
+ * done the total transactions/sec and the 50th/99th percentile round
+ * trip latency are printed.
+ *
+ * The context manager can only be claimed once, so servicemanager (and
+ * everything using it) has to be stopped before running this on a
+ * device.  Build with CROSS_COMPILE set to the target toolchain; the
+ * binder ABI depends on the kernel's word size.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV	"/dev/binder"
+#define BINDER_VM_SIZE	(1024 * 1024)
+#define BENCH_CODE	1
+
+static int nr_pairs = 2;
+static long iterations = 10000;
+static size_t payload_size = 128;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int binder_open(void)
+{
+	struct binder_version vers;
+	int fd;
+
+	fd = open(BINDER_DEV, O_RDWR);
+	if (fd < 0)
+		die(BINDER_DEV);
+	if (ioctl(fd, BINDER_VERSION, &vers) < 0)
+		die("BINDER_VERSION");
+	if (vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol %ld, built for %d\n",
+			vers.protocol_version, BINDER_CURRENT_PROTOCOL_VERSION);
+		exit(1);
+	}
+	if (mmap(NULL, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) ==
+			MAP_FAILED)
+		die("mmap");
+	return fd;
+}
+
+static void binder_write(int fd, const void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0)
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+}
+
+/*
+ * Reads until a BR_TRANSACTION or BR_REPLY arrives and copies it to @tr.
+ * The driver ends a read after queueing one transaction, so nothing that
+ * follows it in the buffer is lost.  Returns the command.
+ */
+static uint32_t binder_wait(int fd, struct binder_transaction_data *tr)
+{
+	uint32_t rbuf[64];
+	struct binder_write_read bwr;
+
+	for (;;) {
+		char *p, *end;
+
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = sizeof(rbuf);
+		bwr.read_buffer = (unsigned long)rbuf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("BINDER_WRITE_READ");
+		}
+
+		p = (char *)rbuf;
+		end = p + bwr.read_consumed;
+		while (p < end) {
+			uint32_t cmd;
+
+			memcpy(&cmd, p, sizeof(cmd));
+			p += sizeof(cmd);
+			switch (cmd) {
+			case BR_NOOP:
+			case BR_TRANSACTION_COMPLETE:
+			case BR_SPAWN_LOOPER:
+				break;
+			case BR_TRANSACTION:
+			case BR_REPLY:
+				memcpy(tr, p, sizeof(*tr));
+				return cmd;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+			case BR_ERROR:
+				fprintf(stderr, "binder: error reply %#x\n",
+					cmd);
+				exit(1);
+			default:
+				fprintf(stderr, "binder: unexpected %#x\n",
+					cmd);
+				exit(1);
+			}
+		}
+	}
+}
+
+/* A command word followed by its argument, as the driver parses them */
+struct bb_cmd_txn {
+	uint32_t cmd;
+	struct binder_transaction_data tr;
+} __attribute__((packed));
+
+struct bb_cmd_free {
+	uint32_t cmd;
+	void *buffer;
+} __attribute__((packed));
+
+static void *server_loop(void *arg)
+{
+	int fd = (long)arg;
+	uint32_t enter = BC_ENTER_LOOPER;
+	struct binder_transaction_data tr;
+	struct {
+		struct bb_cmd_txn reply;
+		struct bb_cmd_free free;
+	} __attribute__((packed)) wbuf;
+
+	binder_write(fd, &enter, sizeof(enter));
+	for (;;) {
+		if (binder_wait(fd, &tr) != BR_TRANSACTION)
+			continue;
+
+		/* Echo the payload; the reply copies it before the free */
+		memset(&wbuf, 0, sizeof(wbuf));
+		wbuf.reply.cmd = BC_REPLY;
+		wbuf.reply.tr.code = tr.code;
+		wbuf.reply.tr.data_size = tr.data_size;
+		wbuf.reply.tr.data.ptr.buffer = tr.data.ptr.buffer;
+		wbuf.free.cmd = BC_FREE_BUFFER;
+		wbuf.free.buffer = (void *)tr.data.ptr.buffer;
+		binder_write(fd, &wbuf, sizeof(wbuf));
+	}
+	return NULL;
+}
+
+static void run_server(int ready_fd)
+{
+	pthread_t thread;
+	int fd, i;
+
+	fd = binder_open();
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+
+	for (i = 1; i < nr_pairs; i++)
+		if (pthread_create(&thread, NULL, server_loop, (void *)(long)fd))
+			die("pthread_create");
+
+	if (write(ready_fd, "r", 1) != 1)
+		die("write");
+	close(ready_fd);
+	server_loop((void *)(long)fd);
+}
+
+static void run_client(int start_fd, uint64_t *lat)
+{
+	struct binder_transaction_data tr;
+	struct {
+		struct bb_cmd_free free;
+		struct bb_cmd_txn txn;
+	} __attribute__((packed)) wbuf;
+	void *payload;
+	char c;
+	long i;
+	int fd;
+
+	fd = binder_open();
+	payload = calloc(1, payload_size);
+	if (!payload)
+		die("calloc");
+
+	if (read(start_fd, &c, 1) != 1)
+		die("read");
+
+	memset(&wbuf, 0, sizeof(wbuf));
+	wbuf.txn.cmd = BC_TRANSACTION;
+	wbuf.txn.tr.target.handle = 0;
+	wbuf.txn.tr.code = BENCH_CODE;
+	wbuf.txn.tr.data_size = payload_size;
+	wbuf.txn.tr.data.ptr.buffer = payload;
+
+	for (i = 0; i < iterations; i++) {
+		uint64_t t0 = now_ns();
+
+		/* The previous reply's buffer is freed with the next call */
+		if (i)
+			binder_write(fd, &wbuf, sizeof(wbuf));
+		else
+			binder_write(fd, &wbuf.txn, sizeof(wbuf.txn));
+		if (binder_wait(fd, &tr) != BR_REPLY) {
+			fprintf(stderr, "client: expected a reply\n");
+			exit(1);
+		}
+		lat[i] = now_ns() - t0;
+
+		wbuf.free.cmd = BC_FREE_BUFFER;
+		wbuf.free.buffer = (void *)tr.data.ptr.buffer;
+	}
+	exit(0);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n pairs] [-i iterations] [-s bytes]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int ready[2], start[2], opt, i;
+	pid_t server;
+	uint64_t *lat, t0, t1;
+	size_t total;
+	char c;
+
+	while ((opt = getopt(argc, argv, "n:i:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_pairs = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atol(optarg);
+			break;
+		case 's':
+			payload_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_pairs < 1 || iterations < 1)
+		usage(argv[0]);
+
+	total = (size_t)nr_pairs * iterations;
+	lat = mmap(NULL, total * sizeof(*lat), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (lat == MAP_FAILED)
+		die("mmap");
+
+	if (pipe(ready) || pipe(start))
+		die("pipe");
+
+	server = fork();
+	if (server < 0)
+		die("fork");
+	if (!server) {
+		close(ready[0]);
+		run_server(ready[1]);
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		return 1;
+	}
+
+	for (i = 0; i < nr_pairs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork");
+		if (!pid) {
+			close(start[1]);
+			run_client(start[0], lat + (size_t)i * iterations);
+		}
+	}
+	close(start[0]);
+
+	t0 = now_ns();
+	for (i = 0; i < nr_pairs; i++)
+		if (write(start[1], "s", 1) != 1)
+			die("write");
+	for (i = 0; i < nr_pairs; i++) {
+		int status;
+
+		if (wait(&status) < 0)
+			die("wait");
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "a client failed\n");
+			kill(server, SIGKILL);
+			return 1;
+		}
+	}
+	t1 = now_ns();
+
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+
+	qsort(lat, total, sizeof(*lat), cmp_u64);
+	printf("pairs %d, payload %zu bytes, %zu transactions in %.3f s\n",
+	       nr_pairs, payload_size, total, (t1 - t0) / 1e9);
+	printf("%.0f transactions/sec, latency p50 %.1f us, p99 %.1f us, "
+	       "max %.1f us\n",
+	       total * 1e9 / (t1 - t0), lat[total / 2] / 1e3,
+	       lat[total * 99 / 100] / 1e3, lat[total - 1] / 1e3);
+	return 0;
+}
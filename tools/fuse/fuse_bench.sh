@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# fuse_bench.sh - compare FUSE configurations with fuse_pt
+#
+# Writes and reads back a file directly on the lower directory, then
+# through fuse_pt mounted over it in each configuration below, and
+# prints fuse_io's throughput and CPU cost (ms and, where perf events
+# work, cycles per MB) for every run.  The page cache is dropped before
+# each read.
+#
+# Needs root.
+#
+# usage: fuse_bench.sh <lower dir> <mountpoint> [MB]
+#
+# This program can be distributed under the terms of the GNU GPL v2.
+
+LOWER=$1
+MNT=$2
+MB=${3:-256}
+BIN=$(dirname $0)
+
+[ -d "$LOWER" ] && [ -d "$MNT" ] ||
+	{ echo "usage: $0 <lower dir> <mountpoint> [MB]"; exit 1; }
+
+run_io() {
+	for bs in 4096 65536; do
+		$BIN/fuse_io -b $bs -s $MB $1/fuse_bench.dat || return 1
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+		$BIN/fuse_io -r -b $bs -s $MB $1/fuse_bench.dat || return 1
+	done
+	rm -f $1/fuse_bench.dat
+}
+
+mounted() {
+	grep -q " $MNT fuse" /proc/mounts
+}
+
+run_fuse() {
+	echo "=== fuse_pt $*"
+	$BIN/fuse_pt "$@" $LOWER $MNT &
+	pid=$!
+	i=0
+	while ! mounted; do
+		sleep 1
+		i=$((i + 1))
+		[ $i -lt 10 ] || { echo "fuse_pt did not mount"; exit 1; }
+	done
+	run_io $MNT
+	umount $MNT
+	wait $pid
+}
+
+echo "=== lower filesystem"
+run_io $LOWER
+
+run_fuse
+run_fuse -w
+run_fuse -w -m 256 -W 1048576
+run_fuse -P
+run_fuse -s
+run_fuse -b
+run_fuse -s -b
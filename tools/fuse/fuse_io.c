@@ -0,0 +1,195 @@
+/*
+ * fuse_io - sequential read or write throughput of one file
+ *
+ * Writes -s MB to the file in -b byte blocks and fsyncs it, or with -r
+ * reads it back, and prints MB/s along with the CPU time spent on all
+ * CPUs per MB moved, from /proc/stat.  The CPU figure includes the
+ * FUSE daemon and the kernel work on both sides of /dev/fuse, so it is
+ * the cost of the whole path.  Where perf events are available it also
+ * prints the CPU cycles counted on all CPUs per MB, which is steadier
+ * than tick based CPU time for short runs.  Drop the page cache before
+ * a read run to measure more than memory copies.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#define MAX_CPUS	256
+
+static int cycle_fds[MAX_CPUS];
+static int nr_cycle_fds;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Busy time of all CPUs so far, in clock ticks */
+static unsigned long long cpu_busy(void)
+{
+	unsigned long long v[8] = { 0 };
+	FILE *f;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		die("/proc/stat");
+	if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+		   &v[7]) < 4) {
+		fprintf(stderr, "cannot parse /proc/stat\n");
+		exit(1);
+	}
+	fclose(f);
+	/* Everything but idle and iowait */
+	return v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+}
+
+/*
+ * Opens a cycle counter on every online CPU, counting all tasks.  Gives
+ * up quietly if any of them cannot be opened, e.g. without root or with
+ * perf_event_paranoid set high.
+ */
+static void cycles_open(void)
+{
+	struct perf_event_attr attr;
+	long cpu, nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+
+	for (cpu = 0; cpu < nr_cpus && cpu < MAX_CPUS; cpu++) {
+		int fd = syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+
+		if (fd < 0) {
+			while (nr_cycle_fds)
+				close(cycle_fds[--nr_cycle_fds]);
+			return;
+		}
+		cycle_fds[nr_cycle_fds++] = fd;
+	}
+}
+
+static void cycles_enable(int on)
+{
+	int i;
+
+	for (i = 0; i < nr_cycle_fds; i++)
+		ioctl(cycle_fds[i], on ? PERF_EVENT_IOC_ENABLE :
+		      PERF_EVENT_IOC_DISABLE, 0);
+}
+
+static unsigned long long cycles_read(void)
+{
+	unsigned long long sum = 0, v;
+	int i;
+
+	for (i = 0; i < nr_cycle_fds; i++)
+		if (read(cycle_fds[i], &v, sizeof(v)) == sizeof(v))
+			sum += v;
+	return sum;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r] [-b block bytes] [-s MB] <file>\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t block = 64 * 1024, size = 256, done = 0, total;
+	unsigned long long busy0, busy1;
+	int rd = 0, opt, fd;
+	double t0, t1, mb;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "rb:s:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rd = 1;
+			break;
+		case 'b':
+			block = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !block || !size)
+		usage(argv[0]);
+	total = size << 20;
+
+	buf = malloc(block);
+	if (!buf)
+		die("malloc");
+	memset(buf, 0x5a, block);
+
+	fd = open(argv[optind], rd ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC,
+		  0644);
+	if (fd < 0)
+		die(argv[optind]);
+
+	cycles_open();
+	busy0 = cpu_busy();
+	cycles_enable(1);
+	t0 = now_s();
+	while (done < total) {
+		size_t len = total - done < block ? total - done : block;
+		ssize_t n = rd ? read(fd, buf, len) : write(fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die(rd ? "read" : "write");
+		}
+		if (!n)
+			break;
+		done += n;
+	}
+	if (!rd && fsync(fd))
+		die("fsync");
+	close(fd);
+	t1 = now_s();
+	cycles_enable(0);
+	busy1 = cpu_busy();
+
+	mb = done / (1024.0 * 1024.0);
+	printf("%s %.0f MB in %zu byte blocks: %.1f MB/s, "
+	       "%.2f CPU ms/MB, ", rd ? "read" : "wrote", mb, block,
+	       mb / (t1 - t0),
+	       (busy1 - busy0) * 1000.0 / sysconf(_SC_CLK_TCK) / mb);
+	if (nr_cycle_fds)
+		printf("%.0f cycles/MB\n", cycles_read() / mb);
+	else
+		printf("n/a cycles/MB\n");
+	return 0;
+}
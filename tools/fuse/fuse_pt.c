@@ -0,0 +1,809 @@
+/*
+ * fuse_pt - minimal passthrough daemon for benchmarking FUSE
+ *
+ * Mounts a FUSE filesystem that mirrors the regular files of one flat
+ * directory of a lower filesystem, talking to /dev/fuse directly so
+ * that every protocol feature of this kernel can be switched on from
+ * the command line:
+ *
+ *   -w         ask for the writeback cache (FUSE_WRITEBACK_CACHE)
+ *   -m pages   ask for up to this many pages per request (FUSE_MAX_PAGES)
+ *   -W bytes   max_write
+ *   -P         serve reads and writes from the lower file (FUSE_PASSTHROUGH)
+ *   -s         read requests with splice(2), and splice WRITE data on to
+ *              the lower file without copying it
+ *   -b         take several requests per read (FUSE_BATCH_READ)
+ *
+ * The daemon is single threaded and serves requests in the foreground
+ * until the filesystem is unmounted.  Subdirectories, links and xattrs
+ * are not supported.  It must run as root, as it mounts by itself.
+ *
+ * fuse_bench.sh uses it to compare configurations.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "../../include/linux/fuse.h"
+
+#define ROOT_NODEID	FUSE_ROOT_ID
+#define FIRST_NODEID	2
+#define ATTR_TIMEOUT	1
+
+struct node {
+	char *name;
+	uint64_t nlookup;
+};
+
+static int fuse_fd;
+static int lower_fd;
+static struct node *nodes;
+static size_t nr_nodes;
+
+static int opt_writeback;
+static unsigned int opt_max_pages;
+static unsigned int opt_max_write = 128 * 1024;
+static int opt_passthrough;
+static int passthrough;
+static int opt_splice;
+static int opt_batch;
+static int pipe_fds[2];
+
+static char *buf;
+static char *scratch;
+static size_t buf_size;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static struct node *get_node(uint64_t nodeid)
+{
+	if (nodeid < FIRST_NODEID || nodeid - FIRST_NODEID >= nr_nodes ||
+	    !nodes[nodeid - FIRST_NODEID].name)
+		return NULL;
+	return &nodes[nodeid - FIRST_NODEID];
+}
+
+/* Finds the node for @name, or makes one; nodeids are slot numbers */
+static uint64_t find_node(const char *name)
+{
+	size_t i, free_slot = nr_nodes;
+
+	for (i = 0; i < nr_nodes; i++) {
+		if (!nodes[i].name) {
+			if (free_slot == nr_nodes)
+				free_slot = i;
+			continue;
+		}
+		if (!strcmp(nodes[i].name, name))
+			return i + FIRST_NODEID;
+	}
+
+	if (free_slot == nr_nodes) {
+		nodes = realloc(nodes, ++nr_nodes * sizeof(*nodes));
+		if (!nodes)
+			die("realloc");
+	}
+	nodes[free_slot].name = strdup(name);
+	nodes[free_slot].nlookup = 0;
+	if (!nodes[free_slot].name)
+		die("strdup");
+	return free_slot + FIRST_NODEID;
+}
+
+static void forget_node(uint64_t nodeid, uint64_t nlookup)
+{
+	struct node *node = get_node(nodeid);
+
+	if (!node)
+		return;
+	node->nlookup -= nlookup < node->nlookup ? nlookup : node->nlookup;
+	if (!node->nlookup) {
+		free(node->name);
+		node->name = NULL;
+	}
+}
+
+static void fill_attr(struct fuse_attr *attr, const struct stat *st)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = st->st_ino;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->blksize = st->st_blksize;
+}
+
+static int stat_node(uint64_t nodeid, struct stat *st)
+{
+	struct node *node;
+
+	if (nodeid == ROOT_NODEID)
+		return fstat(lower_fd, st) ? -errno : 0;
+	node = get_node(nodeid);
+	if (!node)
+		return -ENOENT;
+	if (fstatat(lower_fd, node->name, st, AT_SYMLINK_NOFOLLOW))
+		return -errno;
+	return 0;
+}
+
+static void reply(const struct fuse_in_header *in, int error,
+		  const void *arg, size_t len)
+{
+	struct fuse_out_header out;
+	struct iovec iov[2];
+
+	out.len = sizeof(out) + (error ? 0 : len);
+	out.error = error;
+	out.unique = in->unique;
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = (void *)arg;
+	iov[1].iov_len = error ? 0 : len;
+
+	/* ENOENT: the request was interrupted and is gone */
+	if (writev(fuse_fd, iov, 2) < 0 && errno != ENOENT)
+		die("reply");
+}
+
+static void reply_entry(const struct fuse_in_header *in, const char *name,
+			struct fuse_entry_out *entry)
+{
+	struct stat st;
+
+	memset(entry, 0, sizeof(*entry));
+	if (fstatat(lower_fd, name, &st, AT_SYMLINK_NOFOLLOW)) {
+		reply(in, -errno, NULL, 0);
+		return;
+	}
+	entry->nodeid = find_node(name);
+	get_node(entry->nodeid)->nlookup++;
+	entry->entry_valid = ATTR_TIMEOUT;
+	entry->attr_valid = ATTR_TIMEOUT;
+	fill_attr(&entry->attr, &st);
+}
+
+static void do_init(const struct fuse_in_header *in,
+		    const struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	if (arg->major != FUSE_KERNEL_VERSION) {
+		reply(in, 0, &out, sizeof(out));
+		return;
+	}
+
+	out.max_readahead = arg->max_readahead;
+	out.max_write = opt_max_write;
+	out.flags = arg->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES |
+				  FUSE_ATOMIC_O_TRUNC);
+	if (opt_writeback && (arg->flags & FUSE_WRITEBACK_CACHE))
+		out.flags |= FUSE_WRITEBACK_CACHE;
+	if (opt_max_pages && (arg->flags & FUSE_MAX_PAGES)) {
+		out.flags |= FUSE_MAX_PAGES;
+		out.max_pages = opt_max_pages;
+	}
+	if (opt_passthrough && (arg->local_flags & FUSE_PASSTHROUGH)) {
+		out.local_flags |= FUSE_PASSTHROUGH;
+		passthrough = 1;
+	} else if (opt_passthrough) {
+		fprintf(stderr, "kernel does not offer passthrough\n");
+	}
+	if (opt_batch && (arg->local_flags & FUSE_BATCH_READ))
+		out.local_flags |= FUSE_BATCH_READ;
+	else if (opt_batch)
+		fprintf(stderr, "kernel does not offer batched reads\n");
+	reply(in, 0, &out, sizeof(out));
+}
+
+static void do_lookup(const struct fuse_in_header *in, const char *name)
+{
+	struct fuse_entry_out entry;
+
+	if (in->nodeid != ROOT_NODEID) {
+		reply(in, -ENOENT, NULL, 0);
+		return;
+	}
+	reply_entry(in, name, &entry);
+	if (entry.nodeid)
+		reply(in, 0, &entry, sizeof(entry));
+}
+
+static void do_getattr(const struct fuse_in_header *in)
+{
+	struct fuse_attr_out out;
+	struct stat st;
+	int err;
+
+	err = stat_node(in->nodeid, &st);
+	if (err) {
+		reply(in, err, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = ATTR_TIMEOUT;
+	fill_attr(&out.attr, &st);
+	reply(in, 0, &out, sizeof(out));
+}
+
+static void do_setattr(const struct fuse_in_header *in,
+		       const struct fuse_setattr_in *arg)
+{
+	struct node *node = get_node(in->nodeid);
+	const char *name = node ? node->name : ".";
+	int err = 0;
+
+	if (in->nodeid != ROOT_NODEID && !node) {
+		reply(in, -ENOENT, NULL, 0);
+		return;
+	}
+
+	if (arg->valid & FATTR_MODE &&
+	    fchmodat(lower_fd, name, arg->mode, 0))
+		err = -errno;
+	if (!err && arg->valid & (FATTR_UID | FATTR_GID) &&
+	    fchownat(lower_fd, name,
+		     arg->valid & FATTR_UID ? arg->uid : (uid_t)-1,
+		     arg->valid & FATTR_GID ? arg->gid : (gid_t)-1,
+		     AT_SYMLINK_NOFOLLOW))
+		err = -errno;
+	if (!err && arg->valid & FATTR_SIZE) {
+		if (arg->valid & FATTR_FH)
+			err = ftruncate(arg->fh, arg->size) ? -errno : 0;
+		else
+			err = truncate(name, arg->size) ? -errno : 0;
+	}
+	if (!err && arg->valid & (FATTR_ATIME | FATTR_MTIME)) {
+		struct timespec ts[2] = {
+			{ .tv_nsec = UTIME_OMIT }, { .tv_nsec = UTIME_OMIT },
+		};
+
+		if (arg->valid & FATTR_ATIME_NOW)
+			ts[0].tv_nsec = UTIME_NOW;
+		else if (arg->valid & FATTR_ATIME)
+			ts[0] = (struct timespec){ arg->atime, arg->atimensec };
+		if (arg->valid & FATTR_MTIME_NOW)
+			ts[1].tv_nsec = UTIME_NOW;
+		else if (arg->valid & FATTR_MTIME)
+			ts[1] = (struct timespec){ arg->mtime, arg->mtimensec };
+		if (utimensat(lower_fd, name, ts, AT_SYMLINK_NOFOLLOW))
+			err = -errno;
+	}
+
+	if (err)
+		reply(in, err, NULL, 0);
+	else
+		do_getattr(in);
+}
+
+/*
+ * The writeback cache may read pages of a file opened write only, and
+ * does appends itself.
+ */
+static int lower_open_flags(int flags)
+{
+	flags &= ~(O_CREAT | O_EXCL | O_NOCTTY);
+	if (opt_writeback) {
+		if ((flags & O_ACCMODE) == O_WRONLY)
+			flags = (flags & ~O_ACCMODE) | O_RDWR;
+		flags &= ~O_APPEND;
+	}
+	return flags;
+}
+
+/*
+ * With passthrough the kernel takes its own reference to the lower
+ * file, and fh is only used to close our descriptor on release.
+ */
+static void fill_open(struct fuse_open_out *out, int fd)
+{
+	memset(out, 0, sizeof(*out));
+	out->fh = fd;
+	if (passthrough) {
+		out->open_flags |= FOPEN_PASSTHROUGH;
+		out->passthrough_fd = fd;
+	}
+}
+
+static void do_open(const struct fuse_in_header *in,
+		    const struct fuse_open_in *arg)
+{
+	struct node *node = get_node(in->nodeid);
+	struct fuse_open_out out;
+	int fd;
+
+	if (!node) {
+		reply(in, -ENOENT, NULL, 0);
+		return;
+	}
+	fd = openat(lower_fd, node->name, lower_open_flags(arg->flags));
+	if (fd < 0) {
+		reply(in, -errno, NULL, 0);
+		return;
+	}
+	fill_open(&out, fd);
+	reply(in, 0, &out, sizeof(out));
+}
+
+static void do_create(const struct fuse_in_header *in,
+		      const struct fuse_create_in *arg, const char *name)
+{
+	struct {
+		struct fuse_entry_out entry;
+		struct fuse_open_out open;
+	} out;
+	int fd;
+
+	if (in->nodeid != ROOT_NODEID) {
+		reply(in, -ENOENT, NULL, 0);
+		return;
+	}
+	fd = openat(lower_fd, name, lower_open_flags(arg->flags) | O_CREAT |
+		    (arg->flags & O_EXCL), arg->mode & ~arg->umask);
+	if (fd < 0) {
+		reply(in, -errno, NULL, 0);
+		return;
+	}
+	reply_entry(in, name, &out.entry);
+	if (!out.entry.nodeid) {
+		close(fd);
+		return;
+	}
+	fill_open(&out.open, fd);
+	reply(in, 0, &out, sizeof(out));
+}
+
+static void do_read(const struct fuse_in_header *in,
+		    const struct fuse_read_in *arg)
+{
+	static char *data;
+	static size_t data_size;
+	ssize_t n;
+
+	if (arg->size > data_size) {
+		free(data);
+		data_size = arg->size;
+		data = malloc(data_size);
+		if (!data)
+			die("malloc");
+	}
+	n = pread(arg->fh, data, arg->size, arg->offset);
+	if (n < 0)
+		reply(in, -errno, NULL, 0);
+	else
+		reply(in, 0, data, n);
+}
+
+static void do_write(const struct fuse_in_header *in,
+		     const struct fuse_write_in *arg, const void *data)
+{
+	struct fuse_write_out out;
+	ssize_t n;
+
+	n = pwrite(arg->fh, data, arg->size, arg->offset);
+	if (n < 0) {
+		reply(in, -errno, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.size = n;
+	reply(in, 0, &out, sizeof(out));
+}
+
+static void do_readdir(const struct fuse_in_header *in,
+		       const struct fuse_read_in *arg)
+{
+	char *out;
+	size_t len = 0;
+	uint64_t off = 0;
+	struct dirent *de;
+	DIR *dir;
+	int fd;
+
+	out = calloc(1, arg->size);
+	fd = dup(lower_fd);
+	dir = fd < 0 ? NULL : fdopendir(fd);
+	if (!out || !dir) {
+		reply(in, -ENOMEM, NULL, 0);
+		free(out);
+		return;
+	}
+	rewinddir(dir);
+
+	while ((de = readdir(dir))) {
+		struct fuse_dirent *fde = (struct fuse_dirent *)(out + len);
+		size_t namelen = strlen(de->d_name);
+		size_t entlen = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+
+		if (off++ < arg->offset)
+			continue;
+		if (len + entlen > arg->size)
+			break;
+		fde->ino = de->d_ino;
+		fde->off = off;
+		fde->namelen = namelen;
+		fde->type = de->d_type;
+		memcpy(fde->name, de->d_name, namelen);
+		len += entlen;
+	}
+	closedir(dir);
+
+	reply(in, 0, out, len);
+	free(out);
+}
+
+static void do_statfs(const struct fuse_in_header *in)
+{
+	struct fuse_statfs_out out;
+	struct statvfs sv;
+
+	if (fstatvfs(lower_fd, &sv)) {
+		reply(in, -errno, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.st.blocks = sv.f_blocks;
+	out.st.bfree = sv.f_bfree;
+	out.st.bavail = sv.f_bavail;
+	out.st.files = sv.f_files;
+	out.st.ffree = sv.f_ffree;
+	out.st.bsize = sv.f_bsize;
+	out.st.namelen = sv.f_namemax;
+	out.st.frsize = sv.f_frsize;
+	reply(in, 0, &out, sizeof(out));
+}
+
+/* Returns 0 once the filesystem is going away */
+static int handle_request(const struct fuse_in_header *in, const void *arg)
+{
+	int err;
+
+	switch (in->opcode) {
+	case FUSE_INIT:
+		do_init(in, arg);
+		break;
+	case FUSE_DESTROY:
+		reply(in, 0, NULL, 0);
+		return 0;
+	case FUSE_LOOKUP:
+		do_lookup(in, arg);
+		break;
+	case FUSE_FORGET:
+		forget_node(in->nodeid,
+			    ((const struct fuse_forget_in *)arg)->nlookup);
+		break;
+	case FUSE_BATCH_FORGET: {
+		const struct fuse_batch_forget_in *bf = arg;
+		const struct fuse_forget_one *one = (const void *)(bf + 1);
+		unsigned int i;
+
+		for (i = 0; i < bf->count; i++)
+			forget_node(one[i].nodeid, one[i].nlookup);
+		break;
+	}
+	case FUSE_GETATTR:
+		do_getattr(in);
+		break;
+	case FUSE_SETATTR:
+		do_setattr(in, arg);
+		break;
+	case FUSE_OPEN:
+		do_open(in, arg);
+		break;
+	case FUSE_CREATE:
+		do_create(in, arg, (const char *)arg +
+			  sizeof(struct fuse_create_in));
+		break;
+	case FUSE_READ:
+		do_read(in, arg);
+		break;
+	case FUSE_WRITE:
+		do_write(in, arg, (const char *)arg +
+			 sizeof(struct fuse_write_in));
+		break;
+	case FUSE_RELEASE:
+		close(((const struct fuse_release_in *)arg)->fh);
+		reply(in, 0, NULL, 0);
+		break;
+	case FUSE_FSYNC:
+		err = 0;
+		if (fsync(((const struct fuse_fsync_in *)arg)->fh))
+			err = -errno;
+		reply(in, err, NULL, 0);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_OPENDIR:
+	case FUSE_RELEASEDIR:
+	case FUSE_FSYNCDIR: {
+		struct fuse_open_out out;
+
+		/* OPENDIR wants an open_out, the others no argument */
+		memset(&out, 0, sizeof(out));
+		reply(in, 0, &out,
+		      in->opcode == FUSE_OPENDIR ? sizeof(out) : 0);
+		break;
+	}
+	case FUSE_READDIR:
+		do_readdir(in, arg);
+		break;
+	case FUSE_UNLINK:
+		err = 0;
+		if (unlinkat(lower_fd, arg, 0))
+			err = -errno;
+		reply(in, err, NULL, 0);
+		break;
+	case FUSE_STATFS:
+		do_statfs(in);
+		break;
+	case FUSE_INTERRUPT:
+		/* Requests are answered in order; nothing to cancel */
+		break;
+	default:
+		reply(in, -ENOSYS, NULL, 0);
+		break;
+	}
+	return 1;
+}
+
+static void bad_request(void)
+{
+	fprintf(stderr, "malformed request\n");
+	exit(1);
+}
+
+/* Returns 0 if the filesystem is gone, -1 to retry, 1 on success */
+static int check_dev_read(ssize_t n)
+{
+	if (n >= 0)
+		return 1;
+	if (errno == EINTR || errno == EAGAIN || errno == ENOENT)
+		return -1;
+	if (errno == ENODEV)
+		return 0;
+	die("read /dev/fuse");
+	return 0;
+}
+
+/*
+ * A batched read returns requests back to back, each starting with its
+ * own header.  Their lengths are not multiples of 8, so copy any that
+ * is misaligned before looking at its 64 bit fields.
+ */
+static void serve(void)
+{
+	for (;;) {
+		const struct fuse_in_header *in;
+		struct fuse_in_header h;
+		char *p = buf;
+		ssize_t n;
+		int ret;
+
+		n = read(fuse_fd, buf, buf_size);
+		ret = check_dev_read(n);
+		if (!ret)
+			return;
+		if (ret < 0)
+			continue;
+
+		while (n > 0) {
+			if (n < (ssize_t)sizeof(h))
+				bad_request();
+			memcpy(&h, p, sizeof(h));
+			if (h.len < sizeof(h) || h.len > n)
+				bad_request();
+			if ((uintptr_t)p % 8) {
+				memcpy(scratch, p, h.len);
+				in = (const struct fuse_in_header *)scratch;
+			} else {
+				in = (const struct fuse_in_header *)p;
+			}
+			if (!handle_request(in, in + 1))
+				return;
+			p += h.len;
+			n -= h.len;
+		}
+	}
+}
+
+static void pipe_read(void *dst, size_t len)
+{
+	while (len) {
+		ssize_t n = read(pipe_fds[0], dst, len);
+
+		if (n <= 0)
+			die("read pipe");
+		dst = (char *)dst + n;
+		len -= n;
+	}
+}
+
+/* Moves the data of a WRITE from the pipe to the lower file */
+static void do_write_splice(const struct fuse_in_header *in,
+			    const struct fuse_write_in *arg)
+{
+	struct fuse_write_out out;
+	loff_t off = arg->offset;
+	size_t left = arg->size;
+	int err = 0;
+
+	while (left) {
+		ssize_t n = splice(pipe_fds[0], NULL, arg->fh, &off, left,
+				   SPLICE_F_MOVE);
+
+		if (n <= 0) {
+			err = n ? -errno : -EIO;
+			break;
+		}
+		left -= n;
+	}
+
+	/* Keep the pipe in step with the requests */
+	while (left) {
+		size_t len = left < buf_size ? left : buf_size;
+
+		pipe_read(scratch, len);
+		left -= len;
+	}
+
+	if (err) {
+		reply(in, err, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.size = arg->size;
+	reply(in, 0, &out, sizeof(out));
+}
+
+/*
+ * Requests are spliced into the pipe and their headers and arguments
+ * read from it; WRITE data stays in the pipe and is spliced on.
+ */
+static void serve_splice(void)
+{
+	for (;;) {
+		struct fuse_in_header *in = (struct fuse_in_header *)buf;
+		ssize_t n;
+		int ret;
+
+		n = splice(fuse_fd, NULL, pipe_fds[1], NULL, buf_size, 0);
+		ret = check_dev_read(n);
+		if (!ret)
+			return;
+		if (ret < 0)
+			continue;
+
+		while (n > 0) {
+			if (n < (ssize_t)sizeof(*in))
+				bad_request();
+			pipe_read(in, sizeof(*in));
+			if (in->len < sizeof(*in) || in->len > n ||
+			    in->len > buf_size)
+				bad_request();
+			n -= in->len;
+
+			if (in->opcode == FUSE_WRITE) {
+				struct fuse_write_in *arg = (void *)(in + 1);
+
+				if (in->len < sizeof(*in) + sizeof(*arg))
+					bad_request();
+				pipe_read(arg, sizeof(*arg));
+				do_write_splice(in, arg);
+				continue;
+			}
+
+			pipe_read(in + 1, in->len - sizeof(*in));
+			if (!handle_request(in, in + 1))
+				return;
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-w] [-m max_pages] [-W max_write] [-P] "
+		"[-s] [-b] <lower dir> <mountpoint>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char opts[128];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "wm:W:Psb")) != -1) {
+		switch (opt) {
+		case 'w':
+			opt_writeback = 1;
+			break;
+		case 'm':
+			opt_max_pages = atoi(optarg);
+			break;
+		case 'W':
+			opt_max_write = strtoul(optarg, NULL, 0);
+			break;
+		case 'P':
+			opt_passthrough = 1;
+			break;
+		case 's':
+			opt_splice = 1;
+			break;
+		case 'b':
+			opt_batch = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || opt_max_write < 4096)
+		usage(argv[0]);
+
+	lower_fd = open(argv[optind], O_RDONLY | O_DIRECTORY);
+	if (lower_fd < 0)
+		die(argv[optind]);
+	if (fchdir(lower_fd))
+		die("fchdir");
+
+	/* Room for the largest WRITE plus its headers */
+	buf_size = opt_max_write + getpagesize();
+	buf = malloc(buf_size);
+	scratch = malloc(buf_size);
+	if (!buf || !scratch)
+		die("malloc");
+
+	if (opt_splice) {
+		if (pipe(pipe_fds))
+			die("pipe");
+		/* A whole request has to fit, one page per buffer */
+		if (fcntl(pipe_fds[0], F_SETPIPE_SZ, buf_size) < 0) {
+			fprintf(stderr, "cannot grow pipe to %zu bytes, "
+				"check /proc/sys/fs/pipe-max-size\n", buf_size);
+			exit(1);
+		}
+	}
+
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0)
+		die("/dev/fuse");
+	snprintf(opts, sizeof(opts), "fd=%d,rootmode=40000,user_id=0,"
+		 "group_id=0,allow_other,default_permissions", fuse_fd);
+	if (mount("fuse_pt", argv[optind + 1], "fuse", MS_NOSUID | MS_NODEV,
+		  opts))
+		die("mount");
+
+	if (opt_splice)
+		serve_splice();
+	else
+		serve();
+	return 0;
+}
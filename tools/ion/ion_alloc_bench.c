@@ -0,0 +1,234 @@
+/*
+ * ion_alloc_bench - ION allocation and free latency through /dev/ion
+ *
+ * For each buffer size, allocates a burst of -b buffers with ION_IOC_ALLOC,
+ * frees them again with ION_IOC_FREE, and repeats that -n times.  Prints
+ * the p50/p99/max latency of a single allocation and a single free per
+ * size.  With -t every buffer is also mapped through ION_IOC_MAP and
+ * touched once per page, so the pages are really backed, the way gralloc
+ * users see them.
+ *
+ * The first bursts of a size find the system heap's page pools empty and
+ * go to the page allocator; later ones are served from the pools, so
+ * compare p50 against max.  The heap's debugfs file,
+ * /sys/kernel/debug/ion/vmalloc on the msm boards, shows the pool sizes
+ * and its own latency counters afterwards.
+ *
+ * Build with CROSS_COMPILE set to the target toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* From include/linux/ion.h */
+struct ion_handle;
+
+struct ion_allocation_data {
+	size_t len;
+	size_t align;
+	unsigned int flags;
+	struct ion_handle *handle;
+};
+
+struct ion_fd_data {
+	struct ion_handle *handle;
+	int fd;
+};
+
+struct ion_handle_data {
+	struct ion_handle *handle;
+};
+
+#define ION_SYSTEM_HEAP_ID	30
+#define ION_HEAP(bit)		(1 << (bit))
+#define ION_SET_CACHE(c)	((c) << 0)
+#define CACHED			1
+
+#define ION_IOC_MAGIC		'I'
+#define ION_IOC_ALLOC		_IOWR(ION_IOC_MAGIC, 0, \
+				      struct ion_allocation_data)
+#define ION_IOC_FREE		_IOWR(ION_IOC_MAGIC, 1, \
+				      struct ion_handle_data)
+#define ION_IOC_MAP		_IOWR(ION_IOC_MAGIC, 2, struct ion_fd_data)
+
+#define ION_DEV		"/dev/ion"
+#define MAX_SIZES	16
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+static size_t default_sizes[] = {
+	4096, 65536, 1 << 20, 8 << 20,
+};
+
+static int ion_fd;
+static int heap_id = ION_SYSTEM_HEAP_ID;
+static int iterations = 100;
+static int burst = 8;
+static int touch;
+static long page_size;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_lat(const char *what, uint64_t *lat, size_t n)
+{
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+	printf("  %-5s p50 %6.1f us  p99 %7.1f us  max %7.1f us\n", what,
+	       lat[n / 2] / 1000.0, lat[n * 99 / 100] / 1000.0,
+	       lat[n - 1] / 1000.0);
+}
+
+static void touch_buffer(struct ion_handle *handle, size_t len)
+{
+	struct ion_fd_data map = { .handle = handle };
+	volatile char *p;
+	size_t off;
+
+	if (ioctl(ion_fd, ION_IOC_MAP, &map))
+		die("ION_IOC_MAP");
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, map.fd, 0);
+	if (p == MAP_FAILED)
+		die("mmap");
+	for (off = 0; off < len; off += page_size)
+		p[off] = 1;
+	munmap((void *)p, len);
+	close(map.fd);
+}
+
+static void run_size(size_t len)
+{
+	size_t n = (size_t)iterations * burst, i = 0;
+	struct ion_handle **handles;
+	uint64_t *alloc_lat, *free_lat;
+	int it, b;
+
+	handles = calloc(burst, sizeof(*handles));
+	alloc_lat = calloc(n, sizeof(*alloc_lat));
+	free_lat = calloc(n, sizeof(*free_lat));
+	if (!handles || !alloc_lat || !free_lat)
+		die("calloc");
+
+	for (it = 0; it < iterations; it++) {
+		size_t first = i;
+
+		for (b = 0; b < burst; b++, i++) {
+			struct ion_allocation_data data = {
+				.len = len,
+				.align = page_size,
+				.flags = ION_HEAP(heap_id) |
+					 ION_SET_CACHE(CACHED),
+			};
+			uint64_t t0 = now_ns();
+
+			if (ioctl(ion_fd, ION_IOC_ALLOC, &data))
+				die("ION_IOC_ALLOC");
+			alloc_lat[i] = now_ns() - t0;
+			handles[b] = data.handle;
+			if (touch)
+				touch_buffer(data.handle, len);
+		}
+		for (b = 0; b < burst; b++, first++) {
+			struct ion_handle_data data = { .handle = handles[b] };
+			uint64_t t0 = now_ns();
+
+			if (ioctl(ion_fd, ION_IOC_FREE, &data))
+				die("ION_IOC_FREE");
+			free_lat[first] = now_ns() - t0;
+		}
+	}
+
+	printf("%zu bytes, %zu allocations:\n", len, n);
+	print_lat("alloc", alloc_lat, n);
+	print_lat("free", free_lat, n);
+
+	free(free_lat);
+	free(alloc_lat);
+	free(handles);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-H heap id] [-n iterations] [-b burst] "
+		"[-t] [size...]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[MAX_SIZES];
+	int nr_sizes = 0, opt, i;
+
+	while ((opt = getopt(argc, argv, "H:n:b:t")) != -1) {
+		switch (opt) {
+		case 'H':
+			heap_id = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 't':
+			touch = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (heap_id < 0 || heap_id > 30 || iterations < 1 || burst < 1 ||
+	    argc - optind > MAX_SIZES)
+		usage(argv[0]);
+
+	for (i = optind; i < argc; i++) {
+		sizes[nr_sizes] = strtoul(argv[i], NULL, 0);
+		if (!sizes[nr_sizes++])
+			usage(argv[0]);
+	}
+	if (!nr_sizes) {
+		for (i = 0; i < (int)ARRAY_SIZE(default_sizes); i++)
+			sizes[nr_sizes++] = default_sizes[i];
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	ion_fd = open(ION_DEV, O_RDONLY);
+	if (ion_fd < 0)
+		die(ION_DEV);
+
+	printf("heap %d, bursts of %d buffers%s\n", heap_id, burst,
+	       touch ? ", every page touched" : "");
+	for (i = 0; i < nr_sizes; i++)
+		run_size(sizes[i]);
+
+	close(ion_fd);
+	return 0;
+}
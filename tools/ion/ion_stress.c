@@ -0,0 +1,310 @@
+/*
+ * ion_stress - multi-threaded ION import/free stress
+ *
+ * Allocates -B buffers on the system heap and shares them with
+ * ION_IOC_SHARE, the way a producer hands frames to its consumers.  Then
+ * starts N threads that, for -d seconds, import a random shared buffer
+ * with ION_IOC_IMPORT and free the handle again with ION_IOC_FREE.  Every
+ * -a iterations a thread also allocates, shares and frees a buffer of
+ * its own, and every -m iterations it maps the imported buffer through
+ * ION_IOC_MAP and touches it.  Each thread first allocates -H buffers it
+ * keeps, so lookups run against a client with many handles.
+ *
+ * By default every thread opens its own client, like separate graphics
+ * processes would; with -s all threads share one client and its lock.
+ * Prints iterations per second and the p50/p99 latency of one
+ * import/free pair.
+ *
+ * Build with CROSS_COMPILE set to the target toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* From include/linux/ion.h */
+struct ion_handle;
+
+struct ion_allocation_data {
+	size_t len;
+	size_t align;
+	unsigned int flags;
+	struct ion_handle *handle;
+};
+
+struct ion_fd_data {
+	struct ion_handle *handle;
+	int fd;
+};
+
+struct ion_handle_data {
+	struct ion_handle *handle;
+};
+
+#define ION_SYSTEM_HEAP_ID	30
+#define ION_HEAP(bit)		(1 << (bit))
+#define ION_SET_CACHE(c)	((c) << 0)
+#define CACHED			1
+
+#define ION_IOC_MAGIC		'I'
+#define ION_IOC_ALLOC		_IOWR(ION_IOC_MAGIC, 0, \
+				      struct ion_allocation_data)
+#define ION_IOC_FREE		_IOWR(ION_IOC_MAGIC, 1, \
+				      struct ion_handle_data)
+#define ION_IOC_MAP		_IOWR(ION_IOC_MAGIC, 2, struct ion_fd_data)
+#define ION_IOC_SHARE		_IOWR(ION_IOC_MAGIC, 4, struct ion_fd_data)
+#define ION_IOC_IMPORT		_IOWR(ION_IOC_MAGIC, 5, int)
+
+#define ION_DEV		"/dev/ion"
+#define MAX_SAMPLES	(1 << 20)
+
+static int nr_threads = 4;
+static int nr_shared = 16;
+static int nr_held = 256;
+static int alloc_every = 16;
+static int map_every;
+static int duration = 10;
+static int shared_client;
+static size_t buf_size = 65536;
+static long page_size;
+static int *share_fds;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	int ion_fd;
+	uint64_t *lat;
+	size_t nr_lat;
+	unsigned long iterations;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static struct ion_handle *ion_alloc(int ion_fd, size_t len)
+{
+	struct ion_allocation_data data = {
+		.len = len,
+		.align = page_size,
+		.flags = ION_HEAP(ION_SYSTEM_HEAP_ID) | ION_SET_CACHE(CACHED),
+	};
+
+	if (ioctl(ion_fd, ION_IOC_ALLOC, &data))
+		die("ION_IOC_ALLOC");
+	return data.handle;
+}
+
+static void ion_free(int ion_fd, struct ion_handle *handle)
+{
+	struct ion_handle_data data = { .handle = handle };
+
+	if (ioctl(ion_fd, ION_IOC_FREE, &data))
+		die("ION_IOC_FREE");
+}
+
+static int ion_share(int ion_fd, struct ion_handle *handle,
+		     unsigned int cmd)
+{
+	struct ion_fd_data data = { .handle = handle };
+
+	if (ioctl(ion_fd, cmd, &data) || data.fd < 0)
+		die(cmd == ION_IOC_SHARE ? "ION_IOC_SHARE" : "ION_IOC_MAP");
+	return data.fd;
+}
+
+static void map_and_touch(int ion_fd, struct ion_handle *handle)
+{
+	int fd = ion_share(ion_fd, handle, ION_IOC_MAP);
+	volatile char *p;
+
+	p = mmap(NULL, buf_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		die("mmap");
+	p[0]++;
+	munmap((void *)p, buf_size);
+	close(fd);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->id + 1;
+	struct ion_handle **held;
+	int i;
+
+	held = calloc(nr_held, sizeof(*held));
+	if (!held)
+		die("calloc");
+	for (i = 0; i < nr_held; i++)
+		held[i] = ion_alloc(w->ion_fd, page_size);
+
+	while (!stop) {
+		struct ion_fd_data data = {
+			.fd = share_fds[rand_r(&seed) % nr_shared],
+		};
+		uint64_t t0 = now_ns();
+
+		if (ioctl(w->ion_fd, ION_IOC_IMPORT, &data) || !data.handle) {
+			fprintf(stderr, "ION_IOC_IMPORT failed\n");
+			exit(1);
+		}
+		if (map_every && !(w->iterations % map_every))
+			map_and_touch(w->ion_fd, data.handle);
+		ion_free(w->ion_fd, data.handle);
+		if (w->nr_lat < MAX_SAMPLES)
+			w->lat[w->nr_lat++] = now_ns() - t0;
+
+		if (alloc_every && !(w->iterations % alloc_every)) {
+			struct ion_handle *handle;
+
+			handle = ion_alloc(w->ion_fd, buf_size);
+			close(ion_share(w->ion_fd, handle, ION_IOC_SHARE));
+			ion_free(w->ion_fd, handle);
+		}
+		w->iterations++;
+	}
+
+	for (i = 0; i < nr_held; i++)
+		ion_free(w->ion_fd, held[i]);
+	free(held);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-d seconds] "
+		"[-B shared buffers] [-H held handles] [-b bytes] "
+		"[-a alloc every] [-m map every] [-s]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	uint64_t *all;
+	size_t nr_all = 0;
+	unsigned long total = 0;
+	uint64_t t0, t1;
+	int opt, ion_fd, i;
+
+	while ((opt = getopt(argc, argv, "t:d:B:H:b:a:m:s")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'B':
+			nr_shared = atoi(optarg);
+			break;
+		case 'H':
+			nr_held = atoi(optarg);
+			break;
+		case 'b':
+			buf_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			alloc_every = atoi(optarg);
+			break;
+		case 'm':
+			map_every = atoi(optarg);
+			break;
+		case 's':
+			shared_client = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || duration < 1 || nr_shared < 1 || nr_held < 0 ||
+	    !buf_size || alloc_every < 0 || map_every < 0)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	ion_fd = open(ION_DEV, O_RDONLY);
+	if (ion_fd < 0)
+		die(ION_DEV);
+
+	/* The exporter keeps its handles, so the shared buffers stay alive */
+	share_fds = calloc(nr_shared, sizeof(*share_fds));
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!share_fds || !workers)
+		die("calloc");
+	for (i = 0; i < nr_shared; i++)
+		share_fds[i] = ion_share(ion_fd, ion_alloc(ion_fd, buf_size),
+					 ION_IOC_SHARE);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct worker *w = &workers[i];
+
+		w->id = i;
+		w->ion_fd = shared_client ? ion_fd : open(ION_DEV, O_RDONLY);
+		if (w->ion_fd < 0)
+			die(ION_DEV);
+		w->lat = malloc(MAX_SAMPLES * sizeof(*w->lat));
+		if (!w->lat)
+			die("malloc");
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create");
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	t1 = now_ns();
+
+	all = malloc((size_t)nr_threads * MAX_SAMPLES * sizeof(*all));
+	if (!all)
+		die("malloc");
+	for (i = 0; i < nr_threads; i++) {
+		memcpy(all + nr_all, workers[i].lat,
+		       workers[i].nr_lat * sizeof(*all));
+		nr_all += workers[i].nr_lat;
+		total += workers[i].iterations;
+	}
+	qsort(all, nr_all, sizeof(*all), cmp_u64);
+
+	printf("%d threads, %s, %d shared buffers, %d held handles each: "
+	       "%.0f iterations/s, import+free p50 %.1f us p99 %.1f us\n",
+	       nr_threads, shared_client ? "one client" : "one client each",
+	       nr_shared, nr_held, total * 1e9 / (t1 - t0),
+	       nr_all ? all[nr_all / 2] / 1000.0 : 0,
+	       nr_all ? all[nr_all * 99 / 100] / 1000.0 : 0);
+	return 0;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# row_bench.sh - read latency under write load, per I/O scheduler
+#
+# Runs read-under-write.fio against a block device once per scheduler
+# and prints the reader's completion latency from fio, plus the queue's
+# d2c_latency_hist and, for row, read_lat.  The device must be request
+# based (scsi_debug or eMMC, not brd or loop), see
+# Documentation/block/row-iosched.txt.
+#
+# Everything on the device is overwritten.
+#
+# usage: row_bench.sh <device> [seconds] [schedulers]
+#    e.g. row_bench.sh /dev/sdb 60 "cfq deadline row"
+#
+# This program can be distributed under the terms of the GNU GPL v2.
+
+[ -b "$1" ] || { echo "usage: $0 <device> [seconds] [schedulers]"; exit 1; }
+
+export DEV=$1
+export RUNTIME=${2:-60}
+SCHEDS=${3:-"cfq deadline row"}
+JOB=$(dirname $0)/read-under-write.fio
+Q=/sys/block/$(basename $(readlink -f $DEV))/queue
+
+for s in $SCHEDS; do
+	echo $s > $Q/scheduler || exit 1
+	[ -e $Q/d2c_latency_hist ] && echo 1 > $Q/d2c_latency_hist
+	[ -e $Q/iosched/read_lat ] && echo 1 > $Q/iosched/read_lat
+
+	echo "=== $s"
+	fio $JOB | sed -n '/^reader/,/^writer/p' | grep -v '^writer'
+
+	if [ -e $Q/d2c_latency_hist ]; then
+		echo "--- d2c_latency_hist"
+		cat $Q/d2c_latency_hist
+	fi
+	if [ -e $Q/iosched/read_lat ]; then
+		echo "--- read_lat"
+		cat $Q/iosched/read_lat
+	fi
+done
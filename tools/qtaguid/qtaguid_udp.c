@@ -0,0 +1,176 @@
+/*
+ * qtaguid_udp - loopback UDP packet rate, for measuring xt_qtaguid
+ *
+ * Sends small UDP datagrams to itself over loopback from one thread and
+ * receives them on another for a fixed time, then prints the packets
+ * per second sent and received.  With -T both sockets are tagged
+ * through /proc/net/xt_qtaguid/ctrl first, so the per-packet match also
+ * finds and charges a socket tag.
+ *
+ * qtaguid_bench.sh runs this with and without qtaguid rules on lo.
+ *
+ * Build with CROSS_COMPILE set to the target toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define QTAGUID_CTRL	"/proc/net/xt_qtaguid/ctrl"
+
+static int duration = 5;
+static size_t pkt_size = 64;
+static unsigned int tag;
+static volatile int stop;
+
+struct rx_state {
+	int sock;
+	unsigned long received;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Same command format as libcutils' qtaguid_tagSocket() */
+static void tag_socket(int sock)
+{
+	char cmd[64];
+	int fd, len;
+
+	len = snprintf(cmd, sizeof(cmd), "t %d %llu %u", sock,
+		       (unsigned long long)tag << 32, getuid());
+	fd = open(QTAGUID_CTRL, O_WRONLY);
+	if (fd < 0)
+		die(QTAGUID_CTRL);
+	if (write(fd, cmd, len) != len)
+		die("tag socket");
+	close(fd);
+}
+
+static void *receiver(void *arg)
+{
+	struct rx_state *rx = arg;
+	char buf[2048];
+
+	while (!stop) {
+		if (recv(rx->sock, buf, sizeof(buf), 0) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			die("recv");
+		}
+		rx->received++;
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d seconds] [-s bytes] [-T tag]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+	struct rx_state rx = { .received = 0 };
+	unsigned long sent = 0, dropped = 0;
+	pthread_t thread;
+	double t0, t1;
+	char *buf;
+	int opt, tx;
+
+	while ((opt = getopt(argc, argv, "d:s:T:")) != -1) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 's':
+			pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			tag = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (duration < 1 || !pkt_size || pkt_size > 1472)
+		usage(argv[0]);
+
+	buf = calloc(1, pkt_size);
+	if (!buf)
+		die("calloc");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	rx.sock = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx.sock < 0 || tx < 0)
+		die("socket");
+	if (bind(rx.sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx.sock, (struct sockaddr *)&addr, &addrlen))
+		die("bind");
+	if (setsockopt(rx.sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		die("SO_RCVTIMEO");
+	if (connect(tx, (struct sockaddr *)&addr, sizeof(addr)))
+		die("connect");
+	if (tag) {
+		tag_socket(rx.sock);
+		tag_socket(tx);
+	}
+
+	if (pthread_create(&thread, NULL, receiver, &rx))
+		die("pthread_create");
+
+	t0 = now_s();
+	t1 = t0;
+	while (t1 - t0 < duration) {
+		int i;
+
+		for (i = 0; i < 256; i++) {
+			if (send(tx, buf, pkt_size, 0) < 0) {
+				/* Receive queue full, the receiver is behind */
+				if (errno != ENOBUFS && errno != ECONNREFUSED)
+					die("send");
+				dropped++;
+				continue;
+			}
+			sent++;
+		}
+		t1 = now_s();
+	}
+	stop = 1;
+	pthread_join(thread, NULL);
+
+	printf("%zu byte packets, tag %#x: sent %.0f pps, received %.0f pps, "
+	       "%lu send errors\n", pkt_size, tag, sent / (t1 - t0),
+	       rx.received / (t1 - t0), dropped);
+	return 0;
+}
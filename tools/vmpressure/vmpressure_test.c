@@ -0,0 +1,228 @@
+/*
+ * vmpressure_test - drive memory pressure and check /dev/vmpressure
+ *
+ * Forks a child that allocates and dirties anonymous memory in steps
+ * until it reaches the target size (75% of MemTotal by default), then
+ * holds it for a while and exits.  The child makes itself the first
+ * choice of the OOM and low memory killers.  Meanwhile the parent
+ * polls /dev/vmpressure and prints every event with the child's
+ * allocated size at that time.
+ *
+ * The test fails if no event arrives, or if the sequence numbers go
+ * backwards or repeat.  Gaps in the sequence, i.e. events superseded
+ * before they were read, are counted but allowed.
+ *
+ * Build with CROSS_COMPILE set to the target toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/types.h>
+
+/* From include/linux/vmpressure.h */
+#define VMPRESSURE_LOW		0
+#define VMPRESSURE_MEDIUM	1
+#define VMPRESSURE_CRITICAL	2
+
+struct vmpressure_event {
+	__u32	seq;
+	__u32	level;
+	__u32	pressure;
+	__u32	free;
+	__u32	file;
+};
+
+#define VMPRESSURE_DEV	"/dev/vmpressure"
+#define STEP_MB		16
+
+static const char * const level_names[] = {
+	[VMPRESSURE_LOW]	= "low",
+	[VMPRESSURE_MEDIUM]	= "medium",
+	[VMPRESSURE_CRITICAL]	= "critical",
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long mem_total_mb(void)
+{
+	char line[128];
+	long kb = 0;
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		die("/proc/meminfo");
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "MemTotal: %ld kB", &kb) == 1)
+			break;
+	fclose(f);
+	return kb / 1024;
+}
+
+/* Allocates up to @target_mb, publishing progress in @done_mb */
+static void run_hog(long target_mb, int hold, volatile long *done_mb)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	FILE *f;
+
+	f = fopen("/proc/self/oom_score_adj", "w");
+	if (f) {
+		fputs("1000", f);
+		fclose(f);
+	} else {
+		f = fopen("/proc/self/oom_adj", "w");
+		if (f) {
+			fputs("15", f);
+			fclose(f);
+		}
+	}
+
+	while (*done_mb < target_mb) {
+		size_t size = (size_t)STEP_MB << 20;
+		char *p;
+		size_t off;
+
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			break;
+		for (off = 0; off < size; off += page_size)
+			p[off] = (char)off | 1;
+		*done_mb += STEP_MB;
+	}
+	sleep(hold);
+	exit(0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m target MB] [-h hold seconds]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct vmpressure_event ev;
+	volatile long *done_mb;
+	long target_mb = 0;
+	unsigned int last_seq = 0, events = 0, gaps = 0;
+	unsigned int per_level[3] = { 0 };
+	int hold = 5, opt, fd, status, failed = 0;
+	int child_done = 0;
+	double start;
+	pid_t hog;
+
+	while ((opt = getopt(argc, argv, "m:h:")) != -1) {
+		switch (opt) {
+		case 'm':
+			target_mb = atol(optarg);
+			break;
+		case 'h':
+			hold = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!target_mb)
+		target_mb = mem_total_mb() * 3 / 4;
+
+	fd = open(VMPRESSURE_DEV, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		die(VMPRESSURE_DEV);
+
+	/* Skip whatever was current before we started */
+	while (read(fd, &ev, sizeof(ev)) == sizeof(ev))
+		last_seq = ev.seq;
+
+	done_mb = mmap(NULL, sizeof(*done_mb), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (done_mb == MAP_FAILED)
+		die("mmap");
+	*done_mb = 0;
+
+	printf("allocating %ld MB in %d MB steps\n", target_mb, STEP_MB);
+	start = now_s();
+	hog = fork();
+	if (hog < 0)
+		die("fork");
+	if (!hog)
+		run_hog(target_mb, hold, done_mb);
+
+	while (!child_done) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		ssize_t n;
+
+		if (waitpid(hog, &status, WNOHANG) == hog)
+			child_done = 1;
+
+		if (poll(&pfd, 1, 500) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("poll");
+		}
+		if (!(pfd.revents & POLLIN))
+			continue;
+
+		n = read(fd, &ev, sizeof(ev));
+		if (n < 0 && errno == EAGAIN)
+			continue;
+		if (n != sizeof(ev))
+			die("read");
+
+		printf("%8.3f s  seq %u  %-8s pressure %3u%%  free %u  "
+		       "file %u  hog %ld MB\n", now_s() - start, ev.seq,
+		       ev.level < 3 ? level_names[ev.level] : "?",
+		       ev.pressure, ev.free, ev.file, *done_mb);
+
+		if (events && (int)(ev.seq - last_seq) <= 0) {
+			printf("FAIL: seq %u after %u\n", ev.seq, last_seq);
+			failed = 1;
+		} else if (events && ev.seq != last_seq + 1) {
+			gaps++;
+		}
+		if (ev.level < 3)
+			per_level[ev.level]++;
+		last_seq = ev.seq;
+		events++;
+	}
+
+	if (WIFSIGNALED(status))
+		printf("hog killed by signal %d at %ld MB\n",
+		       WTERMSIG(status), *done_mb);
+
+	printf("%u events (low %u, medium %u, critical %u), %u gaps\n",
+	       events, per_level[VMPRESSURE_LOW], per_level[VMPRESSURE_MEDIUM],
+	       per_level[VMPRESSURE_CRITICAL], gaps);
+	if (!events) {
+		printf("FAIL: no events\n");
+		failed = 1;
+	}
+	printf("%s\n", failed ? "FAIL" : "PASS");
+	return failed;
+}
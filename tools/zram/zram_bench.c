@@ -0,0 +1,309 @@
+/*
+ * zram_bench - zram compression throughput and ratio per backend
+ *
+ * For each compression backend listed in comp_algorithm (or given with
+ * -a), resets the device, selects the backend, writes the data set to
+ * it with O_DIRECT from N threads in parallel, then reads it back the
+ * same way.  Prints write and read MB/s and the compression ratio,
+ * orig_data_size / compr_data_size, as reported by the device.
+ *
+ * The data set is the file given with -f, repeated to fill -s MB, or
+ * else generated text that compresses roughly as well as typical
+ * application heap.  The device must not be in use; it is reset
+ * before and after every run.
+ *
+ * Build with CROSS_COMPILE set to the target toolchain.
+ *
+ * This program can be distributed under the terms of the GNU GPL v2.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define CHUNK		(64 * 1024)
+#define MAX_ALGOS	8
+
+static const char *dev_path = "/dev/block/zram0";
+static char sysfs_dir[64];
+static int nr_threads;
+static size_t data_size = 64 << 20;
+static char *data;
+
+struct worker {
+	pthread_t thread;
+	int write;
+	size_t start, len;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sysfs_write(const char *attr, const char *val)
+{
+	char path[128];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_dir, attr);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		die(path);
+	if (write(fd, val, strlen(val)) < 0)
+		die(path);
+	close(fd);
+}
+
+static void sysfs_read(const char *attr, char *buf, size_t len)
+{
+	char path[128];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_dir, attr);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+	n = read(fd, buf, len - 1);
+	if (n < 0)
+		die(path);
+	buf[n] = '\0';
+	close(fd);
+}
+
+static unsigned long long sysfs_read_ull(const char *attr)
+{
+	char buf[32];
+
+	sysfs_read(attr, buf, sizeof(buf));
+	return strtoull(buf, NULL, 10);
+}
+
+/* Words and numbers, so that it compresses but is never same-filled */
+static void generate_data(void)
+{
+	static const char * const words[] = {
+		"view", "layout", "bitmap", "string", "activity", "intent",
+		"android", "resource", "0x7f0a", "null", "true", "false",
+		"com.android.", "width", "height", "drawable", "\n", "\t",
+	};
+	unsigned int seed = 1;
+	size_t off = 0;
+
+	while (off < data_size) {
+		char tmp[32];
+		int n;
+
+		if (rand_r(&seed) & 1)
+			n = snprintf(tmp, sizeof(tmp), "%s ",
+				     words[rand_r(&seed) % ARRAY_SIZE(words)]);
+		else
+			n = snprintf(tmp, sizeof(tmp), "%u ", rand_r(&seed));
+		if (off + n > data_size)
+			n = data_size - off;
+		memcpy(data + off, tmp, n);
+		off += n;
+	}
+}
+
+static void load_data(const char *file)
+{
+	size_t off = 0;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		die(file);
+	while (off < data_size) {
+		ssize_t n = read(fd, data + off, data_size - off);
+
+		if (n < 0)
+			die(file);
+		if (!n) {
+			if (!off) {
+				fprintf(stderr, "%s is empty\n", file);
+				exit(1);
+			}
+			lseek(fd, 0, SEEK_SET);
+			continue;
+		}
+		off += n;
+	}
+	close(fd);
+}
+
+static void *io_worker(void *arg)
+{
+	struct worker *w = arg;
+	size_t off;
+	char *buf;
+	int fd;
+
+	if (posix_memalign((void **)&buf, 4096, CHUNK))
+		die("posix_memalign");
+	fd = open(dev_path, (w->write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		die(dev_path);
+
+	for (off = w->start; off < w->start + w->len; off += CHUNK) {
+		ssize_t n;
+
+		if (w->write) {
+			memcpy(buf, data + off, CHUNK);
+			n = pwrite(fd, buf, CHUNK, off);
+		} else {
+			n = pread(fd, buf, CHUNK, off);
+		}
+		if (n != CHUNK)
+			die(w->write ? "pwrite" : "pread");
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/* Runs the workers over the whole data set and returns MB/s */
+static double run_io(struct worker *workers, int write)
+{
+	size_t per = data_size / nr_threads;
+	double t0, t1;
+	int i;
+
+	t0 = now_s();
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].write = write;
+		workers[i].start = i * per;
+		workers[i].len = i == nr_threads - 1 ?
+				 data_size - i * per : per;
+		if (pthread_create(&workers[i].thread, NULL, io_worker,
+				   &workers[i]))
+			die("pthread_create");
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	t1 = now_s();
+
+	return data_size / (1024.0 * 1024.0) / (t1 - t0);
+}
+
+static void bench_algo(const char *algo, struct worker *workers)
+{
+	unsigned long long orig, compr, used;
+	double wr, rd;
+	char size[32];
+
+	sysfs_write("reset", "1");
+	sysfs_write("comp_algorithm", algo);
+	snprintf(size, sizeof(size), "%zu", data_size);
+	sysfs_write("disksize", size);
+
+	wr = run_io(workers, 1);
+	orig = sysfs_read_ull("orig_data_size");
+	compr = sysfs_read_ull("compr_data_size");
+	used = sysfs_read_ull("mem_used_total");
+	rd = run_io(workers, 0);
+
+	printf("%-8s write %8.1f MB/s  read %8.1f MB/s  ratio %5.2f  "
+	       "mem_used %llu KB\n", algo, wr, rd,
+	       compr ? (double)orig / compr : 0.0, used >> 10);
+
+	sysfs_write("reset", "1");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d device] [-f data file] [-s MB] "
+		"[-t threads] [-a algorithm]...\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *algos[MAX_ALGOS], list[128], *tok, *save;
+	const char *file = NULL;
+	struct worker *workers;
+	int nr_algos = 0, opt, i;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "d:f:s:t:a:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev_path = optarg;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 's':
+			data_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'a':
+			if (nr_algos == MAX_ALGOS)
+				usage(argv[0]);
+			algos[nr_algos++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || !data_size)
+		usage(argv[0]);
+	/* Whole chunks per thread */
+	data_size -= data_size % ((size_t)CHUNK * nr_threads);
+	if (!data_size)
+		usage(argv[0]);
+
+	snprintf(sysfs_dir, sizeof(sysfs_dir), "/sys/block/%s",
+		 basename(strdupa(dev_path)));
+
+	if (!nr_algos) {
+		sysfs_read("comp_algorithm", list, sizeof(list));
+		for (tok = strtok_r(list, " []\n", &save);
+		     tok && nr_algos < MAX_ALGOS;
+		     tok = strtok_r(NULL, " []\n", &save))
+			algos[nr_algos++] = tok;
+	}
+
+	data = malloc(data_size);
+	if (!data)
+		die("malloc");
+	if (file)
+		load_data(file);
+	else
+		generate_data();
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+
+	printf("%s: %zu MB, %d threads, data %s\n", dev_path,
+	       data_size >> 20, nr_threads, file ? file : "generated");
+	for (i = 0; i < nr_algos; i++)
+		bench_algo(algos[i], workers);
+
+	return 0;
+}
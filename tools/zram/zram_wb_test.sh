@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# zram_wb_test.sh - exercise zram writeback to a loop backed device
+#
+# Sets up a zram device with a loop device over a plain file as its
+# backing device, fills it with half incompressible and half text data,
+# writes back the huge pages and then all idle pages, drops the page
+# cache and reads everything back.  Checks the data and prints the
+# bd_* counters and latencies after each step.
+#
+# Needs CONFIG_ZRAM_WRITEBACK, root, losetup and cmp.  The zram device
+# must not be in use; it is reset before and after the test.
+#
+# usage: zram_wb_test.sh [zram device] [size in MB] [scratch directory]
+#
+# This program can be distributed under the terms of the GNU GPL v2.
+
+ZRAM=${1:-zram0}
+SIZE_MB=${2:-32}
+TMP=${3:-/data/local/tmp}
+
+SYS=/sys/block/$ZRAM
+DEV=/dev/block/$ZRAM
+[ -b "$DEV" ] || DEV=/dev/$ZRAM
+
+BACKING=$TMP/zram_wb_backing
+DATA=$TMP/zram_wb_data
+READBACK=$TMP/zram_wb_readback
+HALF=$((SIZE_MB / 2))
+
+fail() {
+	echo "FAIL: $*"
+	cleanup
+	exit 1
+}
+
+cleanup() {
+	echo 1 > $SYS/reset
+	[ -n "$LOOP" ] && losetup -d $LOOP
+	rm -f $BACKING $DATA $READBACK
+}
+
+stats() {
+	echo "$1: bd_count $(cat $SYS/bd_count)" \
+	     "bd_writes $(cat $SYS/bd_writes)" \
+	     "bd_reads $(cat $SYS/bd_reads)" \
+	     "write latency $(cat $SYS/bd_write_latency_us) us" \
+	     "read latency $(cat $SYS/bd_read_latency_us) us"
+}
+
+[ -e $SYS/backing_dev ] || fail "$SYS/backing_dev missing, no CONFIG_ZRAM_WRITEBACK?"
+
+echo 1 > $SYS/reset
+
+dd if=/dev/zero of=$BACKING bs=1048576 count=$SIZE_MB 2>/dev/null ||
+	fail "cannot create $BACKING"
+LOOP=$(losetup -f) || fail "no free loop device"
+losetup $LOOP $BACKING || fail "losetup $LOOP"
+
+echo $LOOP > $SYS/backing_dev || fail "cannot set backing_dev"
+echo $((SIZE_MB * 1048576)) > $SYS/disksize || fail "cannot set disksize"
+
+# First half random, so it is stored uncompressed, second half text
+dd if=/dev/urandom of=$DATA bs=1048576 count=$HALF 2>/dev/null
+i=0
+while [ $i -lt $HALF ]; do
+	yes "zram writeback test data, megabyte $i" | head -c 1048576 >> $DATA
+	i=$((i + 1))
+done
+dd if=$DATA of=$DEV bs=1048576 2>/dev/null || fail "write to $DEV"
+sync
+stats "written"
+
+echo huge > $SYS/writeback || fail "writeback huge"
+stats "huge written back"
+[ $(cat $SYS/bd_count) -gt 0 ] || fail "no huge page was written back"
+
+echo all > $SYS/idle || fail "idle"
+echo idle > $SYS/writeback || fail "writeback idle"
+stats "idle written back"
+
+echo 3 > /proc/sys/vm/drop_caches
+dd if=$DEV of=$READBACK bs=1048576 count=$SIZE_MB 2>/dev/null ||
+	fail "read from $DEV"
+stats "read back"
+[ $(cat $SYS/bd_reads) -gt 0 ] || fail "nothing was read from $LOOP"
+cmp -s $DATA $READBACK || fail "data read back differs"
+
+cleanup
+echo PASS